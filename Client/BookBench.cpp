@@ -0,0 +1,189 @@
+//------------------------------------------------------------------------------
+//
+// Book builder benchmark: a full-rate synthetic feed applied on one core
+//
+//------------------------------------------------------------------------------
+
+#include <chrono>
+#include <cstdlib>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "BookBench.h"
+#include "BookBuilder.h"
+
+using namespace std;
+
+namespace {
+
+// The book a symbol's feed was generated from, what the local book must end up as
+struct reference_book
+{
+    string symbol;
+    map<int32_t, uint32_t, greater<>> bids;     // best first
+    map<int32_t, uint32_t> asks;
+    uint64_t sequence = 0;
+};
+
+// Same wire format as the server's book channel, snapshot lines carry no timestamp
+void
+append_level(string& feed, char side, int32_t price, uint32_t quantity)
+{
+    format_to(back_inserter(feed), "{} {} {}\n", side, price, quantity);
+}
+
+void
+append_level(string& feed, char side, int32_t price, uint32_t quantity, uint64_t timestamp)
+{
+    format_to(back_inserter(feed), "{} {} {} {}\n", side, price, quantity, timestamp);
+}
+
+template <class Levels>
+bool
+matches(book_side const& side, Levels const& levels)
+{
+    if (side.size() != levels.size())
+        return false;
+
+    size_t level = 0;
+    for (auto const& [price, quantity] : levels)
+    {
+        if (side.price(level) != price || side.quantity(level) != quantity)
+            return false;
+        ++level;
+    }
+    return true;
+}
+
+} // namespace
+
+int
+run_book_benchmark(size_t symbols, size_t messages)
+{
+    if (symbols == 0)
+    {
+        std::cerr << "book benchmark needs at least one symbol\n";
+        return EXIT_FAILURE;
+    }
+
+    constexpr int32_t mid = 10000;
+    constexpr int32_t depth = 20;       // levels per side in the snapshot
+    constexpr int32_t range = 25;       // updates touch this many prices from the inside out
+
+    mt19937 random(42);
+    uniform_int_distribution<uint32_t> quantities(1, 1000);
+    uniform_int_distribution<int32_t> priceOffsets(0, range - 1);
+    uniform_int_distribution<int> percent(0, 99);
+
+    vector<reference_book> references(symbols);
+
+    // The whole feed is generated up front into one buffer, so the timed loop
+    // below measures nothing but parsing and applying
+    string feed;
+    vector<string_view> feedMessages;
+    vector<size_t> starts;
+    starts.reserve(symbols + messages + 1);
+
+    for (size_t i = 0; i < symbols; ++i)
+    {
+        reference_book& reference = references[i];
+        reference.symbol = format("S{:05}", i);
+
+        starts.push_back(feed.size());
+        format_to(back_inserter(feed), "snapshot {} 0 0\n", reference.symbol);
+        for (int32_t level = 0; level < depth; ++level)
+        {
+            uint32_t quantity = quantities(random);
+            reference.bids[mid - 1 - level] = quantity;
+            append_level(feed, 'B', mid - 1 - level, quantity);
+        }
+        for (int32_t level = 0; level < depth; ++level)
+        {
+            uint32_t quantity = quantities(random);
+            reference.asks[mid + 1 + level] = quantity;
+            append_level(feed, 'A', mid + 1 + level, quantity);
+        }
+    }
+
+    size_t levelCount = 0;
+    uint64_t timestamp = 1'700'000'000'000'000'000;
+    for (size_t m = 0; m < messages; ++m, timestamp += 1000)
+    {
+        reference_book& reference = references[m % symbols];
+
+        starts.push_back(feed.size());
+        format_to(back_inserter(feed), "update {} {}\n", reference.symbol, reference.sequence + 1);
+
+        // One to three touched levels, about one in six removes a level
+        int const touched = 1 + percent(random) % 3;
+        for (int t = 0; t < touched; ++t)
+        {
+            bool const bid = percent(random) < 50;
+            int32_t const price = bid ? mid - 1 - priceOffsets(random) : mid + 1 + priceOffsets(random);
+            uint32_t const quantity = percent(random) < 16 ? 0 : quantities(random);
+
+            if (bid)
+            {
+                if (quantity)
+                    reference.bids[price] = quantity;
+                else
+                    reference.bids.erase(price);
+            }
+            else
+            {
+                if (quantity)
+                    reference.asks[price] = quantity;
+                else
+                    reference.asks.erase(price);
+            }
+            append_level(feed, bid ? 'B' : 'A', price, quantity, timestamp);
+            ++reference.sequence;
+            ++levelCount;
+        }
+    }
+    starts.push_back(feed.size());
+
+    feedMessages.reserve(starts.size() - 1);
+    for (size_t i = 0; i + 1 < starts.size(); ++i)
+        feedMessages.emplace_back(feed.data() + starts[i], starts[i + 1] - starts[i]);
+
+    book_builder builder;
+    uint64_t topEvents = 0;
+    builder.on_top_of_book([&topEvents](string_view, top_of_book const&) { ++topEvents; });
+
+    // Snapshots are the sync phase, only the update stream is timed
+    for (size_t i = 0; i < symbols; ++i)
+        builder.apply(feedMessages[i]);
+
+    auto const start = chrono::steady_clock::now();
+    for (size_t i = symbols; i < feedMessages.size(); ++i)
+        builder.apply(feedMessages[i]);
+    double const seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    size_t mismatched = 0;
+    for (auto const& reference : references)
+    {
+        local_book const* book = builder.find(reference.symbol);
+        if (!book || !book->live || book->sequence != reference.sequence
+            || !matches(book->bids, reference.bids) || !matches(book->asks, reference.asks))
+            ++mismatched;
+    }
+
+    std::cout
+        << symbols << " symbols, " << messages << " updates, " << levelCount << " levels, "
+        << (feed.size() >> 20) << " MiB in " << seconds << "s\n"
+        << static_cast<double>(messages) / seconds << " msgs/s, "
+        << static_cast<double>(levelCount) / seconds << " levels/s, "
+        << seconds * 1e9 / static_cast<double>(messages) << " ns/msg, "
+        << topEvents << " top-of-book events, "
+        << builder.gaps() << " gaps, "
+        << mismatched << " books differ from the feed"
+        << std::endl;
+
+    return mismatched == 0 && builder.gaps() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,15 @@
+#ifndef BOOK_BENCH_H
+#define BOOK_BENCH_H
+
+#include <cstddef>
+
+// Generates a synthetic book feed for the given number of symbols, one
+// levels snapshot each followed by messages sequenced updates round robin,
+// and times book_builder applying all of it on the calling thread. Checks
+// every local book against the book the feed was generated from and prints
+// messages, levels and top-of-book events per second. Returns a process
+// exit code.
+int
+run_book_benchmark(std::size_t symbols, std::size_t messages);
+
+#endif
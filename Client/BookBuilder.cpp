@@ -0,0 +1,308 @@
+//------------------------------------------------------------------------------
+//
+// Client-side book builder: levels snapshot plus sequenced level updates
+//
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <charconv>
+#include "BookBuilder.h"
+
+using namespace std;
+
+namespace {
+
+// Splits the next newline terminated line off text
+bool
+next_line(string_view& text, string_view& line)
+{
+    if (text.empty())
+        return false;
+
+    size_t end = text.find('\n');
+    if (end == string_view::npos)
+        end = text.size();
+
+    line = text.substr(0, end);
+    text.remove_prefix(std::min(end + 1, text.size()));
+    return true;
+}
+
+// Splits the next space separated field off text
+string_view
+next_field(string_view& text)
+{
+    size_t end = text.find(' ');
+    if (end == string_view::npos)
+        end = text.size();
+
+    string_view field = text.substr(0, end);
+    text.remove_prefix(std::min(end + 1, text.size()));
+    return field;
+}
+
+template <class Number>
+bool
+parse_number(string_view field, Number& value)
+{
+    auto [end, ec] = from_chars(field.data(), field.data() + field.size(), value);
+    return ec == errc{} && end == field.data() + field.size();
+}
+
+// Applies "B|A PRICE QUANTITY [TIMESTAMP]" lines numbered from first, skipping
+// those at or below the book's sequence. In delta form every price and
+// timestamp after the first line is the difference from the line before.
+// Stops at the first malformed line.
+bool
+apply_levels(local_book& book, uint64_t first, string_view levels, bool delta)
+{
+    int64_t previousPrice = 0;
+    int64_t previousTimestamp = 0;
+
+    string_view line;
+    for (uint64_t sequence = first; next_line(levels, line); ++sequence)
+    {
+        string_view side = next_field(line);
+        int64_t price;
+        uint32_t quantity;
+        if (!parse_number(next_field(line), price) || !parse_number(next_field(line), quantity))
+            return false;
+
+        int64_t timestamp = 0;
+        if (!line.empty() && !parse_number(line, timestamp))
+            return false;
+
+        if (delta)
+        {
+            price += previousPrice;
+            timestamp += previousTimestamp;
+        }
+        previousPrice = price;
+        previousTimestamp = timestamp;
+
+        if (sequence <= book.sequence)
+            continue;
+        book.sequence = sequence;
+        if (!line.empty())
+            book.timestamp = static_cast<uint64_t>(timestamp);
+
+        if (side == "B")
+            book.bids.set(static_cast<int32_t>(price), quantity);
+        else if (side == "A")
+            book.asks.set(static_cast<int32_t>(price), quantity);
+        else
+            return false;
+    }
+    return true;
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+
+book_side::book_side(bool bids)
+    : bids_(bids)
+{
+    // Enough for a typical book, so the first updates after a snapshot do not grow it
+    prices_.reserve(64);
+    quantities_.reserve(64);
+}
+
+void
+book_side::clear()
+{
+    prices_.clear();
+    quantities_.clear();
+}
+
+void
+book_side::set(int32_t price, uint32_t quantity)
+{
+    size_t const level = std::lower_bound(prices_.begin(), prices_.end(), price,
+        [this](int32_t a, int32_t b) { return is_worse(a, b); }) - prices_.begin();
+
+    if (level != prices_.size() && prices_[level] == price)
+    {
+        if (quantity != 0)
+        {
+            quantities_[level] = quantity;
+        }
+        else
+        {
+            prices_.erase(prices_.begin() + level);
+            quantities_.erase(quantities_.begin() + level);
+        }
+    }
+    else if (quantity != 0)
+    {
+        prices_.insert(prices_.begin() + level, price);
+        quantities_.insert(quantities_.begin() + level, quantity);
+    }
+}
+
+size_t
+book_side::size() const
+{
+    return prices_.size();
+}
+
+int32_t
+book_side::price(size_t level) const
+{
+    return prices_[prices_.size() - 1 - level];
+}
+
+uint32_t
+book_side::quantity(size_t level) const
+{
+    return quantities_[quantities_.size() - 1 - level];
+}
+
+top_of_book
+local_book::top() const
+{
+    top_of_book top;
+    if (bids.size())
+    {
+        top.bid_price = bids.price(0);
+        top.bid_quantity = bids.quantity(0);
+    }
+    if (asks.size())
+    {
+        top.ask_price = asks.price(0);
+        top.ask_quantity = asks.quantity(0);
+    }
+    return top;
+}
+
+//------------------------------------------------------------------------------
+
+void
+book_builder::on_top_of_book(top_of_book_handler handler)
+{
+    top_of_book_handler_ = std::move(handler);
+}
+
+void
+book_builder::on_gap(gap_handler handler)
+{
+    gap_handler_ = std::move(handler);
+}
+
+bool
+book_builder::apply(string_view message)
+{
+    string_view levels = message;
+    string_view header;
+    if (!next_line(levels, header))
+        return false;
+
+    string_view const kind = next_field(header);
+    string_view const symbol = next_field(header);
+    uint64_t sequence;
+    if (symbol.empty() || !parse_number(next_field(header), sequence))
+        return false;
+
+    if (kind == "update" || kind == "dupdate")
+    {
+        apply_update(symbol, book(symbol), sequence, levels, message, kind == "dupdate");
+    }
+    else if (kind == "snapshot" || kind == "dsnapshot")
+    {
+        uint64_t timestamp = 0;
+        if (!header.empty() && !parse_number(header, timestamp))
+            return false;
+        apply_snapshot(symbol, book(symbol), sequence, timestamp, levels, kind == "dsnapshot");
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+local_book const*
+book_builder::find(string_view symbol) const
+{
+    auto it = books_.find(symbol);
+    return it != books_.end() ? &it->second : nullptr;
+}
+
+uint64_t
+book_builder::gaps() const
+{
+    return gaps_;
+}
+
+local_book&
+book_builder::book(string_view symbol)
+{
+    auto it = books_.find(symbol);
+    if (it == books_.end())
+        it = books_.emplace(string(symbol), local_book{}).first;
+    return it->second;
+}
+
+void
+book_builder::apply_snapshot(string_view symbol, local_book& book, uint64_t sequence, uint64_t timestamp, string_view levels, bool delta)
+{
+    top_of_book const before = book.top();
+    bool const was_live = book.live;
+
+    // Snapshot lines carry no sequence numbers of their own, numbering them
+    // from one on an empty book applies every one of them
+    book.bids.clear();
+    book.asks.clear();
+    book.sequence = 0;
+    book.live = apply_levels(book, 1, levels, delta);
+    book.sequence = sequence;
+    book.timestamp = timestamp;
+    if (!book.live)
+        return;
+
+    if (top_of_book_handler_ && (!was_live || book.top() != before))
+        top_of_book_handler_(symbol, book.top());
+
+    // Updates that overtook the snapshot, those it already covers are skipped by sequence
+    vector<string> pending;
+    pending.swap(book.pending);
+    for (auto const& message : pending)
+        apply(message);
+}
+
+void
+book_builder::apply_update(string_view symbol, local_book& book, uint64_t sequence, string_view levels, string_view message, bool delta)
+{
+    if (!book.live)
+    {
+        if (book.pending.size() < max_pending)
+            book.pending.emplace_back(message);
+        return;
+    }
+
+    if (sequence > book.sequence + 1)
+    {
+        ++gaps_;
+        book.live = false;
+        book.pending.emplace_back(message);
+        if (gap_handler_)
+            gap_handler_(symbol, book.sequence + 1, sequence);
+        return;
+    }
+
+    top_of_book const before = book.top();
+
+    // Lines the book already has, from the snapshot it was built from, are skipped.
+    // A malformed update leaves the book in an unknown state, treat it as a gap.
+    if (!apply_levels(book, sequence, levels, delta))
+    {
+        ++gaps_;
+        book.live = false;
+        if (gap_handler_)
+            gap_handler_(symbol, book.sequence + 1, book.sequence + 1);
+        return;
+    }
+
+    if (top_of_book_handler_ && book.top() != before)
+        top_of_book_handler_(symbol, book.top());
+}
@@ -0,0 +1,139 @@
+#ifndef BOOK_BUILDER_H
+#define BOOK_BUILDER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Best bid and offer of one symbol, a side with no levels has zero quantity
+struct top_of_book
+{
+    std::int32_t bid_price = 0;
+    std::uint32_t bid_quantity = 0;
+    std::int32_t ask_price = 0;
+    std::uint32_t ask_quantity = 0;
+
+    bool operator==(top_of_book const&) const = default;
+};
+
+// One side of a local book. Levels are parallel arrays sorted worst to best
+// like the server's, so the best level is at the back and the updates a feed
+// mostly sends, near the top, move little or nothing.
+class book_side
+{
+    std::vector<std::int32_t> prices_;
+    std::vector<std::uint32_t> quantities_;
+    bool bids_;
+
+    bool
+    is_worse(std::int32_t price, std::int32_t other) const
+    {
+        return bids_ ? price < other : price > other;
+    }
+
+public:
+    explicit
+    book_side(bool bids);
+
+    void
+    clear();
+
+    // Sets the aggregate quantity at price, zero removes the level
+    void
+    set(std::int32_t price, std::uint32_t quantity);
+
+    std::size_t
+    size() const;
+
+    // level 0 is the best
+    std::int32_t
+    price(std::size_t level) const;
+
+    std::uint32_t
+    quantity(std::size_t level) const;
+};
+
+// Local copy of one symbol's book, built from a levels snapshot and kept
+// current by level updates
+struct local_book
+{
+    book_side bids{ true };
+    book_side asks{ false };
+    std::uint64_t sequence = 0;         // last level update applied, or the snapshot's
+    std::uint64_t timestamp = 0;        // server clock, epoch nanoseconds, of that update or snapshot
+    bool live = false;                  // false until a snapshot arrives and again after a gap
+    std::vector<std::string> pending;   // updates received while not live, replayed after the snapshot
+
+    top_of_book
+    top() const;
+};
+
+// Applies "snapshot"/"update" messages from the server's book channel, or
+// their delta encoded "dsnapshot"/"dupdate" forms, to one local book per
+// symbol. Every level update carries its own sequence
+// number, consecutive per symbol: an update message numbers its first line
+// and the rest follow on. A gap takes the symbol out of the live state and
+// is reported so the caller can send "book:SYMBOL" again for a fresh snapshot.
+// Once the levels of a book have reached their working size, applying a
+// message allocates nothing.
+class book_builder
+{
+public:
+    using top_of_book_handler = std::function<void(std::string_view symbol, top_of_book const& top)>;
+    using gap_handler = std::function<void(std::string_view symbol, std::uint64_t expected, std::uint64_t received)>;
+
+    // At most this many updates are held per symbol while waiting for a snapshot
+    static constexpr std::size_t max_pending = 1024;
+
+    // Called after a message changes the best bid or offer of a live book
+    void
+    on_top_of_book(top_of_book_handler handler);
+
+    // Called when an update skips ahead of the next expected sequence number
+    void
+    on_gap(gap_handler handler);
+
+    // Returns false when the message is not part of the book feed, trades
+    // and text snapshots for example, or is malformed
+    bool
+    apply(std::string_view message);
+
+    local_book const*
+    find(std::string_view symbol) const;
+
+    std::uint64_t
+    gaps() const;
+
+private:
+    // Lets find() take a string_view without building a string
+    struct symbol_hash
+    {
+        using is_transparent = void;
+
+        std::size_t
+        operator()(std::string_view symbol) const
+        {
+            return std::hash<std::string_view>{}(symbol);
+        }
+    };
+
+    std::unordered_map<std::string, local_book, symbol_hash, std::equal_to<>> books_;
+    top_of_book_handler top_of_book_handler_;
+    gap_handler gap_handler_;
+    std::uint64_t gaps_ = 0;
+
+    local_book&
+    book(std::string_view symbol);
+
+    void
+    apply_snapshot(std::string_view symbol, local_book& book, std::uint64_t sequence, std::uint64_t timestamp, std::string_view levels, bool delta);
+
+    void
+    apply_update(std::string_view symbol, local_book& book, std::uint64_t sequence, std::string_view levels, std::string_view message, bool delta);
+};
+
+#endif
@@ -1,271 +1,361 @@
-//
-// Copyright (c) 2016-2019 Vinnie Falco (vinnie dot falco at gmail dot com)
-//
-// Distributed under the Boost Software License, Version 1.0. (See accompanying
-// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
-//
-// Official repository: https://github.com/boostorg/beast
-//
-//------------------------------------------------------------------------------
-//
-// Example: WebSocket client, asynchronous
-//
-//------------------------------------------------------------------------------
-
-#include <boost/beast/core.hpp>
-#include <boost/beast/websocket.hpp>
-#include <boost/asio/strand.hpp>
-#include <cstdlib>
-#include <functional>
-#include <iostream>
-#include <memory>
-#include <string>
-
-namespace beast = boost::beast;         // from <boost/beast.hpp>
-namespace http = beast::http;           // from <boost/beast/http.hpp>
-namespace websocket = beast::websocket; // from <boost/beast/websocket.hpp>
-namespace net = boost::asio;            // from <boost/asio.hpp>
-using tcp = boost::asio::ip::tcp;       // from <boost/asio/ip/tcp.hpp>
-using namespace std;
-
-//------------------------------------------------------------------------------
-
-// Report a failure
-void
-fail(beast::error_code ec, char const* what)
-{
-    std::cerr << what << ": " << ec.message() << "\n";
-}
-
-// Sends a WebSocket message and prints the response
-class session : public std::enable_shared_from_this<session>
-{
-    tcp::resolver resolver_;
-    websocket::stream<beast::tcp_stream> ws_;
-    beast::flat_buffer buffer_;
-    std::string host_;
-    std::string text_;
-
-public:
-    // Resolver and socket require an io_context
-    explicit
-        session(net::io_context& ioc)
-        : resolver_(net::make_strand(ioc))
-        , ws_(net::make_strand(ioc))
-    {
-    }
-
-    // Start the asynchronous operation
-    void
-        run(
-            char const* host,
-            char const* port,
-            char const* text)
-    {
-        // Save these for later
-        host_ = host;
-        text_ = text;
-
-        // Look up the domain name
-        resolver_.async_resolve(
-            host,
-            port,
-            beast::bind_front_handler(
-                &session::on_resolve,
-                shared_from_this()));
-    }
-
-    void
-        on_resolve(
-            beast::error_code ec,
-            tcp::resolver::results_type results)
-    {
-        if (ec)
-            return fail(ec, "resolve");
-
-        // Set the timeout for the operation
-        beast::get_lowest_layer(ws_).expires_after(std::chrono::seconds(30));
-
-        // Make the connection on the IP address we get from a lookup
-        beast::get_lowest_layer(ws_).async_connect(
-            results,
-            beast::bind_front_handler(
-                &session::on_connect,
-                shared_from_this()));
-    }
-
-    void
-        on_connect(beast::error_code ec, tcp::resolver::results_type::endpoint_type)
-    {
-        if (ec)
-            return fail(ec, "connect");
-
-        // Turn off the timeout on the tcp_stream, because
-        // the websocket stream has its own timeout system.
-        beast::get_lowest_layer(ws_).expires_never();
-
-        // Set suggested timeout settings for the websocket
-        ws_.set_option(
-            websocket::stream_base::timeout::suggested(
-                beast::role_type::client));
-
-        // Set a decorator to change the User-Agent of the handshake
-        ws_.set_option(websocket::stream_base::decorator(
-            [](websocket::request_type& req)
-            {
-                req.set(http::field::user_agent,
-                    std::string(BOOST_BEAST_VERSION_STRING) +
-                    " websocket-client-async");
-            }));
-
-        // Perform the websocket handshake
-        ws_.async_handshake(host_, "/",
-            beast::bind_front_handler(
-                &session::on_handshake,
-                shared_from_this()));
-    }
-
-    void
-        on_handshake(beast::error_code ec)
-    {
-        if (ec)
-            return fail(ec, "handshake");
-    }
-
-    void
-        write(string message) 
-    {
-        // Clear the buffer
-        buffer_.consume(buffer_.size());
-
-        // Allocate space in the buffer
-        auto size = message.size();
-        auto buffer_space = buffer_.prepare(size);
-        // Copy the data into the buffer
-        memcpy(buffer_space.data(), message.data(), size);
-        // Commit the data to the buffer
-        buffer_.commit(size);
-
-        // Send the message
-        ws_.async_write(
-            buffer_.data(),
-            beast::bind_front_handler(
-                &session::on_write,
-                shared_from_this()));
-    }
-
-    void
-        on_write(
-            beast::error_code ec,
-            std::size_t bytes_transferred)
-    {
-        boost::ignore_unused(bytes_transferred);
-
-        if (ec)
-            return fail(ec, "write");
-    }
-
-    void
-        read() 
-    {
-        // Read a message into our buffer
-        ws_.async_read(
-            buffer_,
-            beast::bind_front_handler(
-                &session::on_read,
-                shared_from_this()));
-    }
-
-    void
-        on_read(
-            beast::error_code ec,
-            std::size_t bytes_transferred)
-    {
-        boost::ignore_unused(bytes_transferred);
-
-        if (ec)
-            return fail(ec, "read");
-
-        // The make_printable() function helps print a ConstBufferSequence
-        std::cout << beast::make_printable(buffer_.data()) << std::endl;
-
-        // Clear the buffer
-        buffer_.consume(buffer_.size());
-    }
-
-    void close() 
-    {
-        // Close the WebSocket connection
-        ws_.async_close(websocket::close_code::normal,
-            beast::bind_front_handler(
-                &session::on_close,
-                shared_from_this()));
-    }
-
-    void
-        on_close(beast::error_code ec)
-    {
-        if (ec)
-            return fail(ec, "close");
-
-        // If we get here then the connection is closed gracefully
-    }
-};
-
-//------------------------------------------------------------------------------
-
-int main(int argc, char** argv)
-{
-    // Check command line arguments.
-    if (argc != 4)
-    {
-        std::cerr <<
-            "Usage: websocket-client-async <host> <port> <text>\n" <<
-            "Example:\n" <<
-            "    websocket-client-async echo.websocket.org 80 \"Hello, world!\"\n";
-        return EXIT_FAILURE;
-    }
-    auto const host = argv[1];
-    auto const port = argv[2];
-    auto const text = argv[3];
-
-    // The io_context is required for all I/O
-    net::io_context ioc;
-
-    // Create a work guard to keep io_context alive
-    auto work_guard = net::make_work_guard(ioc);
-
-    // Create a session object
-    auto ourSession = std::make_shared<session>(ioc);
-
-    // Start a thread to run the io_context
-    std::thread io_thread([&ioc, &ourSession, &host, &port, &text]() {
-        std::cout << "io_context is running..." << std::endl;
-
-        // Step 1: Register asynchronous tasks (e.g., connect, write, read) with the io_context
-        ourSession->run(host, port, text);
-
-        // Step 2: Start processing the tasks (event loop)
-        ioc.run();
-
-        std::cout << "io_context has stopped!" << std::endl;
-        });
-
-    ourSession->write("subscribe:META");
-
-    while (1) {
-        ourSession->read();
-        this_thread::sleep_for(std::chrono::milliseconds(250));
-    }
-
-    // Step 3: Release the work guard to allow io_context to exit after tasks complete
-    work_guard.reset();
-
-    // Wait for the io_context thread to finish
-    io_thread.join();
-
-    // close the asynchronous operation
-    ourSession->close();
-
-    return EXIT_SUCCESS;
+//
+// Copyright (c) 2016-2019 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/boostorg/beast
+//
+//------------------------------------------------------------------------------
+//
+// Example: WebSocket client, asynchronous
+//
+//------------------------------------------------------------------------------
+
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/asio/strand.hpp>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "BookBench.h"
+#include "LoadTest.h"
+#include "OrderEntryTest.h"
+
+namespace beast = boost::beast;         // from <boost/beast.hpp>
+namespace http = beast::http;           // from <boost/beast/http.hpp>
+namespace websocket = beast::websocket; // from <boost/beast/websocket.hpp>
+namespace net = boost::asio;            // from <boost/asio.hpp>
+using tcp = boost::asio::ip::tcp;       // from <boost/asio/ip/tcp.hpp>
+using namespace std;
+
+//------------------------------------------------------------------------------
+
+// Report a failure
+void
+fail(beast::error_code ec, char const* what)
+{
+    std::cerr << what << ": " << ec.message() << "\n";
+}
+
+// Sends a WebSocket message and prints the response
+class session : public std::enable_shared_from_this<session>
+{
+    tcp::resolver resolver_;
+    websocket::stream<beast::tcp_stream> ws_;
+    beast::flat_buffer buffer_;
+    std::string host_;
+    std::string text_;
+
+public:
+    // Resolver and socket require an io_context
+    explicit
+        session(net::io_context& ioc)
+        : resolver_(net::make_strand(ioc))
+        , ws_(net::make_strand(ioc))
+    {
+    }
+
+    // Start the asynchronous operation
+    void
+        run(
+            char const* host,
+            char const* port,
+            char const* text)
+    {
+        // Save these for later
+        host_ = host;
+        text_ = text;
+
+        // Look up the domain name
+        resolver_.async_resolve(
+            host,
+            port,
+            beast::bind_front_handler(
+                &session::on_resolve,
+                shared_from_this()));
+    }
+
+    void
+        on_resolve(
+            beast::error_code ec,
+            tcp::resolver::results_type results)
+    {
+        if (ec)
+            return fail(ec, "resolve");
+
+        // Set the timeout for the operation
+        beast::get_lowest_layer(ws_).expires_after(std::chrono::seconds(30));
+
+        // Make the connection on the IP address we get from a lookup
+        beast::get_lowest_layer(ws_).async_connect(
+            results,
+            beast::bind_front_handler(
+                &session::on_connect,
+                shared_from_this()));
+    }
+
+    void
+        on_connect(beast::error_code ec, tcp::resolver::results_type::endpoint_type)
+    {
+        if (ec)
+            return fail(ec, "connect");
+
+        // Turn off the timeout on the tcp_stream, because
+        // the websocket stream has its own timeout system.
+        beast::get_lowest_layer(ws_).expires_never();
+
+        // Set suggested timeout settings for the websocket
+        ws_.set_option(
+            websocket::stream_base::timeout::suggested(
+                beast::role_type::client));
+
+        // Set a decorator to change the User-Agent of the handshake
+        ws_.set_option(websocket::stream_base::decorator(
+            [](websocket::request_type& req)
+            {
+                req.set(http::field::user_agent,
+                    std::string(BOOST_BEAST_VERSION_STRING) +
+                    " websocket-client-async");
+            }));
+
+        // Perform the websocket handshake
+        ws_.async_handshake(host_, "/",
+            beast::bind_front_handler(
+                &session::on_handshake,
+                shared_from_this()));
+    }
+
+    void
+        on_handshake(beast::error_code ec)
+    {
+        if (ec)
+            return fail(ec, "handshake");
+    }
+
+    void
+        write(string message) 
+    {
+        // Clear the buffer
+        buffer_.consume(buffer_.size());
+
+        // Allocate space in the buffer
+        auto size = message.size();
+        auto buffer_space = buffer_.prepare(size);
+        // Copy the data into the buffer
+        memcpy(buffer_space.data(), message.data(), size);
+        // Commit the data to the buffer
+        buffer_.commit(size);
+
+        // Send the message
+        ws_.async_write(
+            buffer_.data(),
+            beast::bind_front_handler(
+                &session::on_write,
+                shared_from_this()));
+    }
+
+    void
+        on_write(
+            beast::error_code ec,
+            std::size_t bytes_transferred)
+    {
+        boost::ignore_unused(bytes_transferred);
+
+        if (ec)
+            return fail(ec, "write");
+    }
+
+    void
+        read() 
+    {
+        // Read a message into our buffer
+        ws_.async_read(
+            buffer_,
+            beast::bind_front_handler(
+                &session::on_read,
+                shared_from_this()));
+    }
+
+    void
+        on_read(
+            beast::error_code ec,
+            std::size_t bytes_transferred)
+    {
+        boost::ignore_unused(bytes_transferred);
+
+        if (ec)
+            return fail(ec, "read");
+
+        // The make_printable() function helps print a ConstBufferSequence
+        std::cout << beast::make_printable(buffer_.data()) << std::endl;
+
+        // Clear the buffer
+        buffer_.consume(buffer_.size());
+    }
+
+    void close() 
+    {
+        // Close the WebSocket connection
+        ws_.async_close(websocket::close_code::normal,
+            beast::bind_front_handler(
+                &session::on_close,
+                shared_from_this()));
+    }
+
+    void
+        on_close(beast::error_code ec)
+    {
+        if (ec)
+            return fail(ec, "close");
+
+        // If we get here then the connection is closed gracefully
+    }
+};
+
+//------------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+    // Book builder benchmark: synthetic feed, no server needed
+    if (argc == 4 && std::string(argv[1]) == "--bench-book")
+    {
+        auto const symbols = static_cast<std::size_t>(std::max(1, std::atoi(argv[2])));
+        auto const messages = static_cast<std::size_t>(std::max(1, std::atoi(argv[3])));
+        return run_book_benchmark(symbols, messages);
+    }
+
+    // Order entry mode: pipelined requests on one session, ack rate and latency
+    if (argc >= 7 && std::string(argv[1]) == "--orders")
+    {
+        order_entry_options options;
+        options.host = argv[2];
+        options.port = argv[3];
+        options.symbol = argv[4];
+        options.orders = static_cast<std::size_t>(std::max(1, std::atoi(argv[5])));
+        options.batch = static_cast<std::size_t>(std::max(1, std::atoi(argv[6])));
+        options.window = std::max(options.window, options.batch);
+
+        for (int i = 7; i < argc; ++i)
+        {
+            std::string const flag = argv[i];
+            if (flag == "binary")
+                options.binary = true;
+            else if (flag.starts_with("login="))
+                options.login = std::strtoull(flag.c_str() + 6, nullptr, 10);
+            else if (flag.starts_with("stp="))
+                options.stp = static_cast<unsigned>(std::max(0, std::atoi(flag.c_str() + 4)));
+            else
+            {
+                std::cerr << "unknown order entry option: " << flag << "\n";
+                return EXIT_FAILURE;
+            }
+        }
+        return run_order_entry_test(options);
+    }
+
+    // Load test mode: many subscribers, throughput and lag reporting
+    if (argc >= 8 && std::string(argv[1]) == "--load")
+    {
+        load_test_options options;
+        options.host = argv[2];
+        options.port = argv[3];
+
+        std::stringstream symbols(argv[4]);
+        for (std::string symbol; std::getline(symbols, symbol, ',');)
+            if (!symbol.empty())
+                options.symbols.push_back(symbol);
+
+        options.connections = static_cast<std::size_t>(std::max(1, std::atoi(argv[5])));
+        options.threads = static_cast<std::size_t>(std::max(1, std::atoi(argv[6])));
+        options.duration = std::chrono::seconds(std::max(1, std::atoi(argv[7])));
+
+        for (int i = 8; i < argc; ++i)
+        {
+            std::string const flag = argv[i];
+            if (flag == "book")
+                options.book = true;
+            else if (flag == "deflate")
+                options.deflate = true;
+            else if (flag == "delta")
+                options.delta = true;
+            else if (flag.starts_with("batch="))
+                options.batch_bytes = static_cast<std::size_t>(std::max(0, std::atoi(flag.c_str() + 6)));
+            else if (flag.starts_with("linger="))
+                options.linger = std::chrono::microseconds(std::max(0, std::atoi(flag.c_str() + 7)));
+            else
+            {
+                std::cerr << "unknown load test option: " << flag << "\n";
+                return EXIT_FAILURE;
+            }
+        }
+
+        return run_load_test(options);
+    }
+
+    // Check command line arguments.
+    if (argc != 4)
+    {
+        std::cerr <<
+            "Usage: websocket-client-async <host> <port> <text>\n" <<
+            "       websocket-client-async --load <host> <port> <symbols> <connections> <threads> <seconds>\n" <<
+            "                              [book] [deflate] [delta] [batch=<bytes>] [linger=<microseconds>]\n" <<
+            "       websocket-client-async --orders <host> <port> <symbol> <orders> <batch> [binary] [login=<token>] [stp=<0-3>]\n" <<
+            "       websocket-client-async --bench-book <symbols> <messages>\n" <<
+            "Example:\n" <<
+            "    websocket-client-async echo.websocket.org 80 \"Hello, world!\"\n" <<
+            "    websocket-client-async --load 127.0.0.1 8080 META 2000 4 30\n" <<
+            "    websocket-client-async --load 127.0.0.1 8080 META 2000 4 30 book delta deflate batch=16384 linger=2000\n" <<
+            "    websocket-client-async --orders 127.0.0.1 8080 META 1000000 100 binary\n" <<
+            "    websocket-client-async --orders 127.0.0.1 8080 META 100000 100 login=4711 stp=1\n" <<
+            "    websocket-client-async --bench-book 5000 5000000\n";
+        return EXIT_FAILURE;
+    }
+    auto const host = argv[1];
+    auto const port = argv[2];
+    auto const text = argv[3];
+
+    // The io_context is required for all I/O
+    net::io_context ioc;
+
+    // Create a work guard to keep io_context alive
+    auto work_guard = net::make_work_guard(ioc);
+
+    // Create a session object
+    auto ourSession = std::make_shared<session>(ioc);
+
+    // Start a thread to run the io_context
+    std::thread io_thread([&ioc, &ourSession, &host, &port, &text]() {
+        std::cout << "io_context is running..." << std::endl;
+
+        // Step 1: Register asynchronous tasks (e.g., connect, write, read) with the io_context
+        ourSession->run(host, port, text);
+
+        // Step 2: Start processing the tasks (event loop)
+        ioc.run();
+
+        std::cout << "io_context has stopped!" << std::endl;
+        });
+
+    ourSession->write("subscribe:META");
+
+    while (1) {
+        ourSession->read();
+        this_thread::sleep_for(std::chrono::milliseconds(250));
+    }
+
+    // Step 3: Release the work guard to allow io_context to exit after tasks complete
+    work_guard.reset();
+
+    // Wait for the io_context thread to finish
+    io_thread.join();
+
+    // close the asynchronous operation
+    ourSession->close();
+
+    return EXIT_SUCCESS;
 }
\ No newline at end of file
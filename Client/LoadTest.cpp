@@ -0,0 +1,380 @@
+//------------------------------------------------------------------------------
+//
+// Load generator: thousands of concurrent subscribers from a few threads
+//
+//------------------------------------------------------------------------------
+
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include "BookBuilder.h"
+#include "LoadTest.h"
+
+namespace beast = boost::beast;         // from <boost/beast.hpp>
+namespace websocket = beast::websocket; // from <boost/beast/websocket.hpp>
+namespace net = boost::asio;            // from <boost/asio.hpp>
+using tcp = boost::asio::ip::tcp;       // from <boost/asio/ip/tcp.hpp>
+using namespace std;
+
+namespace {
+
+constexpr char record_separator = '\x1e';
+
+// Per-symbol view shared by all connections subscribed to it
+struct load_symbol
+{
+    string name;
+    atomic<uint64_t> leader{ 0 };       // most messages any subscriber has received
+};
+
+// Counters of one connection. Each is written only by the thread running the
+// connection and read by the reporting thread, so relaxed atomics suffice.
+struct load_connection
+{
+    load_symbol* symbol = nullptr;
+    atomic<uint64_t> messages{ 0 };
+    atomic<uint64_t> frames{ 0 };
+    atomic<uint64_t> bytes{ 0 };        // payload, after any decompression
+    atomic<uint64_t> events{ 0 };
+    atomic<uint64_t> gaps{ 0 };
+    atomic<uint64_t> latencySum{ 0 };  // book updates only: arrival time minus the server's event timestamp
+    atomic<uint64_t> latencyCount{ 0 };
+    atomic<uint64_t> latencyMax{ 0 };
+    atomic<bool> open{ false };
+};
+
+void
+add(atomic<uint64_t>& counter, uint64_t value)
+{
+    counter.store(counter.load(memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+// Counts the events carried by one message without copying it: trades are
+// comma terminated, snapshots and level updates carry one level per line
+// after the header
+uint64_t
+count_events(string_view message)
+{
+    if (message.starts_with(" Bids") || message.starts_with("snapshot ") || message.starts_with("update ")
+        || message.starts_with("dsnapshot ") || message.starts_with("dupdate "))
+        return static_cast<uint64_t>(std::count(message.begin(), message.end(), '\n')) - 1;
+    return static_cast<uint64_t>(std::count(message.begin(), message.end(), ','));
+}
+
+// Trades carry the symbol's trade sequence, "Seq: N", consecutive across
+// every trade of the book. Returns the number of breaks in it, each one
+// trades the server dropped because this client fell behind.
+uint64_t
+count_trade_gaps(string_view message, uint64_t& last)
+{
+    static constexpr string_view tag = "Seq: ";
+    uint64_t gaps = 0;
+    for (size_t at = message.find(tag); at != string_view::npos; at = message.find(tag, at))
+    {
+        at += tag.size();
+        uint64_t sequence = 0;
+        while (at < message.size() && message[at] >= '0' && message[at] <= '9')
+            sequence = sequence * 10 + static_cast<uint64_t>(message[at++] - '0');
+        if (last != 0 && sequence != last + 1)
+            ++gaps;
+        last = sequence;
+    }
+    return gaps;
+}
+
+// Server timestamps are epoch nanoseconds, so this is only meaningful with
+// the clocks of both hosts in sync, or client and server on one host
+void
+record_latency(load_connection& connection, local_book const* book)
+{
+    if (!book || !book->live || !book->timestamp)
+        return;
+
+    auto const now = static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(
+        chrono::system_clock::now().time_since_epoch()).count());
+    uint64_t const latency = now > book->timestamp ? now - book->timestamp : 0;
+
+    add(connection.latencySum, latency);
+    add(connection.latencyCount, 1);
+    if (latency > connection.latencyMax.load(memory_order_relaxed))
+        connection.latencyMax.store(latency, memory_order_relaxed);
+}
+
+void
+fail(beast::error_code ec, char const* what)
+{
+    std::cerr << what << ": " << ec.message() << "\n";
+}
+
+net::awaitable<void>
+run_connection(
+    tcp::resolver::results_type endpoints,
+    load_test_options const& options,
+    load_connection& connection)
+{
+    beast::error_code ec;
+    websocket::stream<beast::tcp_stream> ws(co_await net::this_coro::executor);
+
+    beast::get_lowest_layer(ws).expires_after(std::chrono::seconds(30));
+    co_await beast::get_lowest_layer(ws).async_connect(endpoints, net::redirect_error(net::use_awaitable, ec));
+    if (ec)
+    {
+        fail(ec, "connect");
+        co_return;
+    }
+    beast::get_lowest_layer(ws).expires_never();
+
+    ws.set_option(
+        websocket::stream_base::timeout::suggested(
+            beast::role_type::client));
+
+    // Offered in the handshake, the server decides whether to use it
+    if (options.deflate)
+    {
+        websocket::permessage_deflate deflate;
+        deflate.client_enable = true;
+        ws.set_option(deflate);
+    }
+
+    co_await ws.async_handshake(options.host, "/", net::redirect_error(net::use_awaitable, ec));
+    if (ec)
+    {
+        fail(ec, "handshake");
+        co_return;
+    }
+
+    if (options.batch_bytes || options.delta)
+    {
+        string settings = "options:batch=" + to_string(options.batch_bytes)
+            + ",linger=" + to_string(options.linger.count())
+            + ",delta=" + (options.delta ? "1" : "0");
+        co_await ws.async_write(net::buffer(settings), net::redirect_error(net::use_awaitable, ec));
+        if (ec)
+        {
+            fail(ec, "write");
+            co_return;
+        }
+    }
+
+    string subscribe = (options.book ? "book:" : "subscribe:") + connection.symbol->name;
+    co_await ws.async_write(net::buffer(subscribe), net::redirect_error(net::use_awaitable, ec));
+    if (ec)
+    {
+        fail(ec, "write");
+        co_return;
+    }
+
+    connection.open.store(true, memory_order_relaxed);
+
+    // A gap is repaired by subscribing again, which brings a fresh snapshot
+    book_builder builder;
+    bool resubscribe = false;
+    builder.on_gap([&resubscribe](string_view, uint64_t, uint64_t) { resubscribe = true; });
+
+    beast::flat_buffer buffer;
+    uint64_t received = 0;
+    uint64_t trade_sequence = 0;        // last trade sequence seen, trades mode only
+    for (;;)
+    {
+        std::size_t bytes = co_await ws.async_read(buffer, net::redirect_error(net::use_awaitable, ec));
+        if (ec)
+            break;
+
+        auto data = buffer.data();
+        string_view frame(static_cast<char const*>(data.data()), data.size());
+
+        add(connection.frames, 1);
+        add(connection.bytes, bytes);
+
+        // A batched frame holds several messages split by a record separator
+        while (!frame.empty())
+        {
+            size_t const end = std::min(frame.find(record_separator), frame.size());
+            string_view const message = frame.substr(0, end);
+            frame.remove_prefix(std::min(end + 1, frame.size()));
+
+            add(connection.events, count_events(message));
+            if (options.book && builder.apply(message) && (message.starts_with("update ") || message.starts_with("dupdate ")))
+                record_latency(connection, builder.find(connection.symbol->name));
+            else if (!options.book)
+                add(connection.gaps, count_trade_gaps(message, trade_sequence));
+            ++received;
+        }
+        connection.messages.store(received, memory_order_relaxed);
+
+        // Lag is measured against the subscriber furthest ahead on the same symbol
+        uint64_t leader = connection.symbol->leader.load(memory_order_relaxed);
+        while (leader < received && !connection.symbol->leader.compare_exchange_weak(leader, received, memory_order_relaxed))
+            ;
+
+        buffer.consume(buffer.size());
+
+        if (resubscribe)
+        {
+            resubscribe = false;
+            add(connection.gaps, 1);
+            co_await ws.async_write(net::buffer(subscribe), net::redirect_error(net::use_awaitable, ec));
+            if (ec)
+                break;
+        }
+    }
+
+    connection.open.store(false, memory_order_relaxed);
+}
+
+struct load_totals
+{
+    uint64_t messages = 0;
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    uint64_t events = 0;
+    uint64_t gaps = 0;
+    uint64_t latencySum = 0;
+    uint64_t latencyCount = 0;
+    uint64_t latencyMax = 0;
+    size_t open = 0;
+    uint64_t maxLag = 0;
+    double meanLag = 0;
+};
+
+load_totals
+collect(deque<load_connection> const& connections)
+{
+    load_totals totals;
+    uint64_t lagSum = 0;
+
+    for (auto const& connection : connections)
+    {
+        uint64_t messages = connection.messages.load(memory_order_relaxed);
+        totals.messages += messages;
+        totals.frames += connection.frames.load(memory_order_relaxed);
+        totals.bytes += connection.bytes.load(memory_order_relaxed);
+        totals.events += connection.events.load(memory_order_relaxed);
+        totals.gaps += connection.gaps.load(memory_order_relaxed);
+        totals.latencySum += connection.latencySum.load(memory_order_relaxed);
+        totals.latencyCount += connection.latencyCount.load(memory_order_relaxed);
+        totals.latencyMax = std::max(totals.latencyMax, connection.latencyMax.load(memory_order_relaxed));
+
+        if (!connection.open.load(memory_order_relaxed))
+            continue;
+
+        ++totals.open;
+        uint64_t leader = connection.symbol->leader.load(memory_order_relaxed);
+        uint64_t lag = leader > messages ? leader - messages : 0;
+        totals.maxLag = std::max(totals.maxLag, lag);
+        lagSum += lag;
+    }
+    if (totals.open)
+        totals.meanLag = static_cast<double>(lagSum) / static_cast<double>(totals.open);
+    return totals;
+}
+
+// Mean book update latency since previous, and the largest seen so far
+string
+format_latency(load_totals const& totals, load_totals const& previous)
+{
+    uint64_t const count = totals.latencyCount - previous.latencyCount;
+    uint64_t const mean = count ? (totals.latencySum - previous.latencySum) / count : 0;
+    return "mean " + to_string(mean / 1000) + "us max " + to_string(totals.latencyMax / 1000) + "us";
+}
+
+} // namespace
+
+int
+run_load_test(load_test_options const& options)
+{
+    if (options.symbols.empty() || options.connections == 0)
+    {
+        std::cerr << "load test needs at least one symbol and one connection\n";
+        return EXIT_FAILURE;
+    }
+
+    size_t const threads = std::max<size_t>(1, options.threads);
+
+    deque<load_symbol> symbols;
+    for (auto const& name : options.symbols)
+        symbols.emplace_back().name = name;
+
+    // Resolve once, every connection dials the same endpoints
+    net::io_context resolverContext;
+    beast::error_code ec;
+    auto endpoints = tcp::resolver(resolverContext).resolve(options.host, options.port, ec);
+    if (ec)
+    {
+        fail(ec, "resolve");
+        return EXIT_FAILURE;
+    }
+
+    // Declared before the contexts so suspended connections never outlive their counters
+    deque<load_connection> connections(options.connections);
+
+    vector<unique_ptr<net::io_context>> contexts;
+    for (size_t i = 0; i < threads; ++i)
+        contexts.push_back(make_unique<net::io_context>(1));
+
+    for (size_t i = 0; i < connections.size(); ++i)
+    {
+        connections[i].symbol = &symbols[i % symbols.size()];
+        net::co_spawn(
+            *contexts[i % threads],
+            run_connection(endpoints, options, connections[i]),
+            net::detached);
+    }
+
+    vector<thread> workers;
+    for (auto& context : contexts)
+        workers.emplace_back([&context] { context->run(); });
+
+    auto const start = chrono::steady_clock::now();
+    load_totals previous;
+
+    for (auto elapsed = chrono::seconds(0); elapsed < options.duration; )
+    {
+        this_thread::sleep_for(chrono::seconds(1));
+        elapsed = chrono::duration_cast<chrono::seconds>(chrono::steady_clock::now() - start);
+
+        load_totals totals = collect(connections);
+        std::cout
+            << elapsed.count() << "s"
+            << " open " << totals.open
+            << " msgs/s " << (totals.messages - previous.messages)
+            << " frames/s " << (totals.frames - previous.frames)
+            << " events/s " << (totals.events - previous.events)
+            << " bytes/s " << (totals.bytes - previous.bytes)
+            << " lag max " << totals.maxLag
+            << " mean " << totals.meanLag << " msgs"
+            << " gaps " << totals.gaps
+            << (options.book ? " latency " + format_latency(totals, previous) : "")
+            << std::endl;
+        previous = totals;
+    }
+
+    for (auto& context : contexts)
+        context->stop();
+    for (auto& worker : workers)
+        worker.join();
+
+    double const seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    load_totals totals = collect(connections);
+    std::cout
+        << "total: " << options.connections << " connections, " << symbols.size() << " symbols, " << threads << " threads, "
+        << totals.messages << " msgs (" << static_cast<double>(totals.messages) / seconds << "/s), "
+        << totals.frames << " frames (" << static_cast<double>(totals.frames) / seconds << "/s), "
+        << totals.events << " events (" << static_cast<double>(totals.events) / seconds << "/s), "
+        << totals.bytes << " bytes (" << static_cast<double>(totals.bytes) / seconds << "/s)"
+        << ", " << totals.gaps << " gaps"
+        << (options.book ? ", latency " + format_latency(totals, load_totals{}) : "")
+        << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,36 @@
+#ifndef LOAD_TEST_H
+#define LOAD_TEST_H
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Parameters of a load test run against the market data server
+struct load_test_options
+{
+    std::string host;
+    std::string port;
+    std::vector<std::string> symbols;   // connections subscribe round robin
+    std::size_t connections = 1;
+    std::size_t threads = 1;
+    std::chrono::seconds duration{ 10 };
+    bool book = false;                  // consume the book channel through a book_builder instead of trades
+    bool deflate = false;               // offer permessage-deflate in the handshake
+    bool delta = false;                 // ask for delta encoded book messages
+    std::size_t batch_bytes = 0;        // ask the server to pack messages into frames of about this size
+    std::chrono::microseconds linger{ 0 };  // and to wait this long for a batch to fill
+};
+
+// Opens options.connections websocket sessions spread over options.threads
+// io_contexts, subscribes each to one symbol and consumes the feed as fast
+// as it arrives. Prints aggregate throughput and subscriber lag once a second
+// and a summary at the end, with the sequence gaps each connection saw. With
+// options.book every connection keeps a local book from the level updates
+// and resubscribes after a gap, and the delay from each update's server
+// timestamp to its arrival is reported alongside the lag, otherwise the gaps
+// are breaks in the trade sequence. Returns a process exit code.
+int
+run_load_test(load_test_options const& options);
+
+#endif
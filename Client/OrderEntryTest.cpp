@@ -0,0 +1,365 @@
+//------------------------------------------------------------------------------
+//
+// Order entry load generator: pipelined new and cancel requests on one session
+//
+//------------------------------------------------------------------------------
+
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <format>
+#include <iostream>
+#include <string_view>
+#include <vector>
+#include "OrderEntryTest.h"
+
+namespace beast = boost::beast;         // from <boost/beast.hpp>
+namespace websocket = beast::websocket; // from <boost/beast/websocket.hpp>
+namespace net = boost::asio;            // from <boost/asio.hpp>
+using tcp = boost::asio::ip::tcp;       // from <boost/asio/ip/tcp.hpp>
+using namespace std;
+
+namespace {
+
+constexpr size_t order_record_size = 36;
+
+// State shared by the writer and reader coroutines, both run on one thread
+struct order_entry_run
+{
+    order_entry_options const& options;
+    websocket::stream<beast::tcp_stream> ws;
+    net::steady_timer window_open;      // cancelled by the reader when acks free up the window
+    vector<chrono::steady_clock::time_point> frame_sent;
+    vector<uint64_t> resting;           // ids acknowledged as open, candidates for a cancel
+    size_t sent = 0;
+    size_t answered = 0;
+    size_t rejected = 0;
+    size_t filled = 0;
+    uint64_t filled_quantity = 0;       // as acknowledged, the aggressor side only
+    uint64_t private_quantity = 0;      // as reported on the private channel, resting fills included
+    size_t prevented = 0;
+    unsigned participant = 0;           // as the server bound it at login
+    uint64_t latency_sum = 0;
+    uint64_t latency_max = 0;
+    size_t latency_count = 0;
+    bool failed = false;
+    chrono::steady_clock::time_point last_ack;
+
+    order_entry_run(order_entry_options const& o, net::any_io_executor executor)
+        : options(o)
+        , ws(executor)
+        , window_open(executor, net::steady_timer::time_point::max())
+    {
+    }
+};
+
+void
+fail(beast::error_code ec, char const* what)
+{
+    std::cerr << what << ": " << ec.message() << "\n";
+}
+
+string_view
+next_field(string_view& text, char separator)
+{
+    size_t const end = std::min(text.find(separator), text.size());
+    string_view const field = text.substr(0, end);
+    text.remove_prefix(std::min(end + 1, text.size()));
+    return field;
+}
+
+template <class Number>
+Number
+parse_number(string_view field)
+{
+    Number value{};
+    from_chars(field.data(), field.data() + field.size(), value);
+    return value;
+}
+
+// Crossing buys and sells around a mid price, so a good share of them trade.
+// Only a logged in session owns its orders, the others send no cancels.
+void
+append_request(order_entry_run& run, uint64_t tag, string& text, vector<unsigned char>& binary)
+{
+    bool const cancel = run.participant != 0 && tag % 4 == 3 && !run.resting.empty();
+    uint64_t orderId = 0;
+    if (cancel)
+    {
+        orderId = run.resting.back();
+        run.resting.pop_back();
+    }
+    bool const buy = tag % 2 == 0;
+    int32_t const price = buy ? 100 + static_cast<int32_t>(tag * 7 % 10) : 104 + static_cast<int32_t>(tag * 3 % 10);
+    uint32_t const quantity = 1 + static_cast<uint32_t>(tag % 50);
+
+    if (!run.options.binary)
+    {
+        if (!text.empty())
+            text += '\x1e';
+        if (cancel)
+            format_to(back_inserter(text), "cancel:{},{},{}", run.options.symbol, tag, orderId);
+        else
+            format_to(back_inserter(text), "new:{},{},{},{},{}", run.options.symbol, tag, buy ? 'B' : 'S', price, quantity);
+        return;
+    }
+
+    // Same layout the server decodes, little-endian
+    unsigned char record[order_record_size] = {};
+    record[0] = cancel ? 1 : 0;
+    record[1] = buy ? 0 : 1;
+    std::memcpy(record + 4, run.options.symbol.data(), std::min<size_t>(run.options.symbol.size(), 8));
+    std::memcpy(record + 12, &tag, 8);
+    std::memcpy(record + 20, &orderId, 8);
+    std::memcpy(record + 28, &price, 4);
+    std::memcpy(record + 32, &quantity, 4);
+    binary.insert(binary.end(), record, record + order_record_size);
+}
+
+net::awaitable<void>
+write_requests(order_entry_run& run)
+{
+    beast::error_code ec;
+    string text;
+    vector<unsigned char> binary;
+    run.ws.binary(run.options.binary);
+
+    while (run.sent < run.options.orders && !run.failed)
+    {
+        if (run.sent - run.answered >= run.options.window)
+        {
+            run.window_open.expires_at(net::steady_timer::time_point::max());
+            co_await run.window_open.async_wait(net::redirect_error(net::use_awaitable, ec));
+            continue;
+        }
+
+        text.clear();
+        binary.clear();
+        size_t const count = std::min(run.options.batch, run.options.orders - run.sent);
+        for (size_t i = 0; i < count; ++i)
+            append_request(run, run.sent + i, text, binary);
+
+        run.frame_sent.push_back(chrono::steady_clock::now());
+        run.sent += count;
+        if (run.options.binary)
+            co_await run.ws.async_write(net::buffer(binary), net::redirect_error(net::use_awaitable, ec));
+        else
+            co_await run.ws.async_write(net::buffer(text), net::redirect_error(net::use_awaitable, ec));
+        if (ec)
+        {
+            fail(ec, "write");
+            run.failed = true;
+        }
+    }
+}
+
+// "ack TAG ORDERID ACTION FILLED open|done" or "reject TAG ACTION REASON",
+// or from the private channel "fill SYMBOL SEQUENCE ORDERID B|S PRICE
+// QUANTITY TIMESTAMP" and "prevented SYMBOL ORDERID QUANTITY open|done"
+void
+handle_ack(order_entry_run& run, string_view line, chrono::steady_clock::time_point now)
+{
+    string_view const kind = next_field(line, ' ');
+    if (kind == "fill")
+    {
+        for (int field = 0; field < 5; ++field)
+            next_field(line, ' ');
+        run.private_quantity += parse_number<uint32_t>(next_field(line, ' '));
+        return;
+    }
+    if (kind == "prevented")
+    {
+        ++run.prevented;
+        return;
+    }
+
+    uint64_t const tag = parse_number<uint64_t>(next_field(line, ' '));
+    if (kind == "ack")
+    {
+        uint64_t const orderId = parse_number<uint64_t>(next_field(line, ' '));
+        string_view const action = next_field(line, ' ');
+        uint32_t const filled = parse_number<uint32_t>(next_field(line, ' '));
+        run.filled += filled != 0;
+        run.filled_quantity += filled;
+        if (action == "new" && line == "open")
+            run.resting.push_back(orderId);
+    }
+    else if (kind == "reject")
+    {
+        ++run.rejected;
+    }
+    else
+    {
+        return;
+    }
+
+    // The first ack of a frame stands for the whole frame
+    size_t const frame = tag / run.options.batch;
+    if (tag % run.options.batch == 0 && frame < run.frame_sent.size())
+    {
+        uint64_t const latency = static_cast<uint64_t>(chrono::duration_cast<chrono::microseconds>(now - run.frame_sent[frame]).count());
+        run.latency_sum += latency;
+        run.latency_max = std::max(run.latency_max, latency);
+        ++run.latency_count;
+    }
+    ++run.answered;
+}
+
+void
+handle_frame(order_entry_run& run, beast::flat_buffer& buffer)
+{
+    auto const now = chrono::steady_clock::now();
+    auto data = buffer.data();
+    string_view frame(static_cast<char const*>(data.data()), data.size());
+    while (!frame.empty())
+    {
+        string_view message = next_field(frame, '\x1e');
+        while (!message.empty())
+            handle_ack(run, next_field(message, '\n'), now);
+    }
+    buffer.consume(buffer.size());
+}
+
+net::awaitable<void>
+read_acks(order_entry_run& run)
+{
+    beast::error_code ec;
+    beast::flat_buffer buffer;
+
+    while (run.answered < run.options.orders && !run.failed)
+    {
+        co_await run.ws.async_read(buffer, net::redirect_error(net::use_awaitable, ec));
+        if (ec)
+        {
+            fail(ec, "read");
+            run.failed = true;
+            break;
+        }
+
+        handle_frame(run, buffer);
+        run.window_open.cancel();
+    }
+    run.last_ack = chrono::steady_clock::now();
+    run.window_open.cancel();
+
+    // Private channel messages come through the publisher and can trail the
+    // last ack, they are read until the session has been quiet for a while.
+    // Resting orders keep trading with the simulator, so it never is for long.
+    while (run.participant != 0 && !run.failed && chrono::steady_clock::now() < run.last_ack + chrono::seconds(2))
+    {
+        beast::get_lowest_layer(run.ws).expires_after(std::chrono::milliseconds(500));
+        co_await run.ws.async_read(buffer, net::redirect_error(net::use_awaitable, ec));
+        if (ec)
+            break;
+        handle_frame(run, buffer);
+    }
+}
+
+net::awaitable<void>
+run_session(order_entry_run& run)
+{
+    beast::error_code ec;
+    auto const endpoints = co_await tcp::resolver(co_await net::this_coro::executor)
+        .async_resolve(run.options.host, run.options.port, net::redirect_error(net::use_awaitable, ec));
+    if (ec)
+    {
+        fail(ec, "resolve");
+        co_return;
+    }
+
+    beast::get_lowest_layer(run.ws).expires_after(std::chrono::seconds(30));
+    co_await beast::get_lowest_layer(run.ws).async_connect(endpoints, net::redirect_error(net::use_awaitable, ec));
+    if (ec)
+    {
+        fail(ec, "connect");
+        co_return;
+    }
+    beast::get_lowest_layer(run.ws).expires_never();
+    beast::get_lowest_layer(run.ws).socket().set_option(tcp::no_delay(true));
+
+    co_await run.ws.async_handshake(run.options.host, "/", net::redirect_error(net::use_awaitable, ec));
+    if (ec)
+    {
+        fail(ec, "handshake");
+        co_return;
+    }
+
+    // The server answers a login before anything else is queued for the session
+    if (run.options.login != 0)
+    {
+        beast::flat_buffer buffer;
+        co_await run.ws.async_write(net::buffer(format("login:{}", run.options.login)), net::redirect_error(net::use_awaitable, ec));
+        if (!ec)
+            co_await run.ws.async_read(buffer, net::redirect_error(net::use_awaitable, ec));
+        if (ec)
+        {
+            fail(ec, "login");
+            co_return;
+        }
+        string_view reply(static_cast<char const*>(buffer.data().data()), buffer.size());
+        reply = next_field(reply, '\n');
+        if (next_field(reply, ' ') != "login" || reply == "rejected")
+        {
+            std::cerr << "login: rejected\n";
+            co_return;
+        }
+        run.participant = parse_number<unsigned>(reply);
+    }
+    if (run.options.stp != 0)
+    {
+        co_await run.ws.async_write(net::buffer(format("options:stp={}", run.options.stp)), net::redirect_error(net::use_awaitable, ec));
+        if (ec)
+        {
+            fail(ec, "write");
+            co_return;
+        }
+    }
+
+    auto const start = chrono::steady_clock::now();
+    net::co_spawn(co_await net::this_coro::executor, write_requests(run), net::detached);
+    co_await read_acks(run);
+    double const seconds = chrono::duration<double>(run.last_ack - start).count();
+
+    std::cout
+        << run.sent << " requests in " << seconds << "s, "
+        << static_cast<double>(run.answered) / seconds << " acks/s, "
+        << run.filled << " filled, " << run.rejected << " rejected, "
+        << "frame ack latency mean " << (run.latency_count ? run.latency_sum / run.latency_count : 0)
+        << "us max " << run.latency_max << "us"
+        << std::endl;
+    if (run.participant != 0)
+        std::cout
+            << "participant " << run.participant << ": " << run.filled_quantity << " acknowledged as filled, "
+            << run.private_quantity << " filled on the private channel, " << run.prevented << " self-trades prevented"
+            << std::endl;
+
+    run.ws.async_close(websocket::close_code::normal, net::detached);
+}
+
+} // namespace
+
+int
+run_order_entry_test(order_entry_options const& options)
+{
+    if (options.orders == 0 || options.batch == 0 || options.symbol.empty() || options.symbol.size() > 8)
+    {
+        std::cerr << "order entry test needs a symbol of at most 8 characters, orders and a batch size\n";
+        return EXIT_FAILURE;
+    }
+
+    net::io_context ioc(1);
+    order_entry_run run(options, ioc.get_executor());
+    run.frame_sent.reserve(options.orders / options.batch + 1);
+
+    net::co_spawn(ioc, run_session(run), net::detached);
+    ioc.run();
+
+    return !run.failed && run.answered == options.orders ? EXIT_SUCCESS : EXIT_FAILURE;
+}
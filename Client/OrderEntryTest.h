@@ -0,0 +1,31 @@
+#ifndef ORDER_ENTRY_TEST_H
+#define ORDER_ENTRY_TEST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Parameters of an order entry run against the server's gateway
+struct order_entry_options
+{
+    std::string host;
+    std::string port;
+    std::string symbol;
+    std::size_t orders = 100000;        // requests to send in total
+    std::size_t batch = 100;            // requests per frame
+    std::size_t window = 20000;         // requests sent but not yet acknowledged
+    bool binary = false;                // binary records instead of text commands
+    std::uint64_t login = 0;            // token of the participant to trade as, its fills come back on the private channel
+    unsigned stp = 0;                   // self-trade prevention mode, 0 none to 3 decrement both
+};
+
+// Pushes options.orders requests, mostly crossing new orders, over one
+// websocket session as fast as the window allows. Prints the request and ack
+// rates and the ack latency of each frame. A run that logs in also cancels a
+// resting order every fourth request, and counts the fills and self-trade
+// preventions reported on its participant's private channel. Returns a process
+// exit code.
+int
+run_order_entry_test(order_entry_options const& options);
+
+#endif
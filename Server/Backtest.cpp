@@ -0,0 +1,300 @@
+// backtest: replays per-symbol event files through independent order books on a work stealing pool
+
+#include "common_includes.h"
+#include "Backtest.h"
+#include "OrderBook.h"
+#include "WorkStealingPool.h"
+#include <charconv>
+#include <filesystem>
+#include <random>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+struct BacktestResult {
+	string symbol_;
+	fs::path input_;
+	uintmax_t size_{ 0 };
+	size_t events_{ 0 };
+	size_t trades_{ 0 };
+	size_t updates_{ 0 };
+	string error_;
+};
+
+static string ReadFile(const fs::path& path) {
+	ifstream file(path, ios::binary);
+	if (!file)
+		throw logic_error(format("Backtest input ({}) cannot be opened.", path.string()));
+
+	string contents(static_cast<size_t>(fs::file_size(path)), '\0');
+	file.read(contents.data(), static_cast<streamsize>(contents.size()));
+	return contents;
+}
+
+static void WriteFile(const fs::path& path, const string& contents) {
+	ofstream file(path, ios::binary | ios::trunc);
+	file.write(contents.data(), static_cast<streamsize>(contents.size()));
+	if (!file)
+		throw logic_error(format("Backtest output ({}) cannot be written.", path.string()));
+}
+
+static bool NextLine(string_view& text, string_view& line) {
+	if (text.empty())
+		return false;
+	const size_t end = min(text.find('\n'), text.size());
+	line = text.substr(0, end);
+	text.remove_prefix(min(end + 1, text.size()));
+	if (!line.empty() && line.back() == '\r')
+		line.remove_suffix(1);
+	return true;
+}
+
+static string_view NextField(string_view& line) {
+	const size_t start = min(line.find_first_not_of(" \t"), line.size());
+	line.remove_prefix(start);
+	const size_t end = min(line.find_first_of(" \t"), line.size());
+	string_view field = line.substr(0, end);
+	line.remove_prefix(end);
+	return field;
+}
+
+template <class Number>
+static bool ParseNumber(string_view field, Number& value) {
+	auto [end, ec] = from_chars(field.data(), field.data() + field.size(), value);
+	return !field.empty() && ec == errc{} && end == field.data() + field.size();
+}
+
+static bool ParseOrder(string_view& line, Side& side, Price& price, Quantity& quantity) {
+	const string_view sideField = NextField(line);
+	if (sideField != "B" && sideField != "S")
+		return false;
+	side = sideField == "B" ? Side::Buy : Side::Sell;
+	return ParseNumber(NextField(line), price) && ParseNumber(NextField(line), quantity) && quantity != 0;
+}
+
+static bool ParseOrderType(string_view field, OrderType& orderType) {
+	static constexpr pair<string_view, OrderType> types[] = {
+		{ "gtc", OrderType::GoodTillCancel },
+		{ "fak", OrderType::FillAndKill },
+		{ "fok", OrderType::FillOrKill },
+		{ "market", OrderType::Market },
+		{ "gfd", OrderType::GoodForDay },
+	};
+	if (field.empty()) {
+		orderType = OrderType::GoodTillCancel;
+		return true;
+	}
+	for (const auto& [name, type] : types) {
+		if (field == name) {
+			orderType = type;
+			return true;
+		}
+	}
+	return false;
+}
+
+static chrono::system_clock::time_point ToTimePoint(uint64_t timestamp) {
+	return chrono::system_clock::time_point(chrono::duration_cast<chrono::system_clock::duration>(chrono::nanoseconds(timestamp)));
+}
+
+// replays one symbol start to finish on the calling thread, nothing is shared with other symbols
+static void Replay(const fs::path& outputDirectory, BacktestResult& result) {
+	const string input = ReadFile(result.input_);
+	string trades;
+	string depth;
+	LevelUpdates updates;
+	OrderBook book;
+
+	string_view text = input;
+	string_view line;
+	for (size_t lineNumber = 1; NextLine(text, line); ++lineNumber) {
+		if (line.find_first_not_of(" \t") == string_view::npos)
+			continue;
+
+		uint64_t timestamp;
+		OrderId orderId;
+		const bool stamped = ParseNumber(NextField(line), timestamp);
+		const string_view action = NextField(line);
+		bool valid = stamped && ParseNumber(NextField(line), orderId);
+
+		if (valid) {
+			// the session close follows the replayed day, not the day the backtest runs on
+			const auto now = ToTimePoint(timestamp);
+			if (result.events_ == 0) {
+				auto sessionClose = chrono::floor<chrono::days>(now) + chrono::hours(21);
+				if (sessionClose <= now)
+					sessionClose += chrono::days(1);
+				book.SetSessionClose(sessionClose);
+			}
+			book.SetReplayTime(timestamp);
+			book.ExpireOrders(now);
+		}
+
+		Trades executed;
+		Side side;
+		Price price;
+		Quantity quantity;
+		OrderType orderType;
+		if (valid && action == "N" && ParseOrder(line, side, price, quantity) && ParseOrderType(NextField(line), orderType)) {
+			executed = book.AddOrder(orderType == OrderType::Market
+				? make_shared<Order>(orderId, side, quantity)
+				: make_shared<Order>(orderType, orderId, side, price, quantity));
+		}
+		else if (valid && action == "C") {
+			book.CancelOrder(orderId);
+		}
+		else if (valid && action == "M" && ParseOrder(line, side, price, quantity)) {
+			executed = book.MatchOrder(OrderModify{ orderId, side, price, quantity });
+		}
+		else {
+			valid = false;
+		}
+
+		if (!valid || !NextField(line).empty())
+			throw logic_error(format("{}:{}: malformed event.", result.input_.string(), lineNumber));
+		++result.events_;
+
+		for (const auto& trade : executed) {
+			format_to(back_inserter(trades), "{} {} {} {} {} {} {}\n",
+				trade.GetSequence(), trade.GetTimestamp(),
+				trade.GetBidTrade().orderId_, trade.GetBidTrade().price_,
+				trade.GetAskTrade().orderId_, trade.GetAskTrade().price_,
+				trade.GetBidTrade().quantity_);
+		}
+		result.trades_ += executed.size();
+
+		book.TakeLevelUpdates(updates);
+		for (const auto& update : updates) {
+			format_to(back_inserter(depth), "{} {} {} {} {}\n",
+				update.sequence_, update.timestamp_, update.side_ == Side::Buy ? 'B' : 'A', update.price_, update.quantity_);
+		}
+		result.updates_ += updates.size();
+	}
+
+	WriteFile(outputDirectory / (result.symbol_ + ".trades"), trades);
+	WriteFile(outputDirectory / (result.symbol_ + ".depth"), depth);
+}
+
+int Backtest::Run(const string& inputDirectory, const string& outputDirectory, size_t threads) {
+	vector<BacktestResult> results;
+	try {
+		for (const auto& entry : fs::directory_iterator(inputDirectory)) {
+			if (!entry.is_regular_file() || entry.path().extension() != ".events")
+				continue;
+			BacktestResult& result = results.emplace_back();
+			result.symbol_ = entry.path().stem().string();
+			result.input_ = entry.path();
+			result.size_ = entry.file_size();
+		}
+		fs::create_directories(outputDirectory);
+	}
+	catch (const fs::filesystem_error& e) {
+		cerr << e.what() << "\n";
+		return EXIT_FAILURE;
+	}
+	if (results.empty()) {
+		cerr << "no .events files in " << inputDirectory << "\n";
+		return EXIT_FAILURE;
+	}
+
+	// the summary lists symbols by name, whatever order they finished in
+	sort(results.begin(), results.end(), [](const auto& a, const auto& b) { return a.symbol_ < b.symbol_; });
+
+	// the largest symbols start first, so the last tasks left for the thieves are short ones
+	vector<size_t> order(results.size());
+	iota(order.begin(), order.end(), size_t{ 0 });
+	stable_sort(order.begin(), order.end(), [&results](size_t a, size_t b) { return results[a].size_ > results[b].size_; });
+
+	const auto start = chrono::steady_clock::now();
+	WorkStealingPool(threads).Run(order, [&results, &outputDirectory](size_t i) {
+		try {
+			Replay(outputDirectory, results[i]);
+		}
+		catch (const exception& e) {
+			results[i].error_ = e.what();
+		}
+	});
+	const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	string summary;
+	size_t events = 0, trades = 0, updates = 0, failed = 0;
+	for (const auto& result : results) {
+		if (result.error_.empty())
+			format_to(back_inserter(summary), "{} {} {} {}\n", result.symbol_, result.events_, result.trades_, result.updates_);
+		else
+			format_to(back_inserter(summary), "{} error {}\n", result.symbol_, result.error_);
+		events += result.events_;
+		trades += result.trades_;
+		updates += result.updates_;
+		failed += !result.error_.empty();
+	}
+
+	try {
+		WriteFile(fs::path(outputDirectory) / "summary", summary);
+	}
+	catch (const logic_error& e) {
+		cerr << e.what() << "\n";
+		return EXIT_FAILURE;
+	}
+
+	cout << results.size() << " symbols, " << events << " events, " << trades << " trades, " << updates << " level updates in "
+		<< seconds << "s on " << threads << " threads, " << static_cast<double>(events) / seconds << " events/s";
+	if (failed)
+		cout << ", " << failed << " symbols failed, see the summary";
+	cout << endl;
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int Backtest::GenerateEvents(const string& directory, size_t symbols, size_t events) {
+	fs::create_directories(directory);
+
+	// 2024-01-02 14:30 UTC, a regular session's open
+	constexpr uint64_t open = 1'704'205'800'000'000'000;
+
+	for (size_t s = 0; s < symbols; ++s) {
+		mt19937_64 random(s);
+		uniform_int_distribution<int> percent(0, 99);
+		uniform_int_distribution<uint64_t> gaps(1, 2'000'000);
+		uniform_int_distribution<Quantity> quantities(1, 500);
+		uniform_int_distribution<Price> offsets(-20, 20);
+
+		string text;
+		vector<OrderId> issued;
+		Price mid = 10000;
+		uint64_t timestamp = open;
+		for (size_t e = 0; e < events; ++e) {
+			timestamp += gaps(random);
+			const int roll = percent(random);
+			if (roll < 2)
+				mid += offsets(random) / 4;
+
+			// cancels and modifies pick among the most recent orders, some of which have already traded away
+			if (roll < 25 && !issued.empty()) {
+				const OrderId orderId = issued[issued.size() - 1 - random() % min<size_t>(issued.size(), 256)];
+				format_to(back_inserter(text), "{} C {}\n", timestamp, orderId);
+				continue;
+			}
+			if (roll < 35 && !issued.empty()) {
+				const OrderId orderId = issued[issued.size() - 1 - random() % min<size_t>(issued.size(), 256)];
+				format_to(back_inserter(text), "{} M {} {} {} {}\n", timestamp, orderId, percent(random) < 50 ? 'B' : 'S', mid + offsets(random), quantities(random));
+				continue;
+			}
+
+			const OrderId orderId = issued.size() + 1;
+			issued.push_back(orderId);
+			const bool buy = percent(random) < 50;
+			const Price price = mid + (buy ? -1 : 1) * (offsets(random) + 5);
+			const char* type = roll < 85 ? "" : roll < 93 ? " fak" : roll < 96 ? " fok" : roll < 98 ? " gfd" : " market";
+			format_to(back_inserter(text), "{} N {} {} {} {}{}\n", timestamp, orderId, buy ? 'B' : 'S', price, quantities(random), type);
+		}
+
+		try {
+			WriteFile(fs::path(directory) / format("S{:05}.events", s), text);
+		}
+		catch (const logic_error& e) {
+			cerr << e.what() << "\n";
+			return EXIT_FAILURE;
+		}
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,26 @@
+#ifndef BACKTEST_H
+#define BACKTEST_H
+
+#include "common_includes.h"
+
+// offline replay of recorded order flow, one book per symbol, symbols matched in parallel
+//
+// input is one SYMBOL.events file per symbol, a line per event in time order:
+//   TIMESTAMP N ORDERID B|S PRICE QUANTITY [gtc|fak|fok|market|gfd]	new order, gtc when no type is given
+//   TIMESTAMP C ORDERID												cancel
+//   TIMESTAMP M ORDERID B|S PRICE QUANTITY								modify
+// timestamps are epoch nanoseconds and become the book's clock, good-for-day orders expire at 21:00 UTC
+//
+// output is SYMBOL.trades, "SEQUENCE TIMESTAMP BIDID BIDPRICE ASKID ASKPRICE QUANTITY" per trade,
+// SYMBOL.depth, "SEQUENCE TIMESTAMP B|A PRICE QUANTITY" per level update, and a summary of all symbols
+// every file depends only on the input, never on the thread count or on which thread replayed a symbol
+class Backtest {
+public:
+	// returns a process exit code, failure when any symbol's events could not be read or replayed
+	static int Run(const std::string& inputDirectory, const std::string& outputDirectory, std::size_t threads);
+
+	// writes a deterministic random day of events for symbols symbols, for benchmarking Run
+	static int GenerateEvents(const std::string& directory, std::size_t symbols, std::size_t events);
+};
+
+#endif
@@ -0,0 +1,250 @@
+// book fuzz: drives OrderBook and ReferenceBook with the same operations and stops at the first thing they disagree on
+
+#include "common_includes.h"
+#include "BookFuzz.h"
+#include "OrderBook.h"
+#include "ReferenceBook.h"
+#include "WorkStealingPool.h"
+#include <array>
+#include <random>
+
+using namespace std;
+
+// prices are drawn around a fixed mid, buys from below it and sells from above with an overlap,
+// so most orders cross something while both sides keep a few levels of depth
+static constexpr Price FuzzMid = 1000;
+static constexpr Price FuzzPriceRange = 32;
+static constexpr Quantity FuzzMaxQuantity = 24;
+static constexpr ParticipantId FuzzOwners = 4;	// owner 0 is no owner
+static constexpr OrderId FuzzRecentOrders = 32;	// cancels and modifies pick one of the last ids issued
+
+static const char* TypeName(OrderType type) {
+	switch (type) {
+	case OrderType::GoodTillCancel: return "gtc";
+	case OrderType::FillAndKill: return "fak";
+	case OrderType::FillOrKill: return "fok";
+	case OrderType::Market: return "market";
+	case OrderType::GoodForDay: return "gfd";
+	}
+	return "?";
+}
+
+static string Describe(const TradeInfo& info) {
+	return format("{} {}x{} owner {}", info.orderId_, info.price_, info.quantity_, info.owner_);
+}
+
+static string Describe(const Trade& trade) {
+	return format("#{} at {}: {} bid {} / ask {}", trade.GetSequence(), trade.GetTimestamp(), trade.GetPrice(), Describe(trade.GetBidTrade()), Describe(trade.GetAskTrade()));
+}
+
+static bool operator==(const TradeInfo& info, const TradeInfo& other) {
+	return info.orderId_ == other.orderId_ && info.price_ == other.price_ && info.quantity_ == other.quantity_ && info.owner_ == other.owner_;
+}
+
+static bool operator==(const Trade& trade, const Trade& other) {
+	return trade.GetBidTrade() == other.GetBidTrade() && trade.GetAskTrade() == other.GetAskTrade() && trade.GetPrice() == other.GetPrice()
+		&& trade.GetSequence() == other.GetSequence() && trade.GetTimestamp() == other.GetTimestamp();
+}
+
+static string CompareTrades(const Trades& trades, const Trades& expected) {
+	for (size_t i = 0; i < max(trades.size(), expected.size()); ++i) {
+		if (i < trades.size() && i < expected.size() && trades[i] == expected[i])
+			continue;
+		return format("trade {} is {}, the reference made {}", i,
+			i < trades.size() ? Describe(trades[i]) : "missing", i < expected.size() ? Describe(expected[i]) : "none");
+	}
+	return {};
+}
+
+static string ComparePreventedFills(const PreventedFills& fills, const PreventedFills& expected) {
+	auto describe = [](const PreventedFills& list, size_t i) {
+		return i < list.size() ? format("{} owner {} x{}{}", list[i].orderId_, list[i].owner_, list[i].quantity_, list[i].cancelled_ ? " cancelled" : "") : string("none");
+	};
+	for (size_t i = 0; i < max(fills.size(), expected.size()); ++i) {
+		if (i < fills.size() && i < expected.size() && fills[i].orderId_ == expected[i].orderId_ && fills[i].owner_ == expected[i].owner_
+				&& fills[i].quantity_ == expected[i].quantity_ && fills[i].cancelled_ == expected[i].cancelled_)
+			continue;
+		return format("prevented fill {} is {}, the reference made {}", i, describe(fills, i), describe(expected, i));
+	}
+	return {};
+}
+
+static string CompareLevels(const char* sideName, const LevelInfos& levels, const LevelInfos& expected) {
+	for (size_t i = 0; i < max(levels.size(), expected.size()); ++i) {
+		if (i < levels.size() && i < expected.size() && levels[i].price_ == expected[i].price_ && levels[i].quantity_ == expected[i].quantity_)
+			continue;
+		return format("{} level {} is {}, the reference has {}", sideName, i,
+			i < levels.size() ? format("{}x{}", levels[i].price_, levels[i].quantity_) : "missing",
+			i < expected.size() ? format("{}x{}", expected[i].price_, expected[i].quantity_) : "none");
+	}
+	return {};
+}
+
+// every level whose quantity the step changed must have been reported, and the last report of a level is its quantity now
+static string CompareLevelUpdates(const LevelUpdates& updates, uint64_t& sequence, uint64_t timestamp,
+		const OrderBookLevelInfos& before, const ReferenceBook& reference) {
+	map<pair<Side, Price>, Quantity> reported;
+	for (const auto& update : updates) {
+		if (update.sequence_ != ++sequence || update.timestamp_ != timestamp)
+			return format("level update #{} at {} follows #{} at step time {}", update.sequence_, update.timestamp_, sequence - 1, timestamp);
+		reported[{ update.side_, update.price_ }] = update.quantity_;
+	}
+	for (const auto& [level, quantity] : reported) {
+		const Quantity expected = reference.LevelQuantity(level.first, level.second);
+		if (quantity != expected)
+			return format("level update of {} {} says {}, the reference has {}", level.first == Side::Buy ? "bid" : "ask", level.second, quantity, expected);
+	}
+
+	auto checkSide = [&](Side side, const LevelInfos& levels, const LevelInfos& levelsAfter) -> string {
+		map<Price, pair<Quantity, Quantity>> changes;
+		for (const auto& level : levels)
+			changes[level.price_].first = level.quantity_;
+		for (const auto& level : levelsAfter)
+			changes[level.price_].second = level.quantity_;
+		for (const auto& [price, quantities] : changes)
+			if (quantities.first != quantities.second && !reported.contains({ side, price }))
+				return format("{} {} went from {} to {} without a level update", side == Side::Buy ? "bid" : "ask", price, quantities.first, quantities.second);
+		return {};
+	};
+	const OrderBookLevelInfos after = reference.GetOrderInfos();
+	string failure = checkSide(Side::Buy, before.GetBids(), after.GetBids());
+	return failure.empty() ? checkSide(Side::Sell, before.GetAsks(), after.GetAsks()) : failure;
+}
+
+BookFuzzResult BookFuzz::Check(const uint8_t* data, size_t size) {
+	BookFuzzResult result;
+	OrderBook book;
+	ReferenceBook reference;
+	LevelUpdates updates;
+	PreventedFills fills, expectedFills;
+	uint64_t levelSequence = 0;
+	OrderId issued = 0;
+
+	for (size_t offset = 0; offset + StepBytes <= size; offset += StepBytes, ++result.steps_) {
+		const uint8_t* step = data + offset;
+		const uint64_t timestamp = result.steps_ + 1;
+		book.SetReplayTime(timestamp);
+		reference.SetReplayTime(timestamp);
+
+		const int operation = step[0] % 16;
+		const OrderType type = array{ OrderType::GoodTillCancel, OrderType::GoodTillCancel, OrderType::GoodTillCancel, OrderType::GoodTillCancel,
+			OrderType::FillAndKill, OrderType::FillOrKill, OrderType::Market, OrderType::GoodForDay }[step[1] % 8];
+		const Side side = step[2] % 2 == 0 ? Side::Buy : Side::Sell;
+		const Price price = FuzzMid + step[3] % FuzzPriceRange - (side == Side::Buy ? FuzzPriceRange / 2 : 0);
+		const ParticipantId owner = step[5] % FuzzOwners;
+		const auto prevention = static_cast<SelfTradePrevention>(step[6] % 4);
+		// a recent id, which may have left the book already
+		const OrderId target = issued - step[7] % min<OrderId>(max<OrderId>(issued, 1), FuzzRecentOrders);
+
+		const OrderBookLevelInfos before = reference.GetOrderInfos();
+		Trades trades, expected;
+		string operationName;
+		try {
+			if (operation < 9) {
+				// now and then a new order reuses a recent id, rejected while that order rests and accepted once it has gone
+				const OrderId orderId = step[7] < 16 && issued != 0 ? target : ++issued;
+				const Quantity quantity = 1 + step[4] % FuzzMaxQuantity;
+				const Order order = type == OrderType::Market
+					? Order{ orderId, side, quantity, owner, prevention }
+					: Order{ type, orderId, side, price, quantity, owner, prevention };
+				operationName = format("new {} {} {} {}x{} owner {} stp {}", orderId, TypeName(type), side == Side::Buy ? "buy" : "sell",
+					type == OrderType::Market ? 0 : price, quantity, owner, static_cast<int>(prevention));
+				trades = book.AddOrder(make_shared<Order>(order));
+				expected = reference.AddOrder(order);
+			}
+			else if (operation < 12) {
+				operationName = format("cancel {}", target);
+				book.CancelOrder(target);
+				reference.CancelOrder(target);
+			}
+			else if (operation < 15) {
+				// quantity 0 is allowed and cancels through the replace path
+				const OrderModify modify{ target, side, price, static_cast<Quantity>(step[4] % (FuzzMaxQuantity + 1)) };
+				operationName = format("modify {} {} {}x{}", target, side == Side::Buy ? "buy" : "sell", price, modify.GetQuantity());
+				trades = book.MatchOrder(modify);
+				expected = reference.MatchOrder(modify);
+			}
+			else {
+				operationName = "session close";
+				book.SetSessionClose(chrono::system_clock::time_point{});
+				const size_t expired = book.ExpireOrders(chrono::system_clock::time_point{});
+				const size_t expectedExpired = reference.ExpireGoodForDay();
+				if (expired != expectedExpired)
+					result.failure_ = format("{} good-for-day orders expired, the reference expired {}", expired, expectedExpired);
+			}
+
+			book.TakePreventedFills(fills);
+			reference.TakePreventedFills(expectedFills);
+			book.TakeLevelUpdates(updates);
+			const OrderBookLevelInfos levels = book.GetOrderInfos();
+			const OrderBookLevelInfos expectedLevels = reference.GetOrderInfos();
+
+			for (const string& failure : { result.failure_,
+					CompareTrades(trades, expected),
+					ComparePreventedFills(fills, expectedFills),
+					CompareLevels("bid", levels.GetBids(), expectedLevels.GetBids()),
+					CompareLevels("ask", levels.GetAsks(), expectedLevels.GetAsks()),
+					book.Size() != reference.Size() ? format("{} orders rest, the reference has {}", book.Size(), reference.Size()) : string(),
+					CompareLevelUpdates(updates, levelSequence, timestamp, before, reference) }) {
+				if (!failure.empty()) {
+					result.failure_ = failure;
+					break;
+				}
+			}
+		}
+		catch (const exception& e) {
+			result.failure_ = format("OrderBook threw: {}", e.what());
+		}
+
+		result.trades_ += trades.size();
+		result.preventedFills_ += fills.size();
+		if (!result.failure_.empty()) {
+			result.failure_ = format("step {} ({}): {}", result.steps_, operationName, result.failure_);
+			break;
+		}
+	}
+	return result;
+}
+
+int BookFuzz::Run(uint64_t seed, size_t runs, size_t steps, size_t threads) {
+	vector<BookFuzzResult> results(runs);
+	vector<size_t> tasks(runs);
+	iota(tasks.begin(), tasks.end(), 0);
+
+	const auto start = chrono::steady_clock::now();
+	WorkStealingPool(threads).Run(tasks, [&results, seed, steps](size_t i) {
+		mt19937_64 random(seed + i);
+		vector<uint8_t> input(steps * StepBytes);
+		for (auto& byte : input)
+			byte = static_cast<uint8_t>(random());
+		results[i] = Check(input.data(), input.size());
+	});
+	const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	size_t totalSteps = 0, trades = 0, preventedFills = 0, failed = 0;
+	for (size_t i = 0; i < runs; ++i) {
+		totalSteps += results[i].steps_;
+		trades += results[i].trades_;
+		preventedFills += results[i].preventedFills_;
+		if (!results[i].failure_.empty()) {
+			// the first few are enough to start from, --fuzz-book <seed> 1 <steps> reruns one alone
+			if (failed++ < 10)
+				cerr << format("seed {}: {}\n", seed + i, results[i].failure_);
+		}
+	}
+	cout << format("{} runs, {} steps, {} trades and {} prevented fills compared in {:.2f}s, {} runs failed\n",
+		runs, totalSteps, trades, preventedFills, seconds, failed);
+	return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#if defined(BOOK_FUZZ_LIBFUZZER)
+// a difference aborts, so libFuzzer keeps the input and shrinks it
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+	const BookFuzzResult result = BookFuzz::Check(data, size);
+	if (!result.failure_.empty()) {
+		cerr << result.failure_ << "\n";
+		abort();
+	}
+	return 0;
+}
+#endif
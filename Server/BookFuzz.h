@@ -0,0 +1,36 @@
+#ifndef BOOK_FUZZ_H
+#define BOOK_FUZZ_H
+
+#include "common_includes.h"
+
+// differential fuzzing of OrderBook against ReferenceBook
+//
+// an input is a byte string read StepBytes at a time, each step one operation applied to both books:
+// a new order of any type, side, owner and self-trade prevention, a cancel, a modify, or a session close
+// after every step the books must agree on the trades, the prevented fills, the full depth and the order count,
+// and every level the step changed must be in OrderBook's level updates, the last one for it holding its new quantity
+//
+// seeded runs make their inputs from a seed and run on WorkStealingPool, a libFuzzer build brings its own inputs
+//   sanitizers:	g++ -std=c++20 -g -O1 -fsanitize=address,undefined (or -fsanitize=thread) with the server's sources,
+//					then websocket-server-async --fuzz-book <seed> <runs> <steps> [threads]
+//   libFuzzer:		clang++ -std=c++20 -g -O1 -fsanitize=fuzzer,address -DBOOK_FUZZ_LIBFUZZER
+//					BookFuzz.cpp ReferenceBook.cpp OrderBook.cpp SimdKernels.cpp EventClock.cpp WorkStealingPool.cpp
+//					and no Server.cpp, libFuzzer has its own main
+struct BookFuzzResult {
+	std::size_t steps_{ 0 };
+	std::size_t trades_{ 0 };
+	std::size_t preventedFills_{ 0 };
+	std::string failure_;	// empty when the books agreed throughout, otherwise the step and what differed
+};
+
+class BookFuzz {
+public:
+	static constexpr std::size_t StepBytes = 8;
+
+	// replays input on a fresh pair of books, stopping at the first difference
+	static BookFuzzResult Check(const std::uint8_t* data, std::size_t size);
+	// checks runs inputs of steps steps each, input i made from seed + i so a failure reruns on its own, returns a process exit code
+	static int Run(std::uint64_t seed, std::size_t runs, std::size_t steps, std::size_t threads);
+};
+
+#endif
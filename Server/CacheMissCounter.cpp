@@ -0,0 +1,64 @@
+// cache miss counter: a hardware counter around a benchmark loop, where the platform lets us read one
+
+#include "common_includes.h"
+#include "CacheMissCounter.h"
+
+#if defined(__linux__)
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+CacheMissCounter::CacheMissCounter() {
+#if defined(__linux__)
+	perf_event_attr attributes;
+	memset(&attributes, 0, sizeof(attributes));
+	attributes.size = sizeof(attributes);
+	attributes.type = PERF_TYPE_HARDWARE;
+	attributes.config = PERF_COUNT_HW_CACHE_MISSES;
+	attributes.disabled = 1;
+	attributes.exclude_kernel = 1;
+	attributes.exclude_hv = 1;
+	descriptor_ = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+#endif
+}
+
+CacheMissCounter::~CacheMissCounter() {
+#if defined(__linux__)
+	if (descriptor_ >= 0)
+		close(descriptor_);
+#endif
+}
+
+bool CacheMissCounter::Available() const { return descriptor_ >= 0; }
+
+void CacheMissCounter::Start() {
+#if defined(__linux__)
+	if (descriptor_ < 0)
+		return;
+	ioctl(descriptor_, PERF_EVENT_IOC_RESET, 0);
+	ioctl(descriptor_, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+}
+
+uint64_t CacheMissCounter::Stop() {
+	uint64_t misses = 0;
+#if defined(__linux__)
+	if (descriptor_ < 0)
+		return 0;
+	ioctl(descriptor_, PERF_EVENT_IOC_DISABLE, 0);
+	if (read(descriptor_, &misses, sizeof(misses)) != sizeof(misses))
+		misses = 0;
+#endif
+	return misses;
+}
+
+string CacheMissCounter::PerItem(uint64_t misses, size_t items) const {
+	if (!Available())
+		return "n/a";
+	return format("{:.2f}", static_cast<double>(misses) / static_cast<double>(max<size_t>(items, 1)));
+}
@@ -0,0 +1,26 @@
+#ifndef CACHE_MISS_COUNTER_H
+#define CACHE_MISS_COUNTER_H
+
+#include "common_includes.h"
+
+// last level cache misses of the calling thread, for the benchmark modes
+// read from the hardware counters through perf_event_open on Linux, unavailable elsewhere,
+// in most virtual machines, and where kernel.perf_event_paranoid forbids it
+class CacheMissCounter {
+private:
+	int descriptor_{ -1 };
+public:
+	CacheMissCounter();
+	~CacheMissCounter();
+	CacheMissCounter(const CacheMissCounter&) = delete;
+	CacheMissCounter& operator=(const CacheMissCounter&) = delete;
+
+	bool Available() const;
+	void Start();
+	// misses since Start, 0 when unavailable
+	std::uint64_t Stop();
+	// misses per item as text, "n/a" when unavailable
+	std::string PerItem(std::uint64_t misses, std::size_t items) const;
+};
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef COLUMNAR_FORMAT_H
+#define COLUMNAR_FORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+
+// on-disk layout of the columnar export, shared by the writer and the reader tool
+// everything is little-endian and 8-byte aligned, so a reader can mmap a file and use the structs in place:
+//   ColumnarFileHeader
+//   per block: ColumnarBlockHeader, ColumnarColumnHeader for each column, then each column's packed values
+// a column stores value - base_ in bitWidth_ bits per row (frame of reference), padded to whole 64-bit words,
+// so row i of any column sits at a fixed bit offset and a block is only as wide as its values' range
+
+enum class ColumnarKind : std::uint32_t {
+	Trades = 1,
+	Depth = 2
+};
+
+// one row per trade
+enum class TradeColumn {
+	Sequence,
+	Timestamp,
+	BidOrderId,
+	BidPrice,
+	AskOrderId,
+	AskPrice,
+	Quantity,
+	Count
+};
+
+// one row per level of a top-N snapshot, all rows of a snapshot share its sequence and timestamp
+enum class DepthColumn {
+	Sequence,		// last level update the snapshot includes
+	Timestamp,
+	Side,			// 0 bid, 1 ask
+	Level,			// 0 is the best
+	Price,
+	Quantity,
+	Count
+};
+
+struct ColumnarFileHeader {
+	char magic_[8];				// "MDDSCOL1"
+	std::uint32_t version_;
+	ColumnarKind kind_;
+	std::uint32_t columns_;
+	std::uint32_t reserved_;
+	char symbol_[16];			// NUL padded
+};
+
+struct ColumnarBlockHeader {
+	std::uint32_t magic_;		// BlockMagic
+	std::uint32_t rows_;
+	std::uint32_t columns_;
+	std::uint32_t reserved_;
+	std::uint64_t bytes_;		// whole block, this header included, the next block starts right after
+};
+
+struct ColumnarColumnHeader {
+	std::int64_t base_;			// smallest value in the block
+	std::uint32_t bitWidth_;	// 0 when every value equals base_
+	std::uint32_t bytes_;		// packed values, a multiple of 8
+};
+
+class ColumnarCodec {
+public:
+	static constexpr char Magic[8] = { 'M', 'D', 'D', 'S', 'C', 'O', 'L', '1' };
+	static constexpr std::uint32_t Version = 1;
+	static constexpr std::uint32_t BlockMagic = 0x4b4c4243;		// "CBLK"
+	static constexpr std::size_t MaxColumns = 8;
+
+	static std::size_t PackedBytes(std::size_t rows, unsigned bitWidth) {
+		return (rows * bitWidth + 63) / 64 * 8;
+	}
+
+	// narrowest width that holds every value - base
+	static unsigned BitWidth(std::uint64_t range) {
+		unsigned width = 0;
+		while (width < 64 && (range >> width) != 0)
+			++width;
+		return width;
+	}
+
+	// out must hold PackedBytes(rows, bitWidth) zeroed bytes
+	static void Pack(const std::int64_t* values, std::size_t rows, std::int64_t base, unsigned bitWidth, std::uint64_t* out) {
+		if (bitWidth == 0)
+			return;
+		std::size_t bit = 0;
+		for (std::size_t row = 0; row < rows; ++row, bit += bitWidth) {
+			const std::uint64_t value = static_cast<std::uint64_t>(values[row]) - static_cast<std::uint64_t>(base);
+			const std::size_t word = bit / 64;
+			const unsigned shift = static_cast<unsigned>(bit % 64);
+			out[word] |= value << shift;
+			if (shift + bitWidth > 64)
+				out[word + 1] |= value >> (64 - shift);
+		}
+	}
+
+	static std::int64_t Unpack(const std::uint64_t* words, std::size_t row, std::int64_t base, unsigned bitWidth) {
+		if (bitWidth == 0)
+			return base;
+		const std::size_t bit = row * bitWidth;
+		const std::size_t word = bit / 64;
+		const unsigned shift = static_cast<unsigned>(bit % 64);
+		std::uint64_t value = words[word] >> shift;
+		if (shift + bitWidth > 64)
+			value |= words[word + 1] << (64 - shift);
+		if (bitWidth < 64)
+			value &= (std::uint64_t{ 1 } << bitWidth) - 1;
+		return static_cast<std::int64_t>(value + static_cast<std::uint64_t>(base));
+	}
+};
+
+#endif
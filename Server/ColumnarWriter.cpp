@@ -0,0 +1,227 @@
+// columnar writer: trades and depth snapshots packed into frame-of-reference blocks on a background thread
+
+#include "common_includes.h"
+#include "ColumnarWriter.h"
+#include "Metrics.h"
+#include <cstring>
+#include <filesystem>
+
+using namespace std;
+
+ColumnarWriter::ColumnarWriter(string directory)
+	: directory_{ std::move(directory) }
+{
+	error_code error;
+	filesystem::create_directories(directory_, error);
+	if (error)
+		throw logic_error(format("Export directory ({}) cannot be created: {}.", directory_, error.message()));
+
+	thread_ = thread([this] { Run(); });
+}
+
+ColumnarWriter::~ColumnarWriter() {
+	{
+		lock_guard<mutex> lock(mutex_);
+		stopping_ = true;
+	}
+	ready_.notify_one();
+	thread_.join();
+}
+
+void ColumnarWriter::AppendTrades(const string& symbol, const Trades& trades) {
+	if (trades.empty())
+		return;
+
+	Chunk chunk{ symbol, ColumnarKind::Trades, {} };
+	chunk.rows_.reserve(trades.size());
+	for (const auto& trade : trades) {
+		Row& row = chunk.rows_.emplace_back();
+		row[static_cast<size_t>(TradeColumn::Sequence)] = static_cast<int64_t>(trade.GetSequence());
+		row[static_cast<size_t>(TradeColumn::Timestamp)] = static_cast<int64_t>(trade.GetTimestamp());
+		row[static_cast<size_t>(TradeColumn::BidOrderId)] = static_cast<int64_t>(trade.GetBidTrade().orderId_);
+		row[static_cast<size_t>(TradeColumn::BidPrice)] = trade.GetBidTrade().price_;
+		row[static_cast<size_t>(TradeColumn::AskOrderId)] = static_cast<int64_t>(trade.GetAskTrade().orderId_);
+		row[static_cast<size_t>(TradeColumn::AskPrice)] = trade.GetAskTrade().price_;
+		row[static_cast<size_t>(TradeColumn::Quantity)] = trade.GetBidTrade().quantity_;
+	}
+	Push(std::move(chunk));
+}
+
+void ColumnarWriter::AppendDepth(const string& symbol, uint64_t sequence, uint64_t timestamp, const OrderBookLevelInfos& levels) {
+	Chunk chunk{ symbol, ColumnarKind::Depth, {} };
+	chunk.rows_.reserve(levels.GetBids().size() + levels.GetAsks().size());
+
+	auto append = [&](const LevelInfos& side, int64_t sideId) {
+		for (size_t level = 0; level < side.size(); ++level) {
+			Row& row = chunk.rows_.emplace_back();
+			row[static_cast<size_t>(DepthColumn::Sequence)] = static_cast<int64_t>(sequence);
+			row[static_cast<size_t>(DepthColumn::Timestamp)] = static_cast<int64_t>(timestamp);
+			row[static_cast<size_t>(DepthColumn::Side)] = sideId;
+			row[static_cast<size_t>(DepthColumn::Level)] = static_cast<int64_t>(level);
+			row[static_cast<size_t>(DepthColumn::Price)] = side[level].price_;
+			row[static_cast<size_t>(DepthColumn::Quantity)] = side[level].quantity_;
+		}
+	};
+	append(levels.GetBids(), 0);
+	append(levels.GetAsks(), 1);
+
+	if (!chunk.rows_.empty())
+		Push(std::move(chunk));
+}
+
+void ColumnarWriter::Push(Chunk chunk) {
+	const size_t rows = chunk.rows_.size();
+	{
+		lock_guard<mutex> lock(mutex_);
+		// the publisher must not wait on the disk, a slow writer costs rows instead
+		if (pendingRows_ + rows > MaxPendingRows) {
+			Metrics::Add(Counter::ExportDroppedRows, static_cast<int64_t>(rows));
+			return;
+		}
+		pending_.push_back(std::move(chunk));
+		pendingRows_ += rows;
+	}
+	ready_.notify_one();
+}
+
+void ColumnarWriter::Run() {
+	vector<Chunk> chunks;
+	for (;;) {
+		bool stopping;
+		{
+			unique_lock<mutex> lock(mutex_);
+			ready_.wait_for(lock, FlushInterval, [this] { return !pending_.empty() || stopping_; });
+			chunks.swap(pending_);
+			pendingRows_ = 0;
+			stopping = stopping_;
+		}
+
+		size_t rows = 0;
+		for (auto& chunk : chunks) {
+			ColumnFile& file = File(chunk.symbol_, chunk.kind_);
+			for (const Row& row : chunk.rows_) {
+				if (file.values_[0].empty())
+					file.firstPending_ = chrono::steady_clock::now();
+				for (size_t column = 0; column < file.columns_; ++column)
+					file.values_[column].push_back(row[column]);
+				if (file.values_[0].size() == BlockRows)
+					WriteBlock(file);
+			}
+			rows += chunk.rows_.size();
+		}
+		chunks.clear();
+		Metrics::Add(Counter::ExportedRows, static_cast<int64_t>(rows));
+
+		// short blocks for rows that have waited long enough, or for everything on the way out
+		const auto now = chrono::steady_clock::now();
+		for (auto& [name, file] : files_) {
+			if (!file.values_[0].empty() && (stopping || now - file.firstPending_ >= FlushInterval)) {
+				WriteBlock(file);
+				file.file_.flush();
+			}
+		}
+
+		if (stopping)
+			return;
+	}
+}
+
+// length of the part of an existing file that can be appended to: up to the end of its last whole block,
+// 0 when its header is not the one this writer would have written for the file
+static uint64_t AppendableLength(const filesystem::path& path, uint64_t size, const string& symbol, ColumnarKind kind, size_t columns) {
+	ifstream file(path, ios::binary);
+	ColumnarFileHeader header{};
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))
+		|| memcmp(header.magic_, ColumnarCodec::Magic, sizeof(header.magic_)) != 0
+		|| header.version_ != ColumnarCodec::Version || header.kind_ != kind || header.columns_ != columns
+		|| strncmp(header.symbol_, symbol.c_str(), sizeof(header.symbol_) - 1) != 0)
+		return 0;
+
+	// only block headers are read, a torn block is one that claims more bytes than the file holds
+	const uint64_t minimumBlock = sizeof(ColumnarBlockHeader) + columns * sizeof(ColumnarColumnHeader);
+	uint64_t offset = sizeof(header);
+	ColumnarBlockHeader block{};
+	while (offset + sizeof(block) <= size && file.seekg(static_cast<streamoff>(offset)).read(reinterpret_cast<char*>(&block), sizeof(block))) {
+		if (block.magic_ != ColumnarCodec::BlockMagic || block.columns_ != columns || block.bytes_ < minimumBlock || block.bytes_ > size - offset)
+			break;
+		offset += block.bytes_;
+	}
+	return offset;
+}
+
+ColumnarWriter::ColumnFile& ColumnarWriter::File(const string& symbol, ColumnarKind kind) {
+	const string name = symbol + (kind == ColumnarKind::Trades ? ".trades.col" : ".depth.col");
+	auto it = files_.find(name);
+	if (it != files_.end())
+		return it->second;
+
+	ColumnFile& file = files_[name];
+	file.kind_ = kind;
+	file.columns_ = kind == ColumnarKind::Trades ? static_cast<size_t>(TradeColumn::Count) : static_cast<size_t>(DepthColumn::Count);
+	for (size_t column = 0; column < file.columns_; ++column)
+		file.values_[column].reserve(BlockRows);
+
+	// a restarted server appends to the day's file, the header is only written once
+	// a torn block a crash left at the end is cut off first, and a file with another header is moved aside
+	const filesystem::path path = filesystem::path(directory_) / name;
+	error_code error;
+	const uint64_t size = filesystem::exists(path, error) ? filesystem::file_size(path, error) : 0;
+	const uint64_t length = !error && size ? AppendableLength(path, size, symbol, kind, file.columns_) : 0;
+	if (!error && size && !length) {
+		filesystem::path aside = path;
+		aside += ".invalid";
+		filesystem::rename(path, aside, error);
+		cerr << "export: " << path.string() << " has an unexpected header, moved to " << aside.string() << "\n";
+	}
+	else if (!error && length < size) {
+		filesystem::resize_file(path, length, error);
+		cerr << "export: cut " << size - length << " bytes of a torn block off " << path.string() << "\n";
+	}
+	// appending after a torn block or to a foreign file would leave it unreadable, nothing is written instead
+	if (!error)
+		file.file_.open(path, ios::binary | ios::app);
+	if (!length) {
+		ColumnarFileHeader header{};
+		memcpy(header.magic_, ColumnarCodec::Magic, sizeof(header.magic_));
+		header.version_ = ColumnarCodec::Version;
+		header.kind_ = kind;
+		header.columns_ = static_cast<uint32_t>(file.columns_);
+		memcpy(header.symbol_, symbol.data(), min(symbol.size(), sizeof(header.symbol_) - 1));
+		file.file_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	}
+	if (!file.file_)
+		cerr << "export: cannot write " << path.string() << "\n";
+	return file;
+}
+
+void ColumnarWriter::WriteBlock(ColumnFile& file) {
+	const size_t rows = file.values_[0].size();
+
+	ColumnarColumnHeader columns[ColumnarCodec::MaxColumns] = {};
+	size_t packedBytes = 0;
+	for (size_t column = 0; column < file.columns_; ++column) {
+		const auto [low, high] = minmax_element(file.values_[column].begin(), file.values_[column].end());
+		columns[column].base_ = *low;
+		columns[column].bitWidth_ = ColumnarCodec::BitWidth(static_cast<uint64_t>(*high) - static_cast<uint64_t>(*low));
+		columns[column].bytes_ = static_cast<uint32_t>(ColumnarCodec::PackedBytes(rows, columns[column].bitWidth_));
+		packedBytes += columns[column].bytes_;
+	}
+
+	ColumnarBlockHeader block{};
+	block.magic_ = ColumnarCodec::BlockMagic;
+	block.rows_ = static_cast<uint32_t>(rows);
+	block.columns_ = static_cast<uint32_t>(file.columns_);
+	block.bytes_ = sizeof(block) + file.columns_ * sizeof(ColumnarColumnHeader) + packedBytes;
+
+	packed_.assign(packedBytes / 8, 0);
+	uint64_t* out = packed_.data();
+	for (size_t column = 0; column < file.columns_; ++column) {
+		ColumnarCodec::Pack(file.values_[column].data(), rows, columns[column].base_, columns[column].bitWidth_, out);
+		out += columns[column].bytes_ / 8;
+		file.values_[column].clear();
+	}
+
+	file.file_.write(reinterpret_cast<const char*>(&block), sizeof(block));
+	file.file_.write(reinterpret_cast<const char*>(columns), static_cast<streamsize>(file.columns_ * sizeof(ColumnarColumnHeader)));
+	file.file_.write(reinterpret_cast<const char*>(packed_.data()), static_cast<streamsize>(packedBytes));
+}
@@ -0,0 +1,70 @@
+#ifndef COLUMNAR_WRITER_H
+#define COLUMNAR_WRITER_H
+
+#include "common_includes.h"
+#include "ColumnarFormat.h"
+#include "OrderBook.h"
+#include <array>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// streams trades and top-N depth snapshots into SYMBOL.trades.col and SYMBOL.depth.col files of ColumnarFormat.h
+// callers only copy rows into a pending list, a background thread packs them into blocks of BlockRows and writes them
+// pending rows are bounded and a caller never waits: rows that would take it past MaxPendingRows are dropped and counted,
+// the export then has a gap in its sequence column where the disk fell behind
+// rows that have not filled a block are written as a short block once they are FlushInterval old, so readers see them
+// a file an earlier run left is appended to once its header matches and a torn last block has been cut off
+class ColumnarWriter {
+public:
+	static constexpr std::size_t BlockRows = 4096;
+	static constexpr std::size_t MaxPendingRows = std::size_t(1) << 20;
+	static constexpr std::chrono::milliseconds FlushInterval{ 1000 };
+
+	// throws logic_error when the directory cannot be created
+	explicit ColumnarWriter(std::string directory);
+	// writes everything still pending, short blocks included
+	~ColumnarWriter();
+
+	ColumnarWriter(const ColumnarWriter&) = delete;
+	ColumnarWriter& operator=(const ColumnarWriter&) = delete;
+
+	void AppendTrades(const std::string& symbol, const Trades& trades);
+	void AppendDepth(const std::string& symbol, std::uint64_t sequence, std::uint64_t timestamp, const OrderBookLevelInfos& levels);
+
+private:
+	using Row = std::array<std::int64_t, ColumnarCodec::MaxColumns>;
+
+	struct Chunk {
+		std::string symbol_;
+		ColumnarKind kind_;
+		std::vector<Row> rows_;
+	};
+
+	struct ColumnFile {
+		std::ofstream file_;
+		ColumnarKind kind_;
+		std::size_t columns_;
+		std::vector<std::int64_t> values_[ColumnarCodec::MaxColumns];
+		std::chrono::steady_clock::time_point firstPending_;
+	};
+
+	std::string directory_;
+	std::mutex mutex_;
+	std::condition_variable ready_;
+	std::vector<Chunk> pending_;
+	std::size_t pendingRows_{ 0 };
+	bool stopping_{ false };
+
+	// only touched by the writer thread
+	std::unordered_map<std::string, ColumnFile> files_;
+	std::vector<std::uint64_t> packed_;
+	std::thread thread_;
+
+	void Push(Chunk chunk);
+	void Run();
+	ColumnFile& File(const std::string& symbol, ColumnarKind kind);
+	void WriteBlock(ColumnFile& file);
+};
+
+#endif
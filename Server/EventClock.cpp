@@ -0,0 +1,203 @@
+// event clock: TSC readings scaled to epoch nanoseconds, with a steady_clock fallback
+// the scale is a 32.32 fixed point ns-per-tick factor, so a reading costs a multiply and a shift
+
+#include "common_includes.h"
+#include "EventClock.h"
+#include <atomic>
+#include <thread>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define EVENT_CLOCK_TSC 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+#endif
+
+using namespace std;
+
+struct EventClockCalibration {
+	bool tsc_{ false };
+	uint64_t tscBase_{ 0 };
+	uint64_t epochBase_{ 0 };		// epoch nanoseconds at tscBase_
+	uint64_t multiplier_{ 0 };		// nanoseconds per tick, 32.32 fixed point
+	int64_t steadyOffset_{ 0 };		// epoch minus steady_clock, in nanoseconds
+};
+
+static int64_t SteadyNanoseconds() {
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int64_t EpochNanoseconds() {
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static EventClockCalibration Uncalibrated() {
+	EventClockCalibration calibration;
+	calibration.steadyOffset_ = EpochNanoseconds() - SteadyNanoseconds();
+	return calibration;
+}
+
+// the calibration readers use, kept behind a sequence counter (a seqlock)
+// the calibrating thread makes the counter odd, stores the fields and makes it even again, a reader copies the fields
+// between two reads of the counter and retries when it was odd or moved, so it never uses a half-written calibration
+// the fields are relaxed atomics, so a copy that races a store is well defined and simply thrown away
+class PublishedCalibration {
+private:
+	atomic<uint64_t> sequence_{ 0 };
+	atomic<bool> tsc_{ false };
+	atomic<uint64_t> tscBase_{ 0 };
+	atomic<uint64_t> epochBase_{ 0 };
+	atomic<uint64_t> multiplier_{ 0 };
+	atomic<int64_t> steadyOffset_{ 0 };
+public:
+	explicit PublishedCalibration(const EventClockCalibration& calibration) { Store(calibration); }
+
+	EventClockCalibration Load() const {
+		EventClockCalibration calibration;
+		uint64_t before, after;
+		do {
+			before = sequence_.load(memory_order_acquire);
+			calibration.tsc_ = tsc_.load(memory_order_relaxed);
+			calibration.tscBase_ = tscBase_.load(memory_order_relaxed);
+			calibration.epochBase_ = epochBase_.load(memory_order_relaxed);
+			calibration.multiplier_ = multiplier_.load(memory_order_relaxed);
+			calibration.steadyOffset_ = steadyOffset_.load(memory_order_relaxed);
+			atomic_thread_fence(memory_order_acquire);
+			after = sequence_.load(memory_order_relaxed);
+		} while (before != after || (before & 1) != 0);
+		return calibration;
+	}
+	// one writer at a time, the calibrating thread
+	void Store(const EventClockCalibration& calibration) {
+		const uint64_t sequence = sequence_.load(memory_order_relaxed);
+		sequence_.store(sequence + 1, memory_order_relaxed);
+		atomic_thread_fence(memory_order_release);
+		tsc_.store(calibration.tsc_, memory_order_relaxed);
+		tscBase_.store(calibration.tscBase_, memory_order_relaxed);
+		epochBase_.store(calibration.epochBase_, memory_order_relaxed);
+		multiplier_.store(calibration.multiplier_, memory_order_relaxed);
+		steadyOffset_.store(calibration.steadyOffset_, memory_order_relaxed);
+		sequence_.store(sequence + 2, memory_order_release);
+	}
+};
+
+static PublishedCalibration published{ Uncalibrated() };
+
+// the calibrating thread's own state: where the TSC rate is measured from and when it was last corrected
+static int64_t steadyOrigin = 0;
+static uint64_t tscOrigin = 0;
+static int64_t lastResync = 0;
+
+#if defined(EVENT_CLOCK_TSC)
+
+// only an invariant TSC ticks at a constant rate through frequency and power state changes
+static bool CpuHasInvariantTsc() {
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0x80000000);
+	if (static_cast<unsigned>(info[0]) < 0x80000007)
+		return false;
+	__cpuid(info, 0x80000007);
+	return (info[3] & (1 << 8)) != 0;
+#else
+	unsigned eax, ebx, ecx, edx;
+	if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+		return false;
+	return (edx & (1u << 8)) != 0;
+#endif
+}
+
+static uint64_t ScaleTicks(uint64_t ticks, uint64_t multiplier) {
+#if defined(_MSC_VER)
+	uint64_t high;
+	uint64_t low = _umul128(ticks, multiplier, &high);
+	return __shiftright128(low, high, 32);
+#else
+	return static_cast<uint64_t>((static_cast<unsigned __int128>(ticks) * multiplier) >> 32);
+#endif
+}
+
+// a steady_clock reading paired with the TSC at its midpoint, so the pair is off by at most half a clock call
+static pair<int64_t, uint64_t> ReadPair() {
+	const uint64_t before = __rdtsc();
+	const int64_t steady = SteadyNanoseconds();
+	const uint64_t after = __rdtsc();
+	return { steady, before + (after - before) / 2 };
+}
+
+#endif
+
+void EventClock::Calibrate(chrono::milliseconds window) {
+	EventClockCalibration calibration = Uncalibrated();
+
+#if defined(EVENT_CLOCK_TSC)
+	if (CpuHasInvariantTsc()) {
+		const auto [steadyStart, tscStart] = ReadPair();
+		this_thread::sleep_for(window);
+		const auto [steadyEnd, tscEnd] = ReadPair();
+
+		const int64_t nanoseconds = steadyEnd - steadyStart;
+		const uint64_t ticks = tscEnd - tscStart;
+		if (nanoseconds > 0 && ticks != 0) {
+			calibration.multiplier_ = (static_cast<uint64_t>(nanoseconds) << 32) / ticks;
+			calibration.tscBase_ = tscEnd;
+			calibration.epochBase_ = static_cast<uint64_t>(steadyEnd + calibration.steadyOffset_);
+			calibration.tsc_ = true;
+
+			steadyOrigin = steadyStart;
+			tscOrigin = tscStart;
+			lastResync = steadyEnd;
+		}
+	}
+#endif
+	published.Store(calibration);
+}
+
+// a short calibration window leaves the rate off by some parts per million, which adds up to
+// milliseconds within the hour, so every ResyncInterval the rate is measured again over the whole
+// run and the clock is steered to meet steady_clock one interval later
+// the correction is a change of slope from the current reading, so timestamps never go backwards
+void EventClock::Resync() {
+#if defined(EVENT_CLOCK_TSC)
+	const EventClockCalibration active = published.Load();
+	if (!active.tsc_)
+		return;
+
+	const auto [steady, tsc] = ReadPair();
+	if (steady - lastResync < ResyncInterval.count() || tsc <= active.tscBase_ || tsc <= tscOrigin)
+		return;
+	lastResync = steady;
+
+	const uint64_t reading = active.epochBase_ + ScaleTicks(tsc - active.tscBase_, active.multiplier_);
+	const uint64_t target = static_cast<uint64_t>(steady + active.steadyOffset_ + ResyncInterval.count());
+	const double ticksPerNanosecond = static_cast<double>(tsc - tscOrigin) / static_cast<double>(steady - steadyOrigin);
+	const uint64_t ticks = static_cast<uint64_t>(static_cast<double>(ResyncInterval.count()) * ticksPerNanosecond);
+	if (target <= reading || ticks == 0)
+		return;
+
+	EventClockCalibration next = active;
+	next.tscBase_ = tsc;
+	next.epochBase_ = reading;
+	next.multiplier_ = ((target - reading) << 32) / ticks;
+	published.Store(next);
+#endif
+}
+
+uint64_t EventClock::Now() {
+	const EventClockCalibration calibration = published.Load();
+#if defined(EVENT_CLOCK_TSC)
+	if (calibration.tsc_) {
+		const uint64_t tsc = __rdtsc();
+		// a core whose counter trails the calibrating one by a few ticks reads the calibration instant
+		if (tsc <= calibration.tscBase_)
+			return calibration.epochBase_;
+		return calibration.epochBase_ + ScaleTicks(tsc - calibration.tscBase_, calibration.multiplier_);
+	}
+#endif
+	return static_cast<uint64_t>(SteadyNanoseconds() + calibration.steadyOffset_);
+}
+
+bool EventClock::UsesTsc() { return published.Load().tsc_; }
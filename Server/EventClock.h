@@ -0,0 +1,21 @@
+#ifndef EVENT_CLOCK_H
+#define EVENT_CLOCK_H
+
+#include "common_includes.h"
+
+// nanoseconds since the Unix epoch, cheap enough to read for every book event
+// with an invariant TSC a reading is one rdtsc scaled by a rate calibrated against the system clock,
+// otherwise it is steady_clock shifted onto the epoch, which the vDSO also serves without a syscall
+class EventClock {
+public:
+	static constexpr std::chrono::nanoseconds ResyncInterval = std::chrono::seconds(1);
+
+	// measures the TSC rate over window, call once at startup before other threads read the clock
+	static void Calibrate(std::chrono::milliseconds window = std::chrono::milliseconds(20));
+	// corrects the accumulated drift at most once per ResyncInterval, call often from one thread only
+	static void Resync();
+	static std::uint64_t Now();
+	static bool UsesTsc();
+};
+
+#endif
@@ -0,0 +1,158 @@
+// index benchmark: the book's flat id index next to the node based map it replaced
+
+#include "common_includes.h"
+#include "IndexBenchmark.h"
+#include "OrderIdIndex.h"
+#include "OrderBook.h"
+#include "CacheMissCounter.h"
+#include <random>
+
+using namespace std;
+
+// as large as OrderBook's cold per-order entry
+struct IndexPayload {
+	uint64_t words_[4];
+};
+
+enum class IndexOperation : uint8_t {
+	Replace,		// take a live id out and insert a new one, a cancel and a new order
+	FindLive,
+	FindMissing
+};
+
+struct IndexStep {
+	IndexOperation operation_;
+	OrderId orderId_;
+	OrderId replacement_;
+};
+
+struct IndexTimings {
+	double insert_{ 0 };		// ns per id
+	double mixed_{ 0 };			// ns per operation
+	double erase_{ 0 };			// ns per id
+	uint64_t insertMisses_{ 0 };
+	uint64_t mixedMisses_{ 0 };
+	uint64_t eraseMisses_{ 0 };
+	uint64_t checksum_{ 0 };
+};
+
+// live ids are drawn from the whole live set, new ids continue the sequence like a book's
+// the ids still live after the last step are left in finalIds
+static vector<IndexStep> GenerateSteps(size_t live, size_t operations, vector<OrderId>& finalIds) {
+	mt19937_64 random(32);
+	vector<OrderId> ids(live);
+	iota(ids.begin(), ids.end(), 1);
+	OrderId next = live + 1;
+
+	vector<IndexStep> steps;
+	steps.reserve(operations);
+	for (size_t i = 0; i < operations; ++i) {
+		const uint64_t roll = random() % 10;
+		OrderId& target = ids[random() % ids.size()];
+		if (roll < 4) {
+			steps.push_back({ IndexOperation::Replace, target, next });
+			target = next++;
+		}
+		else if (roll < 8) {
+			steps.push_back({ IndexOperation::FindLive, target, 0 });
+		}
+		else {
+			steps.push_back({ IndexOperation::FindMissing, next + 1 + random() % live, 0 });
+		}
+	}
+	finalIds = std::move(ids);
+	return steps;
+}
+
+template <typename Insert, typename Find, typename Take>
+static IndexTimings Time(size_t live, const vector<IndexStep>& steps, const vector<OrderId>& finalIds, CacheMissCounter& counter, Insert insert, Find find, Take take) {
+	IndexTimings timings;
+	auto elapsed = [](chrono::steady_clock::time_point start, size_t count) {
+		return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / static_cast<double>(count);
+	};
+
+	counter.Start();
+	auto start = chrono::steady_clock::now();
+	for (OrderId id = 1; id <= live; ++id)
+		insert(id, IndexPayload{ { id, id, id, id } });
+	timings.insert_ = elapsed(start, live);
+	timings.insertMisses_ = counter.Stop();
+
+	counter.Start();
+	start = chrono::steady_clock::now();
+	for (const auto& step : steps) {
+		switch (step.operation_) {
+		case IndexOperation::Replace:
+			if (auto payload = take(step.orderId_))
+				timings.checksum_ += payload->words_[0];
+			insert(step.replacement_, IndexPayload{ { step.replacement_, 0, 0, 0 } });
+			break;
+		case IndexOperation::FindLive:
+		case IndexOperation::FindMissing:
+			if (const IndexPayload* payload = find(step.orderId_))
+				timings.checksum_ += payload->words_[0];
+			break;
+		}
+	}
+	timings.mixed_ = elapsed(start, steps.size());
+	timings.mixedMisses_ = counter.Stop();
+
+	size_t erased = 0;
+	counter.Start();
+	start = chrono::steady_clock::now();
+	for (OrderId id : finalIds)
+		erased += take(id).has_value();
+	timings.erase_ = elapsed(start, finalIds.size());
+	timings.eraseMisses_ = counter.Stop();
+	timings.checksum_ += erased;
+	return timings;
+}
+
+int IndexBenchmark::Run(size_t operations) {
+	CacheMissCounter counter;
+	bool same = true;
+	for (size_t live : { size_t{ 1'000'000 }, size_t{ 4'000'000 } }) {
+		vector<OrderId> finalIds;
+		const vector<IndexStep> steps = GenerateSteps(live, operations, finalIds);
+
+		IndexTimings flat, node;
+		{
+			OrderIdIndex<OrderId, IndexPayload> index;
+			index.Reserve(live);
+			flat = Time(live, steps, finalIds, counter,
+				[&](OrderId id, const IndexPayload& payload) { index.Insert(id, payload); },
+				[&](OrderId id) { return index.Find(id); },
+				[&](OrderId id) { return index.Take(id); });
+		}
+		{
+			unordered_map<OrderId, IndexPayload> map;
+			map.reserve(live);
+			node = Time(live, steps, finalIds, counter,
+				[&](OrderId id, const IndexPayload& payload) { map.try_emplace(id, payload); },
+				[&](OrderId id) -> IndexPayload* {
+					auto it = map.find(id);
+					return it != map.end() ? &it->second : nullptr;
+				},
+				[&](OrderId id) -> optional<IndexPayload> {
+					auto it = map.find(id);
+					if (it == map.end())
+						return nullopt;
+					IndexPayload payload = it->second;
+					map.erase(it);
+					return payload;
+				});
+		}
+		same = same && flat.checksum_ == node.checksum_;
+
+		cout << format("{} live ids, {} operations: 40% cancel and add, 40% lookup of a live id, 20% lookup of a missing id\n", live, operations);
+		auto row = [&](const char* name, const IndexTimings& timings) {
+			cout << format("{:14} insert {:7.1f} ns ({} misses), mix {:7.1f} ns/op ({} misses), erase {:7.1f} ns ({} misses)\n", name,
+				timings.insert_, counter.PerItem(timings.insertMisses_, live),
+				timings.mixed_, counter.PerItem(timings.mixedMisses_, steps.size()),
+				timings.erase_, counter.PerItem(timings.eraseMisses_, live));
+		};
+		row("OrderIdIndex", flat);
+		row("unordered_map", node);
+	}
+	return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
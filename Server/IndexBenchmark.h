@@ -0,0 +1,16 @@
+#ifndef INDEX_BENCHMARK_H
+#define INDEX_BENCHMARK_H
+
+#include "common_includes.h"
+
+// measures OrderIdIndex against std::unordered_map holding the same payload, at 1M and 4M live ids
+// each size is timed as a bulk insert, then a steady mix of the book's own operations with the live count held:
+// a cancel and a new order, a lookup of a resting order for a modify, and a lookup of an id that is gone,
+// then erasing every id; both containers are reserved up front and run the same pre-generated operations
+class IndexBenchmark {
+public:
+	// returns a process exit code
+	static int Run(std::size_t operations);
+};
+
+#endif
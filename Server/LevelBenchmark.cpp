@@ -0,0 +1,197 @@
+// level benchmark: list of shared orders per level against parallel arrays per level, swept by one aggressor
+
+#include "common_includes.h"
+#include "LevelBenchmark.h"
+#include "OrderBook.h"
+#include "CacheMissCounter.h"
+#include <random>
+
+using namespace std;
+
+// the asks side as it was kept before the level queues, best level at the back
+struct ListLevels {
+	vector<Price> prices_;
+	vector<Quantity> quantities_;
+	vector<list<OrderPointer>> orders_;
+};
+
+struct SweepResult {
+	size_t fills_{ 0 };
+	uint64_t checksum_{ 0 };	// of what the sweep read, so neither loop can be optimised away
+	double nanoseconds_{ 0 };
+	uint64_t misses_{ 0 };
+};
+
+struct RestingOrder {
+	OrderId orderId_;
+	Price price_;
+	Quantity quantity_;
+	bool cancelled_;
+};
+
+// arrival order of the orders, round robin across levels with random quantities and a quarter cancelled
+static vector<RestingOrder> GenerateOrders(size_t levels, size_t ordersPerLevel) {
+	mt19937_64 random(28);
+	uniform_int_distribution<Quantity> quantities(1, 100);
+	vector<RestingOrder> orders;
+	orders.reserve(levels * ordersPerLevel);
+	for (size_t i = 0; i < levels * ordersPerLevel; ++i)
+		orders.push_back({ i + 1, static_cast<Price>(10000 + i % levels), quantities(random), random() % 4 == 0 });
+	return orders;
+}
+
+static SweepResult SweepLists(const vector<RestingOrder>& orders, size_t levels, CacheMissCounter& counter) {
+	ListLevels side;
+	side.prices_.resize(levels);
+	side.quantities_.resize(levels);
+	side.orders_.resize(levels);
+	// asks run descending so the lowest, best, price is at the back
+	for (size_t level = 0; level < levels; ++level)
+		side.prices_[level] = static_cast<Price>(10000 + levels - 1 - level);
+
+	vector<pair<size_t, list<OrderPointer>::iterator>> locations;
+	locations.reserve(orders.size());
+	for (const auto& order : orders) {
+		const size_t level = levels - 1 - static_cast<size_t>(order.price_ - 10000);
+		side.quantities_[level] += order.quantity_;
+		side.orders_[level].push_back(make_shared<Order>(OrderType::GoodTillCancel, order.orderId_, Side::Sell, order.price_, order.quantity_));
+		locations.emplace_back(level, prev(side.orders_[level].end()));
+	}
+	for (size_t i = 0; i < orders.size(); ++i) {
+		if (orders[i].cancelled_) {
+			auto [level, location] = locations[i];
+			side.quantities_[level] -= (*location)->GetRemainingQuantity();
+			side.orders_[level].erase(location);
+		}
+	}
+
+	SweepResult result;
+	counter.Start();
+	const auto start = chrono::steady_clock::now();
+	while (!side.prices_.empty()) {
+		auto& resting = side.orders_.back();
+		while (!resting.empty()) {
+			const OrderPointer& order = resting.front();
+			const Quantity fill = order->GetRemainingQuantity();
+			result.checksum_ += order->GetOrderId() ^ fill;
+			order->Fill(fill);
+			side.quantities_.back() -= fill;
+			if (order->IsFilled())
+				resting.pop_front();
+			++result.fills_;
+		}
+		side.prices_.pop_back();
+		side.quantities_.pop_back();
+		side.orders_.pop_back();
+	}
+	result.nanoseconds_ = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+	result.misses_ = counter.Stop();
+	return result;
+}
+
+static SweepResult SweepQueues(const vector<RestingOrder>& orders, CacheMissCounter& counter) {
+	BookSide<Side::Sell> side;
+	// ids run from 1, so an order's slot sits at its id - 1
+	vector<uint64_t> slots;
+	slots.reserve(orders.size());
+	for (const auto& order : orders)
+		slots.push_back(side.Push(order.orderId_, order.price_, order.quantity_, 0));
+	for (size_t i = 0; i < orders.size(); ++i)
+		if (orders[i].cancelled_)
+			if (LevelQueue* compacted = side.Erase(orders[i].price_, slots[i]))
+				compacted->ForEachLive([&](OrderId orderId, uint64_t slot) { slots[orderId - 1] = slot; });
+
+	SweepResult result;
+	counter.Start();
+	const auto start = chrono::steady_clock::now();
+	while (!side.Empty()) {
+		LevelQueue& resting = side.BestQueue();
+		while (!resting.Empty()) {
+			const Quantity fill = resting.FrontRemainingQuantity();
+			result.checksum_ += resting.FrontOrderId() ^ fill;
+			side.FillBest(fill);
+			resting.FillFront(fill);
+			++result.fills_;
+		}
+		side.PopBest();
+	}
+	result.nanoseconds_ = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+	result.misses_ = counter.Stop();
+	return result;
+}
+
+// one level whose front order never trades while the orders behind it are cancelled and replaced, a quoting flow
+// without compaction the level would hold a slot for every order ever placed behind the front
+static int ChurnBehindFront(size_t churns) {
+	constexpr Price price = 10000;
+	constexpr size_t behind = 64;
+	constexpr ParticipantId front = 1, quoting = 2, absent = 3;
+
+	BookSide<Side::Sell> side;
+	vector<uint64_t> slots(churns + behind + 2);
+	vector<OrderId> live;
+	OrderId next = 1;
+	slots[next] = side.Push(next, price, 100, front);
+	++next;
+	for (size_t i = 0; i < behind; ++i, ++next) {
+		slots[next] = side.Push(next, price, 10, quoting);
+		live.push_back(next);
+	}
+
+	mt19937_64 random(28);
+	size_t compactions = 0;
+	const auto start = chrono::steady_clock::now();
+	for (size_t i = 0; i < churns; ++i, ++next) {
+		OrderId& target = live[random() % behind];
+		if (LevelQueue* compacted = side.Erase(price, slots[target])) {
+			compacted->ForEachLive([&](OrderId orderId, uint64_t slot) { slots[orderId] = slot; });
+			++compactions;
+		}
+		slots[next] = side.Push(next, price, 10, quoting);
+		target = next;
+	}
+	const double churn = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / static_cast<double>(churns);
+
+	// a fill-or-kill self-trade check walks every slot of the level when the owner has no order there
+	const size_t checks = 10'000;
+	size_t found = 0;
+	const auto checkStart = chrono::steady_clock::now();
+	for (size_t i = 0; i < checks; ++i)
+		found += side.HoldsOwner(price, absent);
+	const double check = chrono::duration<double, nano>(chrono::steady_clock::now() - checkStart).count() / static_cast<double>(checks);
+
+	LevelQueue& queue = side.BestQueue();
+	size_t fronts = 0;
+	queue.ForEachLive([&](OrderId orderId, uint64_t) { fronts += orderId == 1; });
+	cout << format("front order resting while {} orders behind it churn, {} live behind it\n", churns, behind);
+	cout << format("level queues:          {:8.2f} ns/cancel and add, {} compactions, {} slots held at the end, owner check {:.1f} ns\n",
+		churn, compactions, queue.Slots(), check);
+	return found == 0 && fronts == 1 && queue.FrontOrderId() == 1 && queue.Slots() <= 3 * (behind + 1) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int LevelBenchmark::Run(size_t levels, size_t ordersPerLevel) {
+	const vector<RestingOrder> orders = GenerateOrders(levels, ordersPerLevel);
+	// enough rounds for a few million fills, every round sweeps a freshly built side
+	const size_t rounds = max<size_t>(1, 4'000'000 / orders.size());
+
+	CacheMissCounter counter;
+	SweepResult lists, queues;
+	auto add = [](SweepResult& total, const SweepResult& sweep) {
+		total.fills_ += sweep.fills_;
+		total.checksum_ += sweep.checksum_;
+		total.nanoseconds_ += sweep.nanoseconds_;
+		total.misses_ += sweep.misses_;
+	};
+	for (size_t round = 0; round < rounds; ++round) {
+		add(lists, SweepLists(orders, levels, counter));
+		add(queues, SweepQueues(orders, counter));
+	}
+
+	cout << format("{} levels of {} orders, a quarter cancelled, {} rounds, {} fills per round\n", levels, ordersPerLevel, rounds, queues.fills_ / rounds);
+	cout << format("list of shared orders: {:8.2f} ns/fill, {} cache misses/fill\n",
+		lists.nanoseconds_ / static_cast<double>(lists.fills_), counter.PerItem(lists.misses_, lists.fills_));
+	cout << format("level queues:          {:8.2f} ns/fill, {} cache misses/fill, {:.1f}x faster\n",
+		queues.nanoseconds_ / static_cast<double>(queues.fills_), counter.PerItem(queues.misses_, queues.fills_), lists.nanoseconds_ / queues.nanoseconds_);
+	const int churn = ChurnBehindFront(1'000'000);
+	return lists.checksum_ == queues.checksum_ && churn == EXIT_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,19 @@
+#ifndef LEVEL_BENCHMARK_H
+#define LEVEL_BENCHMARK_H
+
+#include "common_includes.h"
+
+// measures a sweep through deep price levels in the book's resting order layout and in the one it replaced
+// the old layout is a std::list of shared Order pointers per level, the new one is BookSide and its LevelQueues
+// both are built with orders arriving round robin across levels, as they do in a live book, a quarter of them
+// cancelled, then one aggressor takes every order; only the sweep is timed, and the id index both layouts
+// update on a fill is left out so the numbers are the level layout alone
+// a second case keeps one level's front order resting while 1M orders behind it are cancelled and replaced,
+// and reports the slots the level still holds and the cost of an owner check that walks all of them
+class LevelBenchmark {
+public:
+	// returns a process exit code
+	static int Run(std::size_t levels, std::size_t ordersPerLevel);
+};
+
+#endif
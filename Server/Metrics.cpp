@@ -0,0 +1,159 @@
+// runtime metrics, recorded per thread and aggregated off the hot path
+
+#include "common_includes.h"
+#include "Metrics.h"
+#include <array>
+#include <bit>
+#include <mutex>
+
+using namespace std;
+
+namespace {
+
+struct MetricsShard {
+	array<atomic<int64_t>, static_cast<size_t>(Counter::Count)> counters_{};
+	array<array<atomic<uint64_t>, Metrics::Buckets>, static_cast<size_t>(Histogram::Count)> histograms_{};
+};
+
+struct MetricsRegistry {
+	mutex mutex_;
+	vector<unique_ptr<MetricsShard>> shards_;	// outlive their threads so nothing recorded is lost
+	array<atomic<int64_t>, static_cast<size_t>(Gauge::Count)> gauges_{};
+};
+
+MetricsRegistry& Registry() {
+	static MetricsRegistry registry;
+	return registry;
+}
+
+MetricsShard& LocalShard() {
+	thread_local MetricsShard* shard = [] {
+		MetricsRegistry& registry = Registry();
+		lock_guard<mutex> lock(registry.mutex_);
+		registry.shards_.push_back(make_unique<MetricsShard>());
+		return registry.shards_.back().get();
+	}();
+	return *shard;
+}
+
+// single writer per shard, a load and a store avoid a locked read-modify-write
+template <typename T>
+void Bump(atomic<T>& value, T by) {
+	value.store(value.load(memory_order_relaxed) + by, memory_order_relaxed);
+}
+
+const char* CounterName(Counter counter) {
+	switch (counter) {
+	case Counter::OrdersReceived: return "mdds_orders_received_total";
+	case Counter::Trades: return "mdds_trades_total";
+	case Counter::MessagesSent: return "mdds_messages_sent_total";
+	case Counter::FramesSent: return "mdds_frames_sent_total";
+	case Counter::BytesSent: return "mdds_bytes_sent_total";
+	case Counter::SlowConsumerDrops: return "mdds_slow_consumer_drops_total";
+	case Counter::QueuedMessages: return "mdds_session_queued_messages";
+	case Counter::ExportedRows: return "mdds_exported_rows_total";
+	case Counter::ExportDroppedRows: return "mdds_export_dropped_rows_total";
+	default: return "mdds_unknown";
+	}
+}
+const char* HistogramName(Histogram histogram) {
+	switch (histogram) {
+	case Histogram::MatchLatency: return "mdds_match_latency_ns";
+	case Histogram::SessionQueueDepth: return "mdds_session_queue_depth";
+	default: return "mdds_unknown";
+	}
+}
+const char* GaugeName(Gauge gauge) {
+	switch (gauge) {
+	case Gauge::BookOrders: return "mdds_book_orders";
+	case Gauge::BookLevels: return "mdds_book_levels";
+	case Gauge::Sessions: return "mdds_sessions";
+	default: return "mdds_unknown";
+	}
+}
+
+} // namespace
+
+void Metrics::Add(Counter counter, int64_t value) {
+	Bump(LocalShard().counters_[static_cast<size_t>(counter)], value);
+}
+void Metrics::Record(Histogram histogram, uint64_t value) {
+	Bump(LocalShard().histograms_[static_cast<size_t>(histogram)][BucketOf(value)], uint64_t{ 1 });
+}
+void Metrics::Set(Gauge gauge, int64_t value) {
+	Registry().gauges_[static_cast<size_t>(gauge)].store(value, memory_order_relaxed);
+}
+void Metrics::Adjust(Gauge gauge, int64_t delta) {
+	Registry().gauges_[static_cast<size_t>(gauge)].fetch_add(delta, memory_order_relaxed);
+}
+
+size_t Metrics::BucketOf(uint64_t value) {
+	if (value < SubBuckets)
+		return static_cast<size_t>(value);
+
+	// the top bit picks the power of two, the next four bits the linear step inside it
+	const unsigned exponent = static_cast<unsigned>(bit_width(value)) - 1;
+	const unsigned shift = exponent - 4;
+	return (exponent - 3) * SubBuckets + ((value >> shift) & (SubBuckets - 1));
+}
+uint64_t Metrics::BucketLowerBound(size_t bucket) {
+	if (bucket < SubBuckets)
+		return bucket;
+
+	const unsigned exponent = static_cast<unsigned>(bucket / SubBuckets) + 3;
+	return (SubBuckets + bucket % SubBuckets) << (exponent - 4);
+}
+
+string Metrics::Render() {
+	MetricsRegistry& registry = Registry();
+
+	array<int64_t, static_cast<size_t>(Counter::Count)> counters{};
+	array<array<uint64_t, Buckets>, static_cast<size_t>(Histogram::Count)> histograms{};
+	{
+		lock_guard<mutex> lock(registry.mutex_);
+		for (const auto& shard : registry.shards_) {
+			for (size_t i = 0; i < counters.size(); ++i)
+				counters[i] += shard->counters_[i].load(memory_order_relaxed);
+			for (size_t h = 0; h < histograms.size(); ++h)
+				for (size_t b = 0; b < Buckets; ++b)
+					histograms[h][b] += shard->histograms_[h][b].load(memory_order_relaxed);
+		}
+	}
+
+	string text;
+	for (size_t i = 0; i < counters.size(); ++i)
+		text += format("{} {}\n", CounterName(static_cast<Counter>(i)), counters[i]);
+	for (size_t i = 0; i < registry.gauges_.size(); ++i)
+		text += format("{} {}\n", GaugeName(static_cast<Gauge>(i)), registry.gauges_[i].load(memory_order_relaxed));
+
+	for (size_t h = 0; h < histograms.size(); ++h) {
+		const char* name = HistogramName(static_cast<Histogram>(h));
+		const auto& buckets = histograms[h];
+		const uint64_t count = accumulate(buckets.begin(), buckets.end(), uint64_t{ 0 });
+
+		for (double quantile : { 0.5, 0.9, 0.99, 0.999 }) {
+			uint64_t rank = max<uint64_t>(1, static_cast<uint64_t>(ceil(quantile * static_cast<double>(count))));
+			uint64_t seen = 0;
+			uint64_t value = 0;
+			for (size_t b = 0; b < Buckets && count != 0; ++b) {
+				seen += buckets[b];
+				if (seen >= rank) {
+					value = BucketLowerBound(b);
+					break;
+				}
+			}
+			text += format("{}{{quantile=\"{}\"}} {}\n", name, quantile, value);
+		}
+
+		uint64_t maximum = 0;
+		for (size_t b = Buckets; b-- > 0;) {
+			if (buckets[b] != 0) {
+				maximum = BucketLowerBound(b);
+				break;
+			}
+		}
+		text += format("{}_max {}\n", name, maximum);
+		text += format("{}_count {}\n", name, count);
+	}
+	return text;
+}
@@ -0,0 +1,57 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "common_includes.h"
+#include <atomic>
+
+// monotonic event counts, QueuedMessages is the one exception that also goes down
+enum class Counter {
+	OrdersReceived,
+	Trades,
+	MessagesSent,
+	FramesSent,
+	BytesSent,
+	SlowConsumerDrops,
+	QueuedMessages,
+	ExportedRows,
+	ExportDroppedRows,
+	Count
+};
+
+// distributions, latencies in nanoseconds and queue depths in messages
+enum class Histogram {
+	MatchLatency,
+	SessionQueueDepth,	// one sample per frame a session writes, the messages queued when it starts
+	Count
+};
+
+// last value written by the single owner of the quantity, or the sum of the adjustments of several owners
+enum class Gauge {
+	BookOrders,
+	BookLevels,
+	Sessions,
+	Count
+};
+
+// hot-path instrumentation: every thread records into its own shard with plain relaxed stores,
+// so an event costs a thread-local lookup and an uncontended add
+// shards are only summed when the admin endpoint renders them
+class Metrics {
+public:
+	static constexpr std::size_t SubBuckets = 16;
+	static constexpr std::size_t Buckets = 64 * SubBuckets;
+
+	static void Add(Counter counter, std::int64_t value = 1);
+	static void Record(Histogram histogram, std::uint64_t value);
+	static void Set(Gauge gauge, std::int64_t value);
+	static void Adjust(Gauge gauge, std::int64_t delta);
+
+	// log-linear bucketing, exact below SubBuckets and within 1/SubBuckets above
+	static std::size_t BucketOf(std::uint64_t value);
+	static std::uint64_t BucketLowerBound(std::size_t bucket);
+
+	// text exposition of all counters, gauges and histogram quantiles
+	static std::string Render();
+};
+
+#endif
@@ -0,0 +1,110 @@
+// metrics benchmark: the per-request cost of the match latency histogram, before and after it moved to EventClock
+
+#include "common_includes.h"
+#include "MetricsBenchmark.h"
+#include "OrderBook.h"
+#include "Metrics.h"
+#include "EventClock.h"
+#include <random>
+
+using namespace std;
+
+// keeps the clock reads being timed from being optimised away
+static volatile uint64_t clockSink = 0;
+
+struct MetricsStep {
+	bool cancel_;
+	OrderType orderType_;
+	Side side_;
+	Price price_;
+	Quantity quantity_;
+	OrderId orderId_;
+};
+
+// mostly resting orders near the mid, some crossing fill-and-kills and cancels of recent orders
+static vector<MetricsStep> GenerateSteps(size_t orders) {
+	mt19937_64 random(35);
+	uniform_int_distribution<int> percent(0, 99);
+	uniform_int_distribution<Quantity> quantities(1, 500);
+	uniform_int_distribution<Price> offsets(0, 20);
+
+	vector<MetricsStep> steps;
+	steps.reserve(orders);
+	for (size_t i = 0; i < orders; ++i) {
+		const int roll = percent(random);
+		const bool buy = percent(random) < 50;
+		if (roll < 20 && i != 0) {
+			steps.push_back({ true, OrderType::GoodTillCancel, Side::Buy, 0, 0, i - random() % min<size_t>(i, 256) });
+			continue;
+		}
+		const bool crossing = roll < 30;
+		const Price price = 10000 + (buy ? -1 : 1) * (crossing ? -offsets(random) : offsets(random) + 1);
+		steps.push_back({ false, crossing ? OrderType::FillAndKill : OrderType::GoodTillCancel, buy ? Side::Buy : Side::Sell, price, quantities(random), i + 1 });
+	}
+	return steps;
+}
+
+static size_t Apply(OrderBook& book, const MetricsStep& step) {
+	if (step.cancel_) {
+		book.CancelOrder(step.orderId_);
+		return 0;
+	}
+	return book.AddOrder(make_shared<Order>(step.orderType_, step.orderId_, step.side_, step.price_, step.quantity_)).size();
+}
+
+// times the whole stream on a fresh book, instrument wraps each step
+template <typename Instrument>
+static double NanosecondsPerOrder(const vector<MetricsStep>& steps, size_t& trades, Instrument instrument) {
+	OrderBook book;
+	trades = 0;
+	const auto start = chrono::steady_clock::now();
+	for (const auto& step : steps)
+		trades += instrument([&] { return Apply(book, step); });
+	return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / static_cast<double>(steps.size());
+}
+
+template <typename Call>
+static double NanosecondsPerCall(size_t calls, Call call) {
+	const auto start = chrono::steady_clock::now();
+	for (size_t i = 0; i < calls; ++i)
+		call(i);
+	return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / static_cast<double>(calls);
+}
+
+int MetricsBenchmark::Run(size_t orders) {
+	EventClock::Calibrate();
+	const vector<MetricsStep> steps = GenerateSteps(orders);
+
+	size_t bareTrades = 0, steadyTrades = 0, eventClockTrades = 0;
+	const double bare = NanosecondsPerOrder(steps, bareTrades, [](auto apply) { return apply(); });
+	const double steady = NanosecondsPerOrder(steps, steadyTrades, [](auto apply) {
+		const auto start = chrono::steady_clock::now();
+		const size_t trades = apply();
+		Metrics::Record(Histogram::MatchLatency, static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count()));
+		return trades;
+	});
+	uint64_t last = EventClock::Now();
+	const double eventClock = NanosecondsPerOrder(steps, eventClockTrades, [&last](auto apply) {
+		const size_t trades = apply();
+		const uint64_t now = EventClock::Now();
+		Metrics::Record(Histogram::MatchLatency, now > last ? now - last : 0);
+		last = now;
+		return trades;
+	});
+
+	const size_t calls = 10'000'000;
+	uint64_t sink = 0;
+	const double steadyRead = NanosecondsPerCall(calls, [&sink](size_t) { sink += static_cast<uint64_t>(chrono::steady_clock::now().time_since_epoch().count()); });
+	const double eventClockRead = NanosecondsPerCall(calls, [&sink](size_t) { sink += EventClock::Now(); });
+	const double record = NanosecondsPerCall(calls, [](size_t i) { Metrics::Record(Histogram::SessionQueueDepth, i & 1023); });
+	const double add = NanosecondsPerCall(calls, [](size_t) { Metrics::Add(Counter::MessagesSent); });
+	clockSink = sink;
+
+	cout << format("{} orders, {} trades, event clock {}\n", steps.size(), bareTrades, EventClock::UsesTsc() ? "on the TSC" : "on steady_clock");
+	cout << format("no instrumentation:              {:7.1f} ns/order\n", bare);
+	cout << format("two steady_clock reads + record: {:7.1f} ns/order, +{:.1f} ns\n", steady, steady - bare);
+	cout << format("one EventClock read + record:    {:7.1f} ns/order, +{:.1f} ns\n", eventClock, eventClock - bare);
+	cout << format("steady_clock::now {:.1f} ns, EventClock::Now {:.1f} ns, Metrics::Record {:.1f} ns, Metrics::Add {:.1f} ns\n",
+		steadyRead, eventClockRead, record, add);
+	return bareTrades == steadyTrades && bareTrades == eventClockTrades ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,16 @@
+#ifndef METRICS_BENCHMARK_H
+#define METRICS_BENCHMARK_H
+
+#include "common_includes.h"
+
+// measures what the runtime metrics add to the matching thread
+// one deterministic stream of orders is applied to a fresh book three ways: with no instrumentation,
+// timed per request with two steady_clock reads as OrderInbox::Drain first did, and timed the way it does now,
+// one EventClock read per request; the single recording calls are timed on their own as well
+class MetricsBenchmark {
+public:
+	// returns a process exit code
+	static int Run(std::size_t orders);
+};
+
+#endif
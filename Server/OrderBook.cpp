@@ -1,242 +1,595 @@
-
-#include "common_includes.h"
-#include "OrderBook.h"
-
-using namespace std;
-
-OrderBookLevelInfos::OrderBookLevelInfos(const LevelInfos& bids, const LevelInfos& asks)
-	: bids_{ bids }
-	, asks_{ asks }
-{}
-const LevelInfos& OrderBookLevelInfos::GetBids() const { return bids_; }
-const LevelInfos& OrderBookLevelInfos::GetAsks() const { return asks_; }
-
-Order::Order(OrderType orderType, OrderId orderId, Side side, Price price, Quantity quantity)
-	: orderType_{ orderType }
-	, orderId_{ orderId }
-	, side_{ side }
-	, price_{ price }
-	, initialQuantity_{ quantity }
-	, remainingQuantity_{ quantity }
-{ }
-OrderId Order::GetOrderId() const { return orderId_; }
-Side Order::GetSide() const { return side_; }
-Price Order::GetPrice() const { return price_; }
-OrderType Order::GetOrderType() const { return orderType_; }
-Quantity Order::GetInitialQuantity() const { return initialQuantity_; }
-Quantity Order::GetRemainingQuantity() const { return remainingQuantity_; }
-Quantity Order::GetFilledQuantity() const { return GetInitialQuantity() - GetRemainingQuantity(); }
-bool Order::IsFilled() const { return GetRemainingQuantity() == 0; }
-
-void Order::Fill(Quantity quantity) {
-	if (quantity > GetRemainingQuantity()) {
-		throw std::logic_error(std::format("Order ({}) cannot be filled for more than its remaining quantity.", GetOrderId()));
-	}
-	remainingQuantity_ -= quantity;
-}
-
-OrderModify::OrderModify(OrderId orderId, Side side, Price price, Quantity quantity)
-	: orderId_{ orderId }
-	, side_{ side }
-	, price_{ price }
-	, quantity_{ quantity }
-{ }
-OrderId OrderModify::GetOrderId() const { return orderId_; }
-Side OrderModify::GetSide() const { return side_; }
-Price OrderModify::GetPrice() const { return price_; }
-Quantity OrderModify::GetQuantity() const { return quantity_; }
-
-OrderPointer OrderModify::ToOrderPointer(OrderType type) const {
-	return std::make_shared<Order>(type, OrderModify::GetOrderId(), OrderModify::GetSide(), OrderModify::GetPrice(), OrderModify::GetQuantity());
-}
-
-Trade::Trade(const TradeInfo& bidTrade, const TradeInfo& askTrade)
-	: bidTrade_{ bidTrade }
-	, askTrade_{ askTrade }
-{ }
-const TradeInfo& Trade::GetBidTrade() const { return bidTrade_; }
-const TradeInfo& Trade::GetAskTrade() const { return askTrade_; }
-
-using Trades = std::vector<Trade>;
-using OrderPointer = std::shared_ptr<Order>;
-using OrderPointers = std::list<OrderPointer>;
-
-bool OrderBook::CanMatch(Side side, Price price) const {
-	if (side == Side::Buy) {
-		if (asks_.empty()) 
-			return false;
-			
-		const auto& [bestAsk, _] = *asks_.begin();
-		return price >= bestAsk;
-	}
-	else {
-		if (bids_.empty())
-			return false;
-
-		const auto& [bestBid, _] = *bids_.begin();
-		return price <= bestBid;
-	}
-}
-Trades OrderBook::MatchOrders() {
-	Trades trades;
-	trades.reserve(orders_.size());
-
-	while (true) {
-		if (bids_.empty() || asks_.empty())
-			break;
-
-		auto& [bidPrice, bids] = *bids_.begin();
-		auto& [askPrice, asks] = *asks_.begin();
-
-		if (bidPrice < askPrice)
-			break;
-
-		while (bids.size() && asks.size()) {
-			auto& bid = bids.front();
-			auto& ask = asks.front();
-
-			Quantity quantity = std::min(bid->GetRemainingQuantity(), ask->GetRemainingQuantity());
-
-			bid->Fill(quantity);
-			ask->Fill(quantity);
-
-			if (bid->IsFilled())
-			{
-				bids.pop_front();
-				orders_.erase(bid->GetOrderId());
-			}
-
-			if (ask->IsFilled())
-			{
-				asks.pop_front();
-				orders_.erase(ask->GetOrderId());
-			}
-
-			if (bids.empty())
-				bids_.erase(bidPrice);
-
-			if (asks.empty())
-				asks_.erase(askPrice);
-
-			trades.push_back(Trade{ 
-				TradeInfo{ bid->GetOrderId(), bid->GetPrice(), quantity },
-				TradeInfo{ ask->GetOrderId(), ask->GetPrice(), quantity }
-				});
-		}
-	}
-	if (!bids_.empty()) {
-
-		auto& [_, bids] = *bids_.begin();
-		auto& order = bids.front();
-
-		if (order->GetOrderType() == OrderType::FillAndKill)
-			CancelOrder(order->GetOrderId());
-	}
-	if (!asks_.empty()) {
-
-		auto& [_, asks] = *asks_.begin();
-		auto& order = asks.front();
-
-		if (order->GetOrderType() == OrderType::FillAndKill)
-			CancelOrder(order->GetOrderId());
-	}
-	return trades;
-}
-
-Trades OrderBook::AddOrder(OrderPointer order) {
-	if (orders_.contains(order->GetOrderId()))
-		return {};
-
-	if (order->GetOrderType() == OrderType::FillAndKill && !CanMatch(order->GetSide(), order->GetPrice()))
-		return {};
-
-	OrderPointers::iterator iterator;
-
-	if (order->GetSide() == Side::Buy) {
-		auto& orders = bids_[order->GetPrice()];
-		orders.push_back(order);
-		iterator = std::next(orders.begin(), orders.size() - 1);
-	}
-	else {
-		auto& orders = asks_[order->GetPrice()];
-		orders.push_back(order);
-		iterator = std::next(orders.begin(), orders.size() - 1);
-	}
-
-	orders_.insert({ order->GetOrderId(), OrderEntry{ order, iterator} });
-
-	return MatchOrders();
-}
-void OrderBook::CancelOrder(OrderId orderId) {
-	if (!orders_.contains(orderId))
-		return;
-
-	const auto& [order, orderIterator] = orders_.at(orderId);
-	orders_.erase(orderId);
-
-	if (order->GetSide() == Side::Sell) {
-		auto price = order->GetPrice();
-		auto& orders = asks_.at(price);
-		orders.erase(orderIterator);
-		if (orders.empty())
-			asks_.erase(price);
-	}
-	else {
-		auto price = order->GetPrice();
-		auto& orders = bids_.at(price);
-		orders.erase(orderIterator);
-		if (orders.empty())
-			bids_.erase(price);
-	}
-}
-Trades OrderBook::MatchOrder(OrderModify order) {
-	if (!orders_.contains(order.GetOrderId()))
-		return {};
-		
-	const auto& [existingOrder, _] = orders_.at(order.GetOrderId());
-	CancelOrder(order.GetOrderId());
-	return AddOrder(order.ToOrderPointer(existingOrder->GetOrderType()));
-}
-std::size_t OrderBook::Size() const { return orders_.size(); }
-
-OrderBookLevelInfos OrderBook::GetOrderInfos() const {
-	LevelInfos bidInfos, askInfos;
-	bidInfos.reserve(orders_.size());
-	askInfos.reserve(orders_.size());
-
-	auto CreateLevelInfos = [](Price price, const OrderPointers& orders) {
-		return LevelInfo{ price, std::accumulate(orders.begin(), orders.end(), (Quantity)0,
-			[](Quantity runningSum, const OrderPointer& order)
-			{return runningSum + order->GetRemainingQuantity(); }) };
-		};
-
-	for (const auto& [price, orders] : bids_) {
-		bidInfos.push_back(CreateLevelInfos(price, orders));
-	}
-	for (const auto& [price, orders] : asks_) {
-		askInfos.push_back(CreateLevelInfos(price, orders));
-	}
-
-	return OrderBookLevelInfos{ bidInfos, askInfos};
-}
-
-Trades OrderBook::GenerateRandomOrder() {
-
-	srand(static_cast<unsigned int>(time(0)));
-	size_t randomType = rand() % 2;
-	OrderType orderType = (randomType == 0) ? OrderType::FillAndKill : OrderType::GoodTillCancel;
-	
-	uint64_t orderId = rand() % 1001;
-	
-	size_t randomSide = rand() % 2;
-	Side orderSide = (randomSide == 0) ? Side::Buy : Side::Sell;
-	
-	int32_t orderPrice = (rand() % 10) + 1;
-
-	uint32_t orderQuantity = (rand() % 100) + 1;
-	
-	shared_ptr<Order> randomOrder = make_shared<Order>(orderType, orderId, orderSide, orderPrice, orderQuantity);
-
-	return AddOrder(randomOrder);
-}
-
+
+#include "common_includes.h"
+#include "OrderBook.h"
+#include "SimdKernels.h"
+#include "EventClock.h"
+
+using namespace std;
+
+OrderBookLevelInfos::OrderBookLevelInfos(const LevelInfos& bids, const LevelInfos& asks)
+	: bids_{ bids }
+	, asks_{ asks }
+{}
+const LevelInfos& OrderBookLevelInfos::GetBids() const { return bids_; }
+const LevelInfos& OrderBookLevelInfos::GetAsks() const { return asks_; }
+
+Order::Order(OrderType orderType, OrderId orderId, Side side, Price price, Quantity quantity, ParticipantId owner, SelfTradePrevention selfTradePrevention)
+	: orderType_{ orderType }
+	, orderId_{ orderId }
+	, side_{ side }
+	, price_{ price }
+	, initialQuantity_{ quantity }
+	, remainingQuantity_{ quantity }
+	, owner_{ owner }
+	, selfTradePrevention_{ selfTradePrevention }
+{ }
+Order::Order(OrderId orderId, Side side, Quantity quantity, ParticipantId owner, SelfTradePrevention selfTradePrevention)
+	: Order(OrderType::Market, orderId, side, 0, quantity, owner, selfTradePrevention)
+{ }
+OrderId Order::GetOrderId() const { return orderId_; }
+Side Order::GetSide() const { return side_; }
+Price Order::GetPrice() const { return price_; }
+OrderType Order::GetOrderType() const { return orderType_; }
+Quantity Order::GetInitialQuantity() const { return initialQuantity_; }
+Quantity Order::GetRemainingQuantity() const { return remainingQuantity_; }
+Quantity Order::GetFilledQuantity() const { return GetInitialQuantity() - GetRemainingQuantity(); }
+ParticipantId Order::GetOwner() const { return owner_; }
+SelfTradePrevention Order::GetSelfTradePrevention() const { return selfTradePrevention_; }
+bool Order::IsFilled() const { return GetRemainingQuantity() == 0; }
+
+void Order::Fill(Quantity quantity) {
+	if (quantity > GetRemainingQuantity()) {
+		throw std::logic_error(std::format("Order ({}) cannot be filled for more than its remaining quantity.", GetOrderId()));
+	}
+	remainingQuantity_ -= quantity;
+}
+
+OrderModify::OrderModify(OrderId orderId, Side side, Price price, Quantity quantity)
+	: orderId_{ orderId }
+	, side_{ side }
+	, price_{ price }
+	, quantity_{ quantity }
+{ }
+OrderId OrderModify::GetOrderId() const { return orderId_; }
+Side OrderModify::GetSide() const { return side_; }
+Price OrderModify::GetPrice() const { return price_; }
+Quantity OrderModify::GetQuantity() const { return quantity_; }
+
+OrderPointer OrderModify::ToOrderPointer(OrderType type, ParticipantId owner, SelfTradePrevention selfTradePrevention) const {
+	return std::make_shared<Order>(type, OrderModify::GetOrderId(), OrderModify::GetSide(), OrderModify::GetPrice(), OrderModify::GetQuantity(), owner, selfTradePrevention);
+}
+
+Trade::Trade(const TradeInfo& bidTrade, const TradeInfo& askTrade, Price price, std::uint64_t sequence, std::uint64_t timestamp)
+	: bidTrade_{ bidTrade }
+	, askTrade_{ askTrade }
+	, price_{ price }
+	, sequence_{ sequence }
+	, timestamp_{ timestamp }
+{ }
+const TradeInfo& Trade::GetBidTrade() const { return bidTrade_; }
+const TradeInfo& Trade::GetAskTrade() const { return askTrade_; }
+Price Trade::GetPrice() const { return price_; }
+std::uint64_t Trade::GetSequence() const { return sequence_; }
+std::uint64_t Trade::GetTimestamp() const { return timestamp_; }
+
+bool LevelQueue::Empty() const { return live_ == 0; }
+OrderId LevelQueue::FrontOrderId() const { return orderIds_[head_]; }
+Quantity LevelQueue::FrontRemainingQuantity() const { return remainingQuantities_[head_]; }
+ParticipantId LevelQueue::FrontOwner() const { return owners_[head_]; }
+
+// moves head_ past filled and cancelled slots, reclaiming the dead prefix once it dominates the queue
+void LevelQueue::Advance() {
+	while (head_ < remainingQuantities_.size() && remainingQuantities_[head_] == 0)
+		++head_;
+
+	if (head_ == remainingQuantities_.size()) {
+		base_ += head_;
+		head_ = 0;
+		orderIds_.clear();
+		remainingQuantities_.clear();
+		owners_.clear();
+	}
+	else if (head_ >= 64 && head_ * 2 >= remainingQuantities_.size()) {
+		base_ += head_;
+		orderIds_.erase(orderIds_.begin(), orderIds_.begin() + head_);
+		remainingQuantities_.erase(remainingQuantities_.begin(), remainingQuantities_.begin() + head_);
+		owners_.erase(owners_.begin(), owners_.begin() + head_);
+		head_ = 0;
+	}
+}
+std::uint64_t LevelQueue::Push(OrderId orderId, Quantity quantity, ParticipantId owner) {
+	orderIds_.push_back(orderId);
+	remainingQuantities_.push_back(quantity);
+	owners_.push_back(owner);
+	++live_;
+	return base_ + orderIds_.size() - 1;
+}
+Quantity LevelQueue::Remove(std::uint64_t slot) {
+	std::size_t index = static_cast<std::size_t>(slot - base_);
+	Quantity quantity = remainingQuantities_[index];
+
+	remainingQuantities_[index] = 0;
+	--live_;
+	if (index == head_) {
+		Advance();
+	}
+	else if (index + 1 == remainingQuantities_.size()) {
+		// the newest orders are cancelled most, their slots can go without renumbering anything
+		while (remainingQuantities_.back() == 0) {
+			orderIds_.pop_back();
+			remainingQuantities_.pop_back();
+			owners_.pop_back();
+		}
+	}
+	return quantity;
+}
+// shrinks a resting order without touching its position, nullopt when quantity would grow it
+std::optional<Quantity> LevelQueue::ReduceTo(std::uint64_t slot, Quantity quantity) {
+	Quantity& remaining = remainingQuantities_[static_cast<std::size_t>(slot - base_)];
+	if (quantity > remaining)
+		return std::nullopt;
+
+	Quantity reducedBy = remaining - quantity;
+	remaining = quantity;
+	return reducedBy;
+}
+bool LevelQueue::FillFront(Quantity quantity) {
+	Quantity& remaining = remainingQuantities_[head_];
+	if (quantity > remaining) {
+		throw std::logic_error(std::format("Order ({}) cannot be filled for more than its remaining quantity.", orderIds_[head_]));
+	}
+	remaining -= quantity;
+	if (remaining != 0)
+		return false;
+
+	--live_;
+	Advance();
+	return true;
+}
+bool LevelQueue::HoldsOwner(ParticipantId owner) const {
+	for (std::size_t index = head_; index < owners_.size(); ++index)
+		if (owners_[index] == owner && remainingQuantities_[index] != 0)
+			return true;
+	return false;
+}
+std::size_t LevelQueue::Slots() const { return orderIds_.size() - head_; }
+bool LevelQueue::Sparse() const { return Slots() > 2 * live_; }
+// packs the live orders to the front in time priority, numbering them past every slot handed out so far
+void LevelQueue::Compact() {
+	std::size_t kept = 0;
+	for (std::size_t index = head_; index < orderIds_.size(); ++index) {
+		if (remainingQuantities_[index] == 0)
+			continue;
+		orderIds_[kept] = orderIds_[index];
+		remainingQuantities_[kept] = remainingQuantities_[index];
+		owners_[kept] = owners_[index];
+		++kept;
+	}
+	base_ += orderIds_.size();
+	head_ = 0;
+	orderIds_.resize(kept);
+	remainingQuantities_.resize(kept);
+	owners_.resize(kept);
+}
+
+// bids run ascending and asks descending, so the best price of either side is always at the back
+template <Side S>
+std::size_t BookSide<S>::FindLevel(Price price) const {
+	return std::lower_bound(prices_.begin(), prices_.end(), price, SideTraits<S>::IsWorse) - prices_.begin();
+}
+template <Side S>
+void BookSide<S>::EraseLevel(std::size_t level) {
+	prices_.erase(prices_.begin() + level);
+	quantities_.erase(quantities_.begin() + level);
+	queues_.erase(queues_.begin() + level);
+}
+
+template <Side S>
+bool BookSide<S>::Empty() const { return prices_.empty(); }
+template <Side S>
+std::size_t BookSide<S>::LevelCount() const { return prices_.size(); }
+template <Side S>
+Quantity BookSide<S>::LevelQuantity(Price price) const {
+	std::size_t level = FindLevel(price);
+	return level != prices_.size() && prices_[level] == price ? quantities_[level] : 0;
+}
+template <Side S>
+Price BookSide<S>::BestPrice() const { return prices_.back(); }
+template <Side S>
+LevelQueue& BookSide<S>::BestQueue() { return queues_.back(); }
+
+// whether an opposite-side order limited at price would trade against this side
+template <Side S>
+bool BookSide<S>::Crosses(Price price) const {
+	return !Empty() && SideTraits<S>::IsReachable(BestPrice(), price);
+}
+template <Side S>
+std::size_t BookSide<S>::CountCrossingLevels(Price price) const {
+	if constexpr (S == Side::Buy)
+		return CountTrailingAtLeast(prices_.data(), prices_.size(), price);
+	else
+		return CountTrailingAtMost(prices_.data(), prices_.size(), price);
+}
+
+// fill-or-kill check against the level aggregates, the book itself is left untouched
+template <Side S>
+bool BookSide<S>::CanFill(Price price, Quantity quantity) const {
+	if (Empty())
+		return false;
+	if (SideTraits<S>::IsReachable(BestPrice(), price) && quantities_.back() >= quantity)
+		return true;
+
+	const std::size_t levels = CountCrossingLevels(price);
+	return SumQuantities(quantities_.data() + quantities_.size() - levels, levels) >= quantity;
+}
+
+// whether any live order of owner rests at a level an opposite order limited at price would reach
+template <Side S>
+bool BookSide<S>::HoldsOwner(Price price, ParticipantId owner) const {
+	const std::size_t levels = CountCrossingLevels(price);
+	for (std::size_t level = queues_.size() - levels; level < queues_.size(); ++level)
+		if (queues_[level].HoldsOwner(owner))
+			return true;
+	return false;
+}
+
+template <Side S>
+std::uint64_t BookSide<S>::Push(OrderId orderId, Price price, Quantity quantity, ParticipantId owner) {
+	std::size_t level = FindLevel(price);
+
+	if (level == prices_.size() || prices_[level] != price) {
+		prices_.insert(prices_.begin() + level, price);
+		quantities_.insert(quantities_.begin() + level, 0);
+		queues_.insert(queues_.begin() + level, LevelQueue{});
+	}
+
+	quantities_[level] += quantity;
+	return queues_[level].Push(orderId, quantity, owner);
+}
+template <Side S>
+LevelQueue* BookSide<S>::Erase(Price price, std::uint64_t slot) {
+	std::size_t level = FindLevel(price);
+
+	LevelQueue& queue = queues_[level];
+	quantities_[level] -= queue.Remove(slot);
+	if (queue.Empty()) {
+		EraseLevel(level);
+		return nullptr;
+	}
+	if (!queue.Sparse())
+		return nullptr;
+	queue.Compact();
+	return &queue;
+}
+template <Side S>
+std::optional<Quantity> BookSide<S>::ReduceTo(Price price, std::uint64_t slot, Quantity quantity) {
+	std::size_t level = FindLevel(price);
+
+	std::optional<Quantity> reducedBy = queues_[level].ReduceTo(slot, quantity);
+	if (reducedBy)
+		quantities_[level] -= *reducedBy;
+	return reducedBy;
+}
+template <Side S>
+void BookSide<S>::FillBest(Quantity quantity) {
+	quantities_.back() -= quantity;
+}
+template <Side S>
+void BookSide<S>::PopBest() {
+	prices_.pop_back();
+	quantities_.pop_back();
+	queues_.pop_back();
+}
+template <Side S>
+void BookSide<S>::AppendLevelInfos(LevelInfos& levelInfos, std::size_t depth) const {
+	const std::size_t count = std::min(depth, prices_.size());
+	const std::size_t offset = levelInfos.size();
+
+	levelInfos.resize(offset + count);
+	PackLevelInfosReversed(prices_.data() + prices_.size() - count, quantities_.data() + quantities_.size() - count, count, levelInfos.data() + offset);
+}
+
+template class BookSide<Side::Buy>;
+template class BookSide<Side::Sell>;
+
+template <Side S>
+BookSide<S>& OrderBook::Levels() {
+	if constexpr (S == Side::Buy)
+		return bids_;
+	else
+		return asks_;
+}
+
+template <Side S>
+void OrderBook::RecordLevel(Price price) {
+	levelUpdates_.push_back(LevelUpdate{ S, price, Levels<S>().LevelQuantity(price), ++levelSequence_, eventTime_ });
+}
+
+// walks the opposite side from its best level while it crosses price, returns what is left of order to rest
+// a market aggressor has no price of its own and reports each fill at the resting level's price
+// resting owners sit next to the quantities in the level queue, so self-trade prevention costs no lookup per fill
+template <Side S, bool AtRestingPrice>
+Quantity OrderBook::MatchAgainst(const Order& order, Price price, Trades& trades) {
+	auto& opposite = Levels<SideTraits<S>::Opposite>();
+
+	const OrderId orderId = order.GetOrderId();
+	const ParticipantId owner = order.GetOwner();
+	const SelfTradePrevention prevention = owner != 0 ? order.GetSelfTradePrevention() : SelfTradePrevention::None;
+	Quantity quantity = order.GetRemainingQuantity();
+	Quantity decremented = 0;	// taken off the aggressor by DecrementBoth
+
+	while (quantity != 0 && opposite.Crosses(price)) {
+		const Price levelPrice = opposite.BestPrice();
+		LevelQueue& resting = opposite.BestQueue();
+		bool levelChanged = false;
+
+		while (quantity != 0 && !resting.Empty()) {
+			const OrderId restingId = resting.FrontOrderId();
+			const ParticipantId restingOwner = resting.FrontOwner();
+			const Quantity fill = std::min(quantity, resting.FrontRemainingQuantity());
+
+			if (prevention != SelfTradePrevention::None && restingOwner == owner) {
+				if (prevention == SelfTradePrevention::CancelAggressor) {
+					preventedFills_.push_back(PreventedFill{ orderId, owner, quantity, true });
+					quantity = 0;
+					break;
+				}
+
+				// cancel resting takes all of the resting order, decrement both what the two have in common
+				const Quantity removed = prevention == SelfTradePrevention::CancelResting ? resting.FrontRemainingQuantity() : fill;
+				opposite.FillBest(removed);
+				const bool gone = resting.FillFront(removed);
+				if (gone)
+					orders_.Erase(restingId);
+				preventedFills_.push_back(PreventedFill{ restingId, owner, removed, gone });
+				if (prevention == SelfTradePrevention::DecrementBoth) {
+					quantity -= removed;
+					decremented += removed;
+				}
+				levelChanged = true;
+				continue;
+			}
+
+			const Price aggressorPrice = AtRestingPrice ? levelPrice : price;
+
+			quantity -= fill;
+			opposite.FillBest(fill);
+			if (resting.FillFront(fill))
+				orders_.Erase(restingId);
+			levelChanged = true;
+
+			if constexpr (S == Side::Buy) {
+				trades.push_back(Trade{
+					TradeInfo{ orderId, aggressorPrice, fill, owner },
+					TradeInfo{ restingId, levelPrice, fill, restingOwner },
+					levelPrice, ++tradeSequence_, eventTime_
+					});
+			}
+			else {
+				trades.push_back(Trade{
+					TradeInfo{ restingId, levelPrice, fill, restingOwner },
+					TradeInfo{ orderId, aggressorPrice, fill, owner },
+					levelPrice, ++tradeSequence_, eventTime_
+					});
+			}
+		}
+
+		if (resting.Empty())
+			opposite.PopBest();
+		if (levelChanged)
+			RecordLevel<SideTraits<S>::Opposite>(levelPrice);
+	}
+
+	if (decremented != 0)
+		preventedFills_.push_back(PreventedFill{ orderId, owner, decremented, quantity == 0 });
+	return quantity;
+}
+
+template <Side S, OrderType T>
+Trades OrderBook::AddOrderAs(const Order& order) {
+	using Policy = OrderTypePolicy<T>;
+	auto& opposite = Levels<SideTraits<S>::Opposite>();
+
+	const Price limit = Policy::IgnoresPrice ? SideTraits<S>::MarketLimit : order.GetPrice();
+
+	if constexpr (Policy::RequiresCross) {
+		if (!opposite.Crosses(limit))
+			return {};
+	}
+	if constexpr (Policy::RequiresFullFill) {
+		if (!opposite.CanFill(limit, order.GetRemainingQuantity()))
+			return {};
+		// self-trade prevention could leave it partly filled, so an order that might meet its own owner is killed up front
+		if (order.GetOwner() != 0 && order.GetSelfTradePrevention() != SelfTradePrevention::None && opposite.HoldsOwner(limit, order.GetOwner()))
+			return {};
+	}
+
+	// at least one trade per crossed level, rather than sizing for the whole book
+	Trades trades;
+	trades.reserve(opposite.CountCrossingLevels(limit));
+
+	Quantity remaining = MatchAgainst<S, Policy::IgnoresPrice>(order, limit, trades);
+	++version_;
+
+	// whatever a fill-and-kill, fill-or-kill or market order did not take off the book does not rest
+	if constexpr (Policy::RestsRemainder) {
+		if (remaining != 0) {
+			std::uint64_t slot = Levels<S>().Push(order.GetOrderId(), order.GetPrice(), remaining, order.GetOwner());
+			orders_.Insert(order.GetOrderId(), OrderEntry{ T, S, order.GetPrice(), order.GetInitialQuantity(), slot, order.GetOwner(), order.GetSelfTradePrevention() });
+			RecordLevel<S>(order.GetPrice());
+
+			if constexpr (Policy::ExpiresAtClose)
+				goodForDayOrders_.push_back(order.GetOrderId());
+		}
+	}
+	return trades;
+}
+
+template <Side S>
+Trades OrderBook::AddOrderTo(const Order& order) {
+	switch (order.GetOrderType()) {
+	case OrderType::GoodTillCancel:
+		return AddOrderAs<S, OrderType::GoodTillCancel>(order);
+	case OrderType::FillAndKill:
+		return AddOrderAs<S, OrderType::FillAndKill>(order);
+	case OrderType::FillOrKill:
+		return AddOrderAs<S, OrderType::FillOrKill>(order);
+	case OrderType::Market:
+		return AddOrderAs<S, OrderType::Market>(order);
+	case OrderType::GoodForDay:
+		return AddOrderAs<S, OrderType::GoodForDay>(order);
+	default:
+		throw std::logic_error(std::format("Order ({}) has an unsupported order type.", order.GetOrderId()));
+	}
+}
+
+Trades OrderBook::AddOrder(OrderPointer order) {
+	if (orders_.Contains(order->GetOrderId()))
+		return {};
+
+	eventTime_ = Now();
+
+	if (order->GetSide() == Side::Buy)
+		return AddOrderTo<Side::Buy>(*order);
+	else
+		return AddOrderTo<Side::Sell>(*order);
+}
+void OrderBook::CancelOrder(OrderId orderId) {
+	std::optional<OrderEntry> order = orders_.Take(orderId);
+	if (!order)
+		return;
+
+	eventTime_ = Now();
+	++version_;
+
+	LevelQueue* compacted;
+	if (order->side_ == Side::Sell) {
+		compacted = asks_.Erase(order->price_, order->slot_);
+		RecordLevel<Side::Sell>(order->price_);
+	}
+	else {
+		compacted = bids_.Erase(order->price_, order->slot_);
+		RecordLevel<Side::Buy>(order->price_);
+	}
+	if (compacted)
+		compacted->ForEachLive([this](OrderId orderId, std::uint64_t slot) { orders_.Find(orderId)->slot_ = slot; });
+}
+Trades OrderBook::MatchOrder(OrderModify order) {
+	OrderEntry* entry = orders_.Find(order.GetOrderId());
+	if (!entry)
+		return {};
+
+	OrderEntry& existing = *entry;
+
+	// a size reduction at the same price is amended where the order rests and keeps its queue priority
+	// only price changes and size increases go through cancel/replace
+	if (order.GetSide() == existing.side_ && order.GetPrice() == existing.price_ && order.GetQuantity() != 0) {
+		std::optional<Quantity> reducedBy = existing.side_ == Side::Buy
+			? bids_.ReduceTo(existing.price_, existing.slot_, order.GetQuantity())
+			: asks_.ReduceTo(existing.price_, existing.slot_, order.GetQuantity());
+
+		if (reducedBy) {
+			if (*reducedBy != 0) {
+				existing.initialQuantity_ -= *reducedBy;
+				eventTime_ = Now();
+				++version_;
+				if (existing.side_ == Side::Buy)
+					RecordLevel<Side::Buy>(existing.price_);
+				else
+					RecordLevel<Side::Sell>(existing.price_);
+			}
+			return {};
+		}
+	}
+
+	const OrderType orderType = existing.orderType_;
+	const ParticipantId owner = existing.owner_;
+	const SelfTradePrevention selfTradePrevention = existing.selfTradePrevention_;
+	CancelOrder(order.GetOrderId());
+	return AddOrder(order.ToOrderPointer(orderType, owner, selfTradePrevention));
+}
+// a replayed book is stamped with the time of the event being replayed, so its output does not depend on when it runs
+std::uint64_t OrderBook::Now() const { return replaying_ ? replayTime_ : EventClock::Now(); }
+void OrderBook::SetReplayTime(std::uint64_t timestamp) {
+	replaying_ = true;
+	replayTime_ = timestamp;
+}
+bool OrderBook::Contains(OrderId orderId) const { return orders_.Contains(orderId); }
+std::size_t OrderBook::Size() const { return orders_.Size(); }
+std::size_t OrderBook::LevelCount() const { return bids_.LevelCount() + asks_.LevelCount(); }
+void OrderBook::Reserve(std::size_t orders) { orders_.Reserve(orders); }
+std::uint64_t OrderBook::GetVersion() const { return version_; }
+
+// hands the level changes made since the last call to the publisher, in sequence order
+// a level touched several times appears once per touch, the last entry holds its final quantity
+void OrderBook::TakeLevelUpdates(LevelUpdates& updates) {
+	updates.clear();
+	updates.swap(levelUpdates_);
+}
+const PreventedFills& OrderBook::GetPreventedFills() const { return preventedFills_; }
+void OrderBook::TakePreventedFills(PreventedFills& fills) {
+	fills.clear();
+	fills.swap(preventedFills_);
+}
+std::uint64_t OrderBook::GetUpdateSequence() const { return levelSequence_; }
+std::uint64_t OrderBook::GetTradeSequence() const { return tradeSequence_; }
+
+void OrderBook::SetSessionClose(std::chrono::system_clock::time_point sessionClose) { sessionClose_ = sessionClose; }
+std::chrono::system_clock::time_point OrderBook::GetSessionClose() const { return sessionClose_; }
+
+// cancels every good-for-day order once the session has closed and rolls the close over to the next day
+// the sweep only visits ids recorded when they rested, never the whole order map
+std::size_t OrderBook::ExpireOrders(std::chrono::system_clock::time_point now) {
+	if (now < sessionClose_)
+		return 0;
+
+	std::size_t expired = 0;
+	for (OrderId orderId : goodForDayOrders_) {
+		const OrderEntry* entry = orders_.Find(orderId);
+		if (!entry || entry->orderType_ != OrderType::GoodForDay)
+			continue;
+
+		CancelOrder(orderId);
+		++expired;
+	}
+	goodForDayOrders_.clear();
+
+	while (sessionClose_ <= now)
+		sessionClose_ += std::chrono::hours(24);
+
+	return expired;
+}
+
+OrderBookLevelInfos OrderBook::GetOrderInfos() const {
+	return GetOrderInfos(std::numeric_limits<std::size_t>::max());
+}
+OrderBookLevelInfos OrderBook::GetOrderInfos(std::size_t depth) const {
+	LevelInfos bidInfos, askInfos;
+
+	// level quantities are kept aggregated, so a snapshot is a straight copy of the top levels
+	bids_.AppendLevelInfos(bidInfos, depth);
+	asks_.AppendLevelInfos(askInfos, depth);
+
+	return OrderBookLevelInfos{ bidInfos, askInfos};
+}
+
+Trades OrderBook::GenerateRandomOrder() {
+
+	srand(static_cast<unsigned int>(time(0)));
+	size_t randomType = rand() % 2;
+	OrderType orderType = (randomType == 0) ? OrderType::FillAndKill : OrderType::GoodTillCancel;
+	
+	uint64_t orderId = rand() % 1001;
+	
+	size_t randomSide = rand() % 2;
+	Side orderSide = (randomSide == 0) ? Side::Buy : Side::Sell;
+	
+	int32_t orderPrice = (rand() % 10) + 1;
+
+	uint32_t orderQuantity = (rand() % 100) + 1;
+	
+	shared_ptr<Order> randomOrder = make_shared<Order>(orderType, orderId, orderSide, orderPrice, orderQuantity);
+
+	return AddOrder(randomOrder);
+}
+
@@ -1,121 +1,355 @@
-#ifndef ORDERBOOK_H
-#define ORDERBOOK_H
-
-#include "common_includes.h"
-
-using Price = std::int32_t;
-using Quantity = std::uint32_t;
-using OrderId = std::uint64_t;
-
-struct LevelInfo {
-	Price price_;
-	Quantity quantity_;
-};
-
-enum class OrderType {
-	GoodTillCancel,
-	FillAndKill
-};
-
-enum class Side {
-	Buy,
-	Sell
-};
-
-struct TradeInfo {
-	OrderId orderId_;
-	Price price_;
-	Quantity quantity_;
-};
-
-class Trade {
-private:
-	TradeInfo bidTrade_;
-	TradeInfo askTrade_;
-public:
-	Trade(const TradeInfo& bidTrade, const TradeInfo& askTrade);
-	const TradeInfo& GetBidTrade() const;
-	const TradeInfo& GetAskTrade() const;
-};
-
-class Order {
-private:
-	OrderType orderType_;
-	OrderId orderId_;
-	Side side_;
-	Price price_;
-	Quantity quantity_;
-	Quantity initialQuantity_;
-	Quantity remainingQuantity_;
-public:
-	Order(OrderType orderType, OrderId orderId, Side side, Price price, Quantity quantity);
-
-	OrderId GetOrderId() const;
-	Side GetSide() const;
-	Price GetPrice() const;
-	OrderType GetOrderType() const;
-	Quantity GetInitialQuantity() const;
-	Quantity GetRemainingQuantity() const;
-	Quantity GetFilledQuantity() const;
-	bool IsFilled() const;
-
-	void Fill(Quantity quantity);
-};
-
-using Trades = std::vector<Trade>;
-using OrderPointer = std::shared_ptr<Order>;
-using OrderPointers = std::list<OrderPointer>;
-using LevelInfos = std::vector<LevelInfo>;
-
-class OrderBookLevelInfos {
-private:
-	LevelInfos bids_;
-	LevelInfos asks_;
-public:
-	OrderBookLevelInfos(const LevelInfos& bids, const LevelInfos& asks);
-
-	const LevelInfos& GetBids() const;
-	const LevelInfos& GetAsks() const;
-};
-
-class OrderModify {
-private:
-	OrderType orderType_;
-	OrderId orderId_;
-	Side side_;
-	Price price_;
-	Quantity quantity_;
-public:
-	OrderModify(OrderId orderId, Side side, Price price, Quantity quantity);
-	OrderId GetOrderId() const;
-	Side GetSide() const;
-	Price GetPrice() const;
-	Quantity GetQuantity() const;
-	OrderPointer ToOrderPointer(OrderType type) const;
-};
-
-class OrderBook {
-private:
-	struct OrderEntry {
-		OrderPointer order_{ nullptr };
-		OrderPointers::iterator location_;
-
-	};
-
-	std::map<Price, OrderPointers, std::greater<Price>> bids_;
-	std::map<Price, OrderPointers, std::less<Price>> asks_;
-	std::unordered_map<OrderId, OrderEntry> orders_;
-
-	bool CanMatch(Side side, Price price) const;
-	Trades MatchOrders();
-public:
-	Trades AddOrder(OrderPointer order);
-	void CancelOrder(OrderId orderId);
-	Trades MatchOrder(OrderModify order);
-	std::size_t Size() const;
-	OrderBookLevelInfos GetOrderInfos() const;
-	Trades GenerateRandomOrder();
-};
-
-#endif // ORDERBOOK_H
-
+#ifndef ORDERBOOK_H
+#define ORDERBOOK_H
+
+#include "common_includes.h"
+#include "OrderIdIndex.h"
+
+using Price = std::int32_t;
+using Quantity = std::uint32_t;
+using OrderId = std::uint64_t;
+using ParticipantId = std::uint32_t;	// owner of an order, 0 when it has none, like the simulator's own orders
+
+struct LevelInfo {
+	Price price_;
+	Quantity quantity_;
+};
+
+enum class OrderType {
+	GoodTillCancel,
+	FillAndKill,
+	FillOrKill,
+	Market,
+	GoodForDay
+};
+
+enum class Side {
+	Buy,
+	Sell
+};
+
+// what an incoming order does when it would trade with a resting order of the same owner
+// the incoming order's instruction decides, orders without an owner are never stopped
+enum class SelfTradePrevention {
+	None,				// they trade
+	CancelResting,		// the resting order is cancelled and matching carries on past it
+	CancelAggressor,	// the rest of the incoming order is cancelled, trades it made so far stand
+	DecrementBoth		// the smaller of the two is taken off both without a trade
+};
+
+// compile-time description of a book side, so bids and asks share one implementation
+template <Side S>
+struct SideTraits;
+
+template <>
+struct SideTraits<Side::Buy> {
+	static constexpr Side Opposite = Side::Sell;
+	// levels are stored worst to best, for bids that is ascending
+	static constexpr bool IsWorse(Price price, Price other) { return price < other; }
+	// whether a bid resting at restingPrice trades with an incoming sell limited at price
+	static constexpr bool IsReachable(Price restingPrice, Price price) { return restingPrice >= price; }
+	// limit that makes an order on this side reach every opposite level, used for market orders
+	static constexpr Price MarketLimit = std::numeric_limits<Price>::max();
+};
+
+template <>
+struct SideTraits<Side::Sell> {
+	static constexpr Side Opposite = Side::Buy;
+	static constexpr bool IsWorse(Price price, Price other) { return price > other; }
+	static constexpr bool IsReachable(Price restingPrice, Price price) { return restingPrice <= price; }
+	static constexpr Price MarketLimit = std::numeric_limits<Price>::min();
+};
+
+// compile-time handling of an order type, selected once per order instead of tested inside the matching loop
+template <OrderType T>
+struct OrderTypePolicy;
+
+template <>
+struct OrderTypePolicy<OrderType::GoodTillCancel> {
+	static constexpr bool RequiresCross = false;	// rejected outright when it cannot trade on arrival
+	static constexpr bool RequiresFullFill = false;	// rejected outright unless the opposite side can fill all of it
+	static constexpr bool IgnoresPrice = false;		// trades at any opposite price, reported at the resting price
+	static constexpr bool RestsRemainder = true;	// whatever is left after matching joins the book
+	static constexpr bool ExpiresAtClose = false;	// cancelled by the session close sweep
+};
+
+template <>
+struct OrderTypePolicy<OrderType::FillAndKill> {
+	static constexpr bool RequiresCross = true;
+	static constexpr bool RequiresFullFill = false;
+	static constexpr bool IgnoresPrice = false;
+	static constexpr bool RestsRemainder = false;
+	static constexpr bool ExpiresAtClose = false;
+};
+
+template <>
+struct OrderTypePolicy<OrderType::FillOrKill> {
+	static constexpr bool RequiresCross = true;
+	static constexpr bool RequiresFullFill = true;
+	static constexpr bool IgnoresPrice = false;
+	static constexpr bool RestsRemainder = false;
+	static constexpr bool ExpiresAtClose = false;
+};
+
+template <>
+struct OrderTypePolicy<OrderType::Market> {
+	static constexpr bool RequiresCross = true;
+	static constexpr bool RequiresFullFill = false;
+	static constexpr bool IgnoresPrice = true;
+	static constexpr bool RestsRemainder = false;
+	static constexpr bool ExpiresAtClose = false;
+};
+
+template <>
+struct OrderTypePolicy<OrderType::GoodForDay> {
+	static constexpr bool RequiresCross = false;
+	static constexpr bool RequiresFullFill = false;
+	static constexpr bool IgnoresPrice = false;
+	static constexpr bool RestsRemainder = true;
+	static constexpr bool ExpiresAtClose = true;
+};
+
+struct TradeInfo {
+	OrderId orderId_;
+	Price price_;
+	Quantity quantity_;
+	ParticipantId owner_;	// for the owner's private channel, never published with the trade
+};
+
+class Trade {
+private:
+	TradeInfo bidTrade_;
+	TradeInfo askTrade_;
+	Price price_;				// where it traded, the resting order's level; an aggressive limit reports its own limit in its TradeInfo
+	std::uint64_t sequence_;	// per-symbol trade sequence number, consecutive across all trades of the book
+	std::uint64_t timestamp_;	// EventClock nanoseconds of the operation that traded
+public:
+	Trade(const TradeInfo& bidTrade, const TradeInfo& askTrade, Price price, std::uint64_t sequence, std::uint64_t timestamp);
+	const TradeInfo& GetBidTrade() const;
+	const TradeInfo& GetAskTrade() const;
+	Price GetPrice() const;
+	std::uint64_t GetSequence() const;
+	std::uint64_t GetTimestamp() const;
+};
+
+class Order {
+private:
+	OrderType orderType_;
+	OrderId orderId_;
+	Side side_;
+	Price price_;
+	Quantity initialQuantity_;
+	Quantity remainingQuantity_;
+	ParticipantId owner_;
+	SelfTradePrevention selfTradePrevention_;
+public:
+	Order(OrderType orderType, OrderId orderId, Side side, Price price, Quantity quantity,
+		ParticipantId owner = 0, SelfTradePrevention selfTradePrevention = SelfTradePrevention::None);
+	// market order, carries no price
+	Order(OrderId orderId, Side side, Quantity quantity,
+		ParticipantId owner = 0, SelfTradePrevention selfTradePrevention = SelfTradePrevention::None);
+
+	OrderId GetOrderId() const;
+	Side GetSide() const;
+	Price GetPrice() const;
+	OrderType GetOrderType() const;
+	Quantity GetInitialQuantity() const;
+	Quantity GetRemainingQuantity() const;
+	Quantity GetFilledQuantity() const;
+	ParticipantId GetOwner() const;
+	SelfTradePrevention GetSelfTradePrevention() const;
+	bool IsFilled() const;
+
+	void Fill(Quantity quantity);
+};
+
+using Trades = std::vector<Trade>;
+using OrderPointer = std::shared_ptr<Order>;
+using LevelInfos = std::vector<LevelInfo>;
+
+// new aggregate quantity of one price level after a mutation, zero when the level went away
+// sequence numbers are per symbol and consecutive across every level update the book makes
+struct LevelUpdate {
+	Side side_;
+	Price price_;
+	Quantity quantity_;
+	std::uint64_t sequence_;
+	std::uint64_t timestamp_;	// EventClock nanoseconds of the operation that changed the level
+};
+
+using LevelUpdates = std::vector<LevelUpdate>;
+
+// quantity self-trade prevention took off an order instead of trading it, one entry per order touched
+struct PreventedFill {
+	OrderId orderId_;
+	ParticipantId owner_;
+	Quantity quantity_;
+	bool cancelled_;		// nothing of the order is left in the book, or for an incoming order to rest
+};
+
+using PreventedFills = std::vector<PreventedFill>;
+
+class OrderBookLevelInfos {
+private:
+	LevelInfos bids_;
+	LevelInfos asks_;
+public:
+	OrderBookLevelInfos(const LevelInfos& bids, const LevelInfos& asks);
+
+	const LevelInfos& GetBids() const;
+	const LevelInfos& GetAsks() const;
+};
+
+class OrderModify {
+private:
+	OrderType orderType_;
+	OrderId orderId_;
+	Side side_;
+	Price price_;
+	Quantity quantity_;
+public:
+	OrderModify(OrderId orderId, Side side, Price price, Quantity quantity);
+	OrderId GetOrderId() const;
+	Side GetSide() const;
+	Price GetPrice() const;
+	Quantity GetQuantity() const;
+	// the replacement order, keeping what the modified order was entered with
+	OrderPointer ToOrderPointer(OrderType type, ParticipantId owner, SelfTradePrevention selfTradePrevention) const;
+};
+
+// orders resting at one price in time priority, holding only what the matching loop reads
+// ids, remaining quantities and owners are parallel arrays, so a sweep through a busy level stays on a few cache lines
+// a cancel zeroes its slot in place and matching skips it, which keeps slot numbers stable until compaction
+// dead slots are reclaimed from the front as orders fill and from the back as the newest are cancelled; a level whose
+// front order rests while the orders behind it churn is compacted once dead slots outnumber live ones two to one,
+// which gives its live orders new slot numbers
+class LevelQueue {
+private:
+	std::vector<OrderId> orderIds_;
+	std::vector<Quantity> remainingQuantities_;
+	std::vector<ParticipantId> owners_;
+	std::size_t head_{ 0 };
+	std::size_t live_{ 0 };
+	std::uint64_t base_{ 0 };	// slot number of orderIds_[0]
+
+	void Advance();
+public:
+	bool Empty() const;
+	OrderId FrontOrderId() const;
+	Quantity FrontRemainingQuantity() const;
+	ParticipantId FrontOwner() const;
+
+	std::uint64_t Push(OrderId orderId, Quantity quantity, ParticipantId owner);
+	Quantity Remove(std::uint64_t slot);
+	std::optional<Quantity> ReduceTo(std::uint64_t slot, Quantity quantity);
+	bool FillFront(Quantity quantity);
+	bool HoldsOwner(ParticipantId owner) const;
+	// slots held from the head on, live or dead
+	std::size_t Slots() const;
+	bool Sparse() const;
+	void Compact();
+
+	// visit(orderId, slot) for every live order in time priority
+	template <typename Visit>
+	void ForEachLive(Visit visit) const {
+		for (std::size_t index = head_; index < orderIds_.size(); ++index)
+			if (remainingQuantities_[index] != 0)
+				visit(orderIds_[index], base_ + index);
+	}
+};
+
+// one side of the book, price levels kept contiguous as parallel arrays sorted worst to best
+// the best level sits at the back so matching and top-N packing only ever touch the tail
+template <Side S>
+class BookSide {
+private:
+	std::vector<Price> prices_;
+	std::vector<Quantity> quantities_;		// aggregate remaining quantity of each level
+	std::vector<LevelQueue> queues_;
+
+	std::size_t FindLevel(Price price) const;
+	void EraseLevel(std::size_t level);
+public:
+	bool Empty() const;
+	std::size_t LevelCount() const;
+	Quantity LevelQuantity(Price price) const;
+	Price BestPrice() const;
+	LevelQueue& BestQueue();
+	bool Crosses(Price price) const;
+	std::size_t CountCrossingLevels(Price price) const;
+	bool CanFill(Price price, Quantity quantity) const;
+	bool HoldsOwner(Price price, ParticipantId owner) const;
+
+	std::uint64_t Push(OrderId orderId, Price price, Quantity quantity, ParticipantId owner);
+	// the level's queue when removing the order compacted it, its live orders then sit in new slots
+	LevelQueue* Erase(Price price, std::uint64_t slot);
+	std::optional<Quantity> ReduceTo(Price price, std::uint64_t slot, Quantity quantity);
+	void FillBest(Quantity quantity);
+	void PopBest();
+	void AppendLevelInfos(LevelInfos& levelInfos, std::size_t depth) const;
+};
+
+class OrderBook {
+private:
+	// cold per-order fields, looked up by id on cancel and modify but never while walking a level
+	struct OrderEntry {
+		OrderType orderType_;
+		Side side_;
+		Price price_;
+		Quantity initialQuantity_;
+		std::uint64_t slot_;	// position in the level queue at price_
+		ParticipantId owner_;
+		SelfTradePrevention selfTradePrevention_;	// kept for the replacement when a modify goes through cancel/replace
+	};
+
+	BookSide<Side::Buy> bids_;
+	BookSide<Side::Sell> asks_;
+	OrderIdIndex<OrderId, OrderEntry> orders_;
+	std::uint64_t version_{ 0 };	// bumped on every mutation, keys cached snapshots
+	std::chrono::system_clock::time_point sessionClose_{ std::chrono::system_clock::time_point::max() };
+	std::vector<OrderId> goodForDayOrders_;		// swept in bulk at session close, may hold ids already gone
+	LevelUpdates levelUpdates_;					// levels touched since the last TakeLevelUpdates
+	PreventedFills preventedFills_;				// since the last TakePreventedFills
+	std::uint64_t levelSequence_{ 0 };			// sequence number of the last level update made
+	std::uint64_t tradeSequence_{ 0 };			// sequence number of the last trade made
+	std::uint64_t eventTime_{ 0 };				// read once per public operation and stamped on everything it produces
+	std::uint64_t replayTime_{ 0 };
+	bool replaying_{ false };					// set by SetReplayTime, from then on the clock is replayTime_
+
+	std::uint64_t Now() const;
+
+	template <Side S>
+	BookSide<S>& Levels();
+	template <Side S>
+	void RecordLevel(Price price);
+	template <Side S>
+	Trades AddOrderTo(const Order& order);
+	template <Side S, OrderType T>
+	Trades AddOrderAs(const Order& order);
+	template <Side S, bool AtRestingPrice>
+	Quantity MatchAgainst(const Order& order, Price price, Trades& trades);
+public:
+	Trades AddOrder(OrderPointer order);
+	void CancelOrder(OrderId orderId);
+	Trades MatchOrder(OrderModify order);
+	// replaces the event clock with timestamp for every operation until the next call
+	void SetReplayTime(std::uint64_t timestamp);
+	bool Contains(OrderId orderId) const;
+	std::size_t Size() const;
+	std::size_t LevelCount() const;
+	void Reserve(std::size_t orders);
+	std::uint64_t GetVersion() const;
+	void TakeLevelUpdates(LevelUpdates& updates);
+	// what self-trade prevention did since the last TakePreventedFills, oldest first
+	const PreventedFills& GetPreventedFills() const;
+	void TakePreventedFills(PreventedFills& fills);
+	std::uint64_t GetUpdateSequence() const;
+	std::uint64_t GetTradeSequence() const;
+	void SetSessionClose(std::chrono::system_clock::time_point sessionClose);
+	std::chrono::system_clock::time_point GetSessionClose() const;
+	std::size_t ExpireOrders(std::chrono::system_clock::time_point now);
+	OrderBookLevelInfos GetOrderInfos() const;
+	OrderBookLevelInfos GetOrderInfos(std::size_t depth) const;
+	Trades GenerateRandomOrder();
+};
+
+#endif // ORDERBOOK_H
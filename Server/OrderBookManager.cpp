@@ -1,49 +1,115 @@
-// the order book manager keeps a map of orderbooks
-// orderbook map keyed on symbol, value as orderbook
-// returns pointer to correct orderbook for server to use
-
-#include "common_includes.h"
-#include "OrderBook.h"
-#include "OrderBookManager.h"
-
-using namespace std;
-using Symbol = string;
-
-bool OrderBookManager::AddSymbol(Symbol symbol, size_t depth) {
-
-	auto result = orderBookMap.insert(pair(symbol, make_shared<OrderBook>()));
-	orderBookDepth.insert(pair(symbol, depth));
-	if (result.second) {
-		return true;
-	}
-	else {
-		return false;
-	}
-}
-bool OrderBookManager::RemoveSymbol(Symbol symbol) {
-
-	if (orderBookMap.contains(symbol) && orderBookDepth.contains(symbol)) {
-		orderBookMap.erase(symbol);
-		orderBookDepth.erase(symbol);
-		return true;
-	}
-	else {
-		return false;
-	}
-}
-shared_ptr<OrderBook> OrderBookManager::GetOrderBook(Symbol symbol) const {
-	if (orderBookMap.contains(symbol)) {
-		return orderBookMap.at(symbol);
-	}
-	else {
-		return {};
-	}
-}
-size_t OrderBookManager::GetOrderBookDepth(Symbol symbol) const {
-	if (orderBookDepth.contains(symbol)) {
-		return orderBookDepth.at(symbol);
-	}
-	else {
-		return {};
-	}
-}
+// the order book manager keeps a map of orderbooks
+// orderbook map keyed on symbol, value as orderbook
+// returns pointer to correct orderbook for server to use
+
+#include "common_includes.h"
+#include "OrderBook.h"
+#include "SnapshotCache.h"
+#include "OrderBookManager.h"
+
+using namespace std;
+using Symbol = string;
+
+bool OrderBookManager::AddSymbol(Symbol symbol, size_t depth) {
+
+	auto orderBook = make_shared<OrderBook>();
+	orderBook->SetSessionClose(sessionClose);
+
+	auto result = orderBookMap.insert(pair(symbol, orderBook));
+	orderBookDepth.insert(pair(symbol, depth));
+	snapshotCacheMap.insert(pair(symbol, make_shared<SnapshotCache>(symbol)));
+	orderBookMutex.insert(pair(symbol, make_shared<mutex>()));
+	orderInboxMap.insert(pair(symbol, make_shared<OrderInbox>(riskLimits.ForSymbol(symbol), riskLimits.Participants())));
+	if (result.second) {
+		return true;
+	}
+	else {
+		return false;
+	}
+}
+bool OrderBookManager::RemoveSymbol(Symbol symbol) {
+
+	if (orderBookMap.contains(symbol) && orderBookDepth.contains(symbol)) {
+		orderBookMap.erase(symbol);
+		orderBookDepth.erase(symbol);
+		snapshotCacheMap.erase(symbol);
+		orderBookMutex.erase(symbol);
+		orderInboxMap.erase(symbol);
+		return true;
+	}
+	else {
+		return false;
+	}
+}
+shared_ptr<OrderBook> OrderBookManager::GetOrderBook(Symbol symbol) const {
+	if (orderBookMap.contains(symbol)) {
+		return orderBookMap.at(symbol);
+	}
+	else {
+		return {};
+	}
+}
+size_t OrderBookManager::GetOrderBookDepth(Symbol symbol) const {
+	if (orderBookDepth.contains(symbol)) {
+		return orderBookDepth.at(symbol);
+	}
+	else {
+		return {};
+	}
+}
+void OrderBookManager::SetSessionClose(chrono::system_clock::time_point close) {
+	sessionClose = close;
+	for (auto& [symbol, orderBook] : orderBookMap) {
+		orderBook->SetSessionClose(close);
+	}
+}
+shared_ptr<mutex> OrderBookManager::GetOrderBookMutex(Symbol symbol) const {
+	if (orderBookMutex.contains(symbol)) {
+		return orderBookMutex.at(symbol);
+	}
+	else {
+		return {};
+	}
+}
+shared_ptr<OrderInbox> OrderBookManager::GetOrderInbox(Symbol symbol) const {
+	if (orderInboxMap.contains(symbol)) {
+		return orderInboxMap.at(symbol);
+	}
+	else {
+		return {};
+	}
+}
+bool OrderBookManager::SubmitOrders(const Symbol& symbol, OrderBatch&& batch) {
+	auto inbox = orderInboxMap.find(symbol);
+	if (inbox == orderInboxMap.end()) {
+		return false;
+	}
+
+	// one atomic add per batch, the ids of a batch's new orders are consecutive
+	size_t newOrders = 0;
+	for (const auto& request : batch.requests_) {
+		newOrders += request.action_ == OrderAction::New;
+	}
+	OrderId orderId = newOrders ? nextOrderId.fetch_add(newOrders, memory_order_relaxed) : 0;
+	for (auto& request : batch.requests_) {
+		if (request.action_ == OrderAction::New) {
+			request.orderId_ = orderId++;
+		}
+	}
+
+	inbox->second->Submit(std::move(batch));
+	return true;
+}
+RiskLimits& OrderBookManager::GetRiskLimits() {
+	return riskLimits;
+}
+SnapshotBuffer OrderBookManager::GetSnapshot(Symbol symbol, SnapshotEncoding encoding) const {
+	if (orderBookMap.contains(symbol) && snapshotCacheMap.contains(symbol)) {
+		// the book is read on the caller's thread while the matching thread may be writing it
+		lock_guard<mutex> lock(*orderBookMutex.at(symbol));
+		return snapshotCacheMap.at(symbol)->GetSnapshot(*orderBookMap.at(symbol), orderBookDepth.at(symbol), encoding);
+	}
+	else {
+		return {};
+	}
+}
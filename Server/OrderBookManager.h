@@ -1,21 +1,43 @@
-#ifndef ORDERBOOK_MANAGER_H
-#define ORDERBOOK_MANAGER_H
-
-#include "common_includes.h"
-#include "OrderBook.h"
-
-using namespace std;
-using Symbol = string;
-
-class OrderBookManager {
-private:
-	unordered_map<Symbol, shared_ptr<OrderBook>> orderBookMap;
-	unordered_map<Symbol, size_t>                orderBookDepth;   // how many levels on bids/asks to desseminate to client
-public:
-	bool AddSymbol(Symbol symbol, size_t depth);
-	bool RemoveSymbol(Symbol symbol);
-	shared_ptr<OrderBook> GetOrderBook(Symbol symbol) const;
-	size_t GetOrderBookDepth(Symbol symbol) const;
-};
-
-#endif
+#ifndef ORDERBOOK_MANAGER_H
+#define ORDERBOOK_MANAGER_H
+
+#include "common_includes.h"
+#include "OrderBook.h"
+#include "SnapshotCache.h"
+#include "OrderEntry.h"
+#include <atomic>
+#include <mutex>
+
+using namespace std;
+using Symbol = string;
+
+class OrderBookManager {
+private:
+	unordered_map<Symbol, shared_ptr<OrderBook>> orderBookMap;
+	unordered_map<Symbol, size_t>                orderBookDepth;   // how many levels on bids/asks to desseminate to client
+	unordered_map<Symbol, shared_ptr<SnapshotCache>> snapshotCacheMap;
+	unordered_map<Symbol, shared_ptr<mutex>>     orderBookMutex;   // held by whoever mutates or reads a book across threads
+	unordered_map<Symbol, shared_ptr<OrderInbox>> orderInboxMap;   // client orders waiting for the book's matching thread
+	chrono::system_clock::time_point             sessionClose{ chrono::system_clock::time_point::max() };   // good-for-day orders expire here
+	atomic<OrderId>                              nextOrderId{ FirstClientOrderId };
+	RiskLimits                                   riskLimits;       // checked by every inbox, kept for removed symbols too
+public:
+	// ids handed to client orders start above the range the simulator's random orders use
+	static constexpr OrderId FirstClientOrderId = OrderId(1) << 32;
+
+	bool AddSymbol(Symbol symbol, size_t depth);
+	bool RemoveSymbol(Symbol symbol);
+	shared_ptr<OrderBook> GetOrderBook(Symbol symbol) const;
+	size_t GetOrderBookDepth(Symbol symbol) const;
+	shared_ptr<mutex> GetOrderBookMutex(Symbol symbol) const;
+	void SetSessionClose(chrono::system_clock::time_point close);
+	shared_ptr<OrderInbox> GetOrderInbox(Symbol symbol) const;
+	// assigns ids to the new orders and queues the batch for the symbol's matching thread
+	// false for an unknown symbol, the batch is then left as it was
+	bool SubmitOrders(const Symbol& symbol, OrderBatch&& batch);
+	// limits can be changed at any time, symbols get their entry in AddSymbol
+	RiskLimits& GetRiskLimits();
+	SnapshotBuffer GetSnapshot(Symbol symbol, SnapshotEncoding encoding = SnapshotEncoding::Text) const;
+};
+
+#endif
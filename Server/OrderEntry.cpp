@@ -0,0 +1,142 @@
+// order entry: requests from clients queued per book and applied on the book's matching thread
+
+#include "common_includes.h"
+#include "OrderEntry.h"
+#include "Metrics.h"
+#include "EventClock.h"
+#include "ThreadConfig.h"
+
+using namespace std;
+
+OrderSignal::OrderSignal(bool spin)
+	: spin_{ spin }
+{ }
+
+void OrderSignal::Raise() {
+	// a waiter that has not seen the flag yet checks it under the mutex, so notifying under it loses no wakeup
+	if (raised_.exchange(true, memory_order_release) || spin_)
+		return;
+	lock_guard<mutex> lock(mutex_);
+	ready_.notify_one();
+}
+
+bool OrderSignal::WaitUntil(chrono::steady_clock::time_point deadline) {
+	if (spin_) {
+		while (!raised_.load(memory_order_acquire) && chrono::steady_clock::now() < deadline)
+			ThreadConfig::Pause();
+	}
+	else {
+		unique_lock<mutex> lock(mutex_);
+		ready_.wait_until(lock, deadline, [this] { return raised_.load(memory_order_acquire); });
+	}
+	return raised_.exchange(false, memory_order_acq_rel);
+}
+
+OrderInbox::OrderInbox(const SymbolRiskLimits& symbolLimits, const ParticipantRiskLimits* participantLimits)
+	: risk_{ symbolLimits, participantLimits }
+{ }
+
+void OrderInbox::SetSignal(shared_ptr<OrderSignal> signal) {
+	signal_ = std::move(signal);
+}
+
+void OrderInbox::Submit(OrderBatch batch) {
+	{
+		lock_guard<mutex> lock(mutex_);
+		batches_.push_back(std::move(batch));
+	}
+	if (signal_)
+		signal_->Raise();
+}
+
+size_t OrderInbox::Drain(OrderBook& book, Trades& trades) {
+	draining_.clear();
+	{
+		lock_guard<mutex> lock(mutex_);
+		draining_.swap(batches_);
+	}
+
+	size_t applied = 0;
+	for (auto& batch : draining_) {
+		OrderAcks acks;
+		acks.reserve(batch.requests_.size());
+		// one clock read per request, each request is timed from the end of the one before it
+		uint64_t last = EventClock::Now();
+		for (const auto& request : batch.requests_) {
+			acks.push_back(Execute(book, request, trades));
+			const uint64_t now = EventClock::Now();
+			Metrics::Record(Histogram::MatchLatency, now > last ? now - last : 0);
+			last = now;
+		}
+		applied += batch.requests_.size();
+		if (batch.reply_)
+			batch.reply_(std::move(acks));
+	}
+	return applied;
+}
+
+void OrderInbox::Observe(const Trades& trades) {
+	risk_.Observe(trades);
+}
+
+void OrderInbox::Expire(const OrderBook& book) {
+	risk_.Expire(book);
+}
+
+OrderAck OrderInbox::Execute(OrderBook& book, const OrderRequest& request, Trades& trades) {
+	static constexpr OrderStatus riskStatuses[] = {
+		OrderStatus::Accepted, OrderStatus::RiskBlocked, OrderStatus::RiskQuantity,
+		OrderStatus::RiskNotional, OrderStatus::RiskPriceBand, OrderStatus::RiskPosition
+	};
+
+	OrderAck ack{ request.action_, OrderStatus::Accepted, request.clientTag_, request.orderId_, 0, false };
+
+	// a participant acts only on its own open orders, which the gate follows anyway
+	if (request.action_ != OrderAction::New && !risk_.Owns(request.participant_, request.orderId_)) {
+		ack.status_ = OrderStatus::UnknownOrder;
+		return ack;
+	}
+	if (request.action_ != OrderAction::Cancel) {
+		const RiskCheck check = risk_.Check(request.participant_, request.orderType_, request.side_, request.price_, request.quantity_,
+			request.action_ == OrderAction::Modify ? request.orderId_ : 0);
+		if (check != RiskCheck::Passed) {
+			ack.status_ = riskStatuses[static_cast<size_t>(check)];
+			return ack;
+		}
+	}
+
+	Trades executed;
+	const size_t prevented = book.GetPreventedFills().size();
+	switch (request.action_) {
+	case OrderAction::New:
+		risk_.Open(request.participant_, request.orderId_, request.orderType_, request.side_, request.quantity_);
+		executed = book.AddOrder(request.orderType_ == OrderType::Market
+			? make_shared<Order>(request.orderId_, request.side_, request.quantity_, request.participant_, request.selfTradePrevention_)
+			: make_shared<Order>(request.orderType_, request.orderId_, request.side_, request.price_, request.quantity_, request.participant_, request.selfTradePrevention_));
+		break;
+	case OrderAction::Cancel:
+		book.CancelOrder(request.orderId_);
+		break;
+	case OrderAction::Modify:
+		// the order keeps its type, owner and self-trade prevention in the book, the gate already knows whether it is good for day
+		risk_.Close(request.orderId_);
+		risk_.Open(request.participant_, request.orderId_, OrderType::GoodTillCancel, request.side_, request.quantity_);
+		executed = book.MatchOrder(OrderModify{ request.orderId_, request.side_, request.price_, request.quantity_ });
+		break;
+	}
+	risk_.Observe(executed);
+	for (size_t i = prevented; i < book.GetPreventedFills().size(); ++i)
+		risk_.Observe(book.GetPreventedFills()[i]);
+
+	for (const auto& trade : executed) {
+		if (trade.GetBidTrade().orderId_ == request.orderId_)
+			ack.filled_ += trade.GetBidTrade().quantity_;
+		else if (trade.GetAskTrade().orderId_ == request.orderId_)
+			ack.filled_ += trade.GetAskTrade().quantity_;
+	}
+	ack.resting_ = book.Contains(request.orderId_);
+	if (!ack.resting_)
+		risk_.Close(request.orderId_);
+	trades.insert(trades.end(), executed.begin(), executed.end());
+	return ack;
+}
@@ -0,0 +1,104 @@
+#ifndef ORDER_ENTRY_H
+#define ORDER_ENTRY_H
+
+#include "common_includes.h"
+#include "OrderBook.h"
+#include "RiskLimits.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+enum class OrderAction {
+	New,
+	Cancel,
+	Modify
+};
+
+// one order entry request for one book, decoded from the text or binary session protocol
+struct OrderRequest {
+	OrderAction action_;
+	OrderType orderType_;
+	Side side_;
+	Price price_;
+	Quantity quantity_;
+	OrderId orderId_;				// assigned by the manager for New, the order acted on otherwise
+	std::uint64_t clientTag_;		// chosen by the client and echoed in the ack
+	ParticipantId participant_;		// set by the session, below RiskLimits::MaxParticipants, owns the order
+	SelfTradePrevention selfTradePrevention_;	// set by the session, applied against the participant's own orders
+};
+
+enum class OrderStatus {
+	Accepted,
+	UnknownSymbol,
+	UnknownOrder,
+	Malformed,
+	// rejected by the book's RiskGate, one status per RiskCheck
+	RiskBlocked,
+	RiskQuantity,
+	RiskNotional,
+	RiskPriceBand,
+	RiskPosition
+};
+
+struct OrderAck {
+	OrderAction action_;
+	OrderStatus status_;
+	std::uint64_t clientTag_;
+	OrderId orderId_;
+	Quantity filled_;		// traded by this request
+	bool resting_;			// left in the book afterwards
+};
+
+using OrderAcks = std::vector<OrderAck>;
+using OrderReplyHandler = std::function<void(OrderAcks acks)>;
+
+// the requests of one client message, applied in order and acknowledged together
+struct OrderBatch {
+	std::vector<OrderRequest> requests_;
+	OrderReplyHandler reply_;
+};
+
+// wakes the matching thread that owns a set of books when orders arrive for any of them
+// a spinning thread polls the flag, a blocking one sleeps on the condition variable
+class OrderSignal {
+private:
+	std::mutex mutex_;
+	std::condition_variable ready_;
+	std::atomic<bool> raised_{ false };
+	bool spin_;
+public:
+	explicit OrderSignal(bool spin);
+
+	void Raise();
+	// returns whether the signal was raised before deadline, and lowers it
+	bool WaitUntil(std::chrono::steady_clock::time_point deadline);
+};
+
+// requests waiting for one book's matching thread
+// submitters only append a batch under a short lock, the matching thread swaps the whole list out
+// and passes every request through the book's risk checks before it reaches the book
+class OrderInbox {
+private:
+	std::mutex mutex_;
+	std::vector<OrderBatch> batches_;
+	std::vector<OrderBatch> draining_;		// only touched by the matching thread
+	std::shared_ptr<OrderSignal> signal_;
+	RiskGate risk_;							// only touched by the matching thread
+
+	OrderAck Execute(OrderBook& book, const OrderRequest& request, Trades& trades);
+public:
+	OrderInbox(const SymbolRiskLimits& symbolLimits, const ParticipantRiskLimits* participantLimits);
+
+	// set before any batch is submitted
+	void SetSignal(std::shared_ptr<OrderSignal> signal);
+	void Submit(OrderBatch batch);
+	// applies every waiting request to book in arrival order, appends the trades and answers each batch
+	// call from the matching thread with the book's mutex held, returns the number of requests applied
+	std::size_t Drain(OrderBook& book, Trades& trades);
+	// the book's trades made outside Drain, and its session close sweeps, so client orders they touch are accounted for
+	void Observe(const Trades& trades);
+	void Expire(const OrderBook& book);
+};
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef ORDER_ID_INDEX_H
+#define ORDER_ID_INDEX_H
+
+#include "common_includes.h"
+#include <bit>
+
+// flat open-addressing map from order id to a small trivially copyable handle
+// robin hood probing keeps probe sequences short, and erase shifts the following run back one slot
+// instead of leaving tombstones, so lookups never wade through deleted entries
+// every operation is a single probe sequence starting at the key's home slot
+template <typename Key, typename Value>
+class OrderIdIndex {
+private:
+	struct Slot {
+		Key key_{};
+		Value value_{};
+		std::uint32_t distance_{ 0 };	// 0 marks an empty slot, otherwise one more than the distance from home
+	};
+
+	static constexpr std::size_t MinimumCapacity = 16;
+
+	std::vector<Slot> slots_;
+	std::size_t size_{ 0 };
+	std::size_t mask_{ 0 };
+	unsigned shift_{ 0 };
+
+	// fibonacci hashing, spreads sequential ids across the table
+	std::size_t Home(Key key) const {
+		return static_cast<std::size_t>((static_cast<std::uint64_t>(key) * 0x9E3779B97F4A7C15ull) >> shift_);
+	}
+	std::size_t Next(std::size_t index) const { return (index + 1) & mask_; }
+
+	// probes for key, returns the slot index or npos
+	std::size_t Locate(Key key) const {
+		if (slots_.empty())
+			return std::string::npos;
+
+		std::size_t index = Home(key);
+		for (std::uint32_t distance = 1; ; ++distance) {
+			const Slot& slot = slots_[index];
+			if (slot.distance_ < distance)
+				return std::string::npos;
+			if (slot.key_ == key)
+				return index;
+			index = Next(index);
+		}
+	}
+	void RemoveAt(std::size_t index) {
+		std::size_t next = Next(index);
+		while (slots_[next].distance_ > 1) {
+			slots_[index] = slots_[next];
+			--slots_[index].distance_;
+			index = next;
+			next = Next(next);
+		}
+		slots_[index] = Slot{};
+		--size_;
+	}
+	void Rehash(std::size_t capacity) {
+		std::vector<Slot> previous = std::move(slots_);
+
+		slots_.assign(capacity, Slot{});
+		mask_ = capacity - 1;
+		shift_ = 64 - static_cast<unsigned>(std::countr_zero(capacity));
+		size_ = 0;
+
+		for (const Slot& slot : previous) {
+			if (slot.distance_ != 0)
+				Insert(slot.key_, slot.value_);
+		}
+	}
+public:
+	explicit OrderIdIndex(std::size_t capacity = MinimumCapacity) { Reserve(capacity); }
+
+	// sizes the table so count entries fit without growing, keeping the load under 7/8
+	void Reserve(std::size_t count) {
+		std::size_t capacity = std::max(MinimumCapacity, std::bit_ceil(count + count / 7 + 1));
+		if (capacity > slots_.size())
+			Rehash(capacity);
+	}
+	std::size_t Size() const { return size_; }
+	bool Contains(Key key) const { return Locate(key) != std::string::npos; }
+
+	Value* Find(Key key) {
+		std::size_t index = Locate(key);
+		return index == std::string::npos ? nullptr : &slots_[index].value_;
+	}
+	const Value* Find(Key key) const {
+		std::size_t index = Locate(key);
+		return index == std::string::npos ? nullptr : &slots_[index].value_;
+	}
+
+	// false when key is already present, the existing value is left as it was
+	bool Insert(Key key, const Value& value) {
+		if ((size_ + 1) * 8 > slots_.size() * 7)
+			Rehash(slots_.size() * 2);
+
+		Slot incoming{ key, value, 1 };
+		std::size_t index = Home(key);
+
+		while (true) {
+			Slot& slot = slots_[index];
+			if (slot.distance_ == 0) {
+				slot = incoming;
+				++size_;
+				return true;
+			}
+			// the key can only still be ahead while incoming is the original entry, which it stays until the first swap
+			if (slot.key_ == key && incoming.key_ == key)
+				return false;
+			if (slot.distance_ < incoming.distance_)
+				std::swap(slot, incoming);
+
+			index = Next(index);
+			++incoming.distance_;
+		}
+	}
+
+	bool Erase(Key key) {
+		std::size_t index = Locate(key);
+		if (index == std::string::npos)
+			return false;
+
+		RemoveAt(index);
+		return true;
+	}
+	// erases key and hands back what it mapped to, in the same probe
+	std::optional<Value> Take(Key key) {
+		std::size_t index = Locate(key);
+		if (index == std::string::npos)
+			return std::nullopt;
+
+		Value value = slots_[index].value_;
+		RemoveAt(index);
+		return value;
+	}
+};
+
+#endif
@@ -0,0 +1,174 @@
+// reference book: the matching rules with no data structures to get wrong, for differential testing of OrderBook
+
+#include "common_includes.h"
+#include "ReferenceBook.h"
+
+using namespace std;
+
+vector<ReferenceBook::RestingOrder>::iterator ReferenceBook::Find(OrderId orderId) {
+	return find_if(orders_.begin(), orders_.end(), [orderId](const RestingOrder& order) { return order.orderId_ == orderId; });
+}
+
+vector<ReferenceBook::RestingOrder>::iterator ReferenceBook::BestCrossing(Side side, Price price) {
+	auto best = orders_.end();
+	for (auto it = orders_.begin(); it != orders_.end(); ++it) {
+		if (it->side_ == side)
+			continue;
+		// a buy takes the lowest ask at or below its price, a sell the highest bid at or above, the earlier of equal prices
+		const bool crosses = side == Side::Buy ? it->price_ <= price : it->price_ >= price;
+		const bool better = best == orders_.end() || (side == Side::Buy ? it->price_ < best->price_ : it->price_ > best->price_);
+		if (crosses && better)
+			best = it;
+	}
+	return best;
+}
+
+Trades ReferenceBook::Add(const RestingOrder& order) {
+	const bool buy = order.side_ == Side::Buy;
+	const bool market = order.orderType_ == OrderType::Market;
+	const bool rests = order.orderType_ == OrderType::GoodTillCancel || order.orderType_ == OrderType::GoodForDay;
+	const Price limit = !market ? order.price_ : buy ? numeric_limits<Price>::max() : numeric_limits<Price>::min();
+	const SelfTradePrevention prevention = order.owner_ != 0 ? order.selfTradePrevention_ : SelfTradePrevention::None;
+
+	// fill-and-kill, fill-or-kill and market orders that cannot trade at all are rejected
+	if (!rests && BestCrossing(order.side_, limit) == orders_.end())
+		return {};
+
+	// fill-or-kill needs enough crossing quantity, and none of its own owner's orders in the way when it prevents self-trades
+	if (order.orderType_ == OrderType::FillOrKill) {
+		uint64_t available = 0;
+		bool meetsOwner = false;
+		for (const auto& resting : orders_) {
+			if (resting.side_ == order.side_ || (buy ? resting.price_ > limit : resting.price_ < limit))
+				continue;
+			available += resting.remaining_;
+			meetsOwner = meetsOwner || resting.owner_ == order.owner_;
+		}
+		if (available < order.remaining_ || (prevention != SelfTradePrevention::None && meetsOwner))
+			return {};
+	}
+
+	Trades trades;
+	Quantity quantity = order.remaining_;
+	Quantity decremented = 0;
+	while (quantity != 0) {
+		auto resting = BestCrossing(order.side_, limit);
+		if (resting == orders_.end())
+			break;
+
+		if (prevention != SelfTradePrevention::None && resting->owner_ == order.owner_) {
+			if (prevention == SelfTradePrevention::CancelAggressor) {
+				preventedFills_.push_back(PreventedFill{ order.orderId_, order.owner_, quantity, true });
+				quantity = 0;
+				break;
+			}
+			const Quantity removed = prevention == SelfTradePrevention::CancelResting ? resting->remaining_ : min(quantity, resting->remaining_);
+			resting->remaining_ -= removed;
+			preventedFills_.push_back(PreventedFill{ resting->orderId_, resting->owner_, removed, resting->remaining_ == 0 });
+			if (prevention == SelfTradePrevention::DecrementBoth) {
+				quantity -= removed;
+				decremented += removed;
+			}
+			if (resting->remaining_ == 0)
+				orders_.erase(resting);
+			continue;
+		}
+
+		// the incoming order reports its own limit, a market order the price it traded at
+		const Quantity fill = min(quantity, resting->remaining_);
+		const TradeInfo incoming{ order.orderId_, market ? resting->price_ : limit, fill, order.owner_ };
+		const TradeInfo restingInfo{ resting->orderId_, resting->price_, fill, resting->owner_ };
+		trades.push_back(buy
+			? Trade{ incoming, restingInfo, resting->price_, ++tradeSequence_, timestamp_ }
+			: Trade{ restingInfo, incoming, resting->price_, ++tradeSequence_, timestamp_ });
+
+		quantity -= fill;
+		resting->remaining_ -= fill;
+		if (resting->remaining_ == 0)
+			orders_.erase(resting);
+	}
+
+	if (decremented != 0)
+		preventedFills_.push_back(PreventedFill{ order.orderId_, order.owner_, decremented, quantity == 0 });
+
+	if (rests && quantity != 0) {
+		RestingOrder rest = order;
+		rest.remaining_ = quantity;
+		orders_.push_back(rest);
+	}
+	return trades;
+}
+
+Trades ReferenceBook::AddOrder(const Order& order) {
+	if (Contains(order.GetOrderId()))
+		return {};
+	return Add(RestingOrder{ order.GetOrderId(), order.GetOrderType(), order.GetSide(), order.GetPrice(),
+		order.GetRemainingQuantity(), order.GetOwner(), order.GetSelfTradePrevention() });
+}
+
+void ReferenceBook::CancelOrder(OrderId orderId) {
+	auto order = Find(orderId);
+	if (order != orders_.end())
+		orders_.erase(order);
+}
+
+Trades ReferenceBook::MatchOrder(const OrderModify& order) {
+	auto existing = Find(order.GetOrderId());
+	if (existing == orders_.end())
+		return {};
+
+	// shrinking in place keeps the order where it is, anything else is a new arrival of the same type and owner
+	if (order.GetSide() == existing->side_ && order.GetPrice() == existing->price_ && order.GetQuantity() != 0 && order.GetQuantity() <= existing->remaining_) {
+		existing->remaining_ = order.GetQuantity();
+		return {};
+	}
+
+	const RestingOrder replacement{ order.GetOrderId(), existing->orderType_, order.GetSide(), order.GetPrice(),
+		order.GetQuantity(), existing->owner_, existing->selfTradePrevention_ };
+	orders_.erase(existing);
+	return Add(replacement);
+}
+
+size_t ReferenceBook::ExpireGoodForDay() {
+	return erase_if(orders_, [](const RestingOrder& order) { return order.orderType_ == OrderType::GoodForDay; });
+}
+
+void ReferenceBook::SetReplayTime(uint64_t timestamp) { timestamp_ = timestamp; }
+
+bool ReferenceBook::Contains(OrderId orderId) const {
+	return any_of(orders_.begin(), orders_.end(), [orderId](const RestingOrder& order) { return order.orderId_ == orderId; });
+}
+
+size_t ReferenceBook::Size() const { return orders_.size(); }
+
+Quantity ReferenceBook::LevelQuantity(Side side, Price price) const {
+	Quantity quantity = 0;
+	for (const auto& order : orders_)
+		if (order.side_ == side && order.price_ == price)
+			quantity += order.remaining_;
+	return quantity;
+}
+
+// bids best first is highest first, asks lowest first
+OrderBookLevelInfos ReferenceBook::GetOrderInfos() const {
+	map<Price, Quantity, greater<Price>> bids;
+	map<Price, Quantity> asks;
+	for (const auto& order : orders_) {
+		if (order.side_ == Side::Buy)
+			bids[order.price_] += order.remaining_;
+		else
+			asks[order.price_] += order.remaining_;
+	}
+
+	LevelInfos bidInfos, askInfos;
+	for (const auto& [price, quantity] : bids)
+		bidInfos.push_back(LevelInfo{ price, quantity });
+	for (const auto& [price, quantity] : asks)
+		askInfos.push_back(LevelInfo{ price, quantity });
+	return OrderBookLevelInfos{ bidInfos, askInfos };
+}
+
+void ReferenceBook::TakePreventedFills(PreventedFills& fills) {
+	fills.clear();
+	fills.swap(preventedFills_);
+}
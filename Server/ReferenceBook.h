@@ -0,0 +1,48 @@
+#ifndef REFERENCE_BOOK_H
+#define REFERENCE_BOOK_H
+
+#include "common_includes.h"
+#include "OrderBook.h"
+
+// the matching rules of OrderBook written as plainly as they can be, to check it against
+// resting orders are one list in arrival order and every operation scans all of it, nothing is cached or aggregated,
+// so each rule is a few lines that can be read off: best price first, then earliest arrival
+// far too slow for a live book, meant for books of a few hundred orders in BookFuzz
+class ReferenceBook {
+private:
+	struct RestingOrder {
+		OrderId orderId_;
+		OrderType orderType_;
+		Side side_;
+		Price price_;
+		Quantity remaining_;
+		ParticipantId owner_;
+		SelfTradePrevention selfTradePrevention_;
+	};
+
+	std::vector<RestingOrder> orders_;	// arrival order, which is time priority within a price
+	PreventedFills preventedFills_;
+	std::uint64_t tradeSequence_{ 0 };
+	std::uint64_t timestamp_{ 0 };
+
+	std::vector<RestingOrder>::iterator Find(OrderId orderId);
+	// the opposite order an incoming order on side limited at price would trade with next, end when there is none
+	std::vector<RestingOrder>::iterator BestCrossing(Side side, Price price);
+	Trades Add(const RestingOrder& order);
+public:
+	Trades AddOrder(const Order& order);
+	void CancelOrder(OrderId orderId);
+	Trades MatchOrder(const OrderModify& order);
+	// cancels every good-for-day order, what OrderBook::ExpireOrders does once the session has closed
+	std::size_t ExpireGoodForDay();
+	// the timestamp every trade carries until the next call, like OrderBook::SetReplayTime
+	void SetReplayTime(std::uint64_t timestamp);
+
+	bool Contains(OrderId orderId) const;
+	std::size_t Size() const;
+	Quantity LevelQuantity(Side side, Price price) const;
+	OrderBookLevelInfos GetOrderInfos() const;
+	void TakePreventedFills(PreventedFills& fills);
+};
+
+#endif
@@ -0,0 +1,168 @@
+// risk benchmark: the cost of the pre-trade checks next to the cost of matching the same orders
+
+#include "common_includes.h"
+#include "RiskBenchmark.h"
+#include "OrderEntry.h"
+#include <random>
+
+using namespace std;
+
+struct BookResult {
+	Trades trades_;
+	bool resting_;
+};
+
+static constexpr ParticipantId BenchmarkParticipants = 64;
+static constexpr size_t BenchmarkBatch = 64;
+
+// the same mix as Backtest::GenerateEvents, spread over participants that only touch their own orders
+static vector<OrderRequest> GenerateRequests(size_t orders) {
+	mt19937_64 random(43);
+	uniform_int_distribution<int> percent(0, 99);
+	uniform_int_distribution<Quantity> quantities(1, 500);
+	uniform_int_distribution<Price> offsets(-20, 20);
+
+	vector<OrderRequest> requests;
+	requests.reserve(orders);
+	vector<const OrderRequest*> issued;
+	Price mid = 10000;
+	for (size_t i = 0; i < orders; ++i) {
+		const int roll = percent(random);
+		if (roll < 2)
+			mid += offsets(random) / 4;
+
+		if (roll < 35 && !issued.empty()) {
+			const OrderRequest& target = *issued[issued.size() - 1 - random() % min<size_t>(issued.size(), 256)];
+			const bool cancel = roll < 25;
+			requests.push_back({ cancel ? OrderAction::Cancel : OrderAction::Modify, OrderType::GoodTillCancel,
+				percent(random) < 50 ? Side::Buy : Side::Sell, mid + offsets(random), quantities(random), target.orderId_, i, target.participant_, SelfTradePrevention::None });
+			continue;
+		}
+
+		const bool buy = percent(random) < 50;
+		const OrderType type = roll < 85 ? OrderType::GoodTillCancel : roll < 93 ? OrderType::FillAndKill
+			: roll < 96 ? OrderType::FillOrKill : roll < 98 ? OrderType::GoodForDay : OrderType::Market;
+		const OrderId orderId = i + 1;
+		requests.push_back({ OrderAction::New, type, buy ? Side::Buy : Side::Sell, mid + (buy ? -1 : 1) * (offsets(random) + 5),
+			quantities(random), orderId, i, static_cast<ParticipantId>(1 + orderId % BenchmarkParticipants), SelfTradePrevention::None });
+		// requests is reserved, the pointers stay valid
+		issued.push_back(&requests.back());
+	}
+	return requests;
+}
+
+static double NanosecondsPerOrder(chrono::steady_clock::time_point start, size_t orders) {
+	return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / static_cast<double>(orders);
+}
+
+// a sell limited far below the bid trades at the bid, so the band has to stay around the bid as well
+// an order near the real market afterwards must pass, it failed while the band followed the sell's own limit
+static bool BandFollowsTradedPrice() {
+	RiskLimits limits;
+	limits.ForSymbol("BAND");
+	limits.Set("symbol BAND price_band=10");
+	OrderBook book;
+	OrderInbox inbox(limits.ForSymbol("BAND"), limits.Participants());
+
+	OrderAcks acks;
+	Trades trades;
+	auto send = [&](Side side, Price price, ParticipantId participant) {
+		const OrderId orderId = acks.size() + 1;
+		OrderBatch batch;
+		batch.requests_.push_back({ OrderAction::New, OrderType::GoodTillCancel, side, price, 10, orderId, orderId, participant, SelfTradePrevention::None });
+		batch.reply_ = [&acks](OrderAcks replies) { acks.insert(acks.end(), replies.begin(), replies.end()); };
+		inbox.Submit(std::move(batch));
+		inbox.Drain(book, trades);
+	};
+	send(Side::Buy, 100, 1);
+	send(Side::Sell, 50, 2);
+	send(Side::Buy, 105, 1);
+	return acks.size() == 3 && trades.size() == 1 && trades[0].GetPrice() == 100
+		&& all_of(acks.begin(), acks.end(), [](const OrderAck& ack) { return ack.status_ == OrderStatus::Accepted; });
+}
+
+int RiskBenchmark::Run(size_t orders) {
+	const bool band = BandFollowsTradedPrice();
+	const vector<OrderRequest> requests = GenerateRequests(orders);
+
+	// every check switched on, none of them tight enough to reject
+	RiskLimits limits;
+	limits.ForSymbol("BENCH");
+	limits.Set("symbol BENCH max_quantity=1000000 max_notional=1000000000000 price_band=100000");
+	for (ParticipantId participant = 1; participant <= BenchmarkParticipants; ++participant)
+		limits.Set(format("participant {} max_quantity=1000000 max_position=1000000000000", participant));
+
+	// the book alone, keeping what each request did for the gate to see
+	vector<BookResult> results(requests.size());
+	size_t trades = 0;
+	OrderBook book;
+	auto start = chrono::steady_clock::now();
+	for (size_t i = 0; i < requests.size(); ++i) {
+		const OrderRequest& request = requests[i];
+		switch (request.action_) {
+		case OrderAction::New:
+			results[i].trades_ = book.AddOrder(request.orderType_ == OrderType::Market
+				? make_shared<Order>(request.orderId_, request.side_, request.quantity_)
+				: make_shared<Order>(request.orderType_, request.orderId_, request.side_, request.price_, request.quantity_));
+			break;
+		case OrderAction::Cancel:
+			book.CancelOrder(request.orderId_);
+			break;
+		case OrderAction::Modify:
+			results[i].trades_ = book.MatchOrder(OrderModify{ request.orderId_, request.side_, request.price_, request.quantity_ });
+			break;
+		}
+		results[i].resting_ = book.Contains(request.orderId_);
+		trades += results[i].trades_.size();
+	}
+	const double bookNanoseconds = NanosecondsPerOrder(start, requests.size());
+
+	// the gate alone, doing for each request what OrderInbox does around the book
+	RiskGate gate(limits.ForSymbol("BENCH"), limits.Participants());
+	size_t gateRejects = 0;
+	start = chrono::steady_clock::now();
+	for (size_t i = 0; i < requests.size(); ++i) {
+		const OrderRequest& request = requests[i];
+		if (request.action_ != OrderAction::New && !gate.Owns(request.participant_, request.orderId_))
+			continue;
+		if (request.action_ != OrderAction::Cancel && gate.Check(request.participant_, request.orderType_, request.side_, request.price_,
+				request.quantity_, request.action_ == OrderAction::Modify ? request.orderId_ : 0) != RiskCheck::Passed) {
+			++gateRejects;
+			continue;
+		}
+		if (request.action_ != OrderAction::New)
+			gate.Close(request.orderId_);
+		if (request.action_ != OrderAction::Cancel)
+			gate.Open(request.participant_, request.orderId_, request.orderType_, request.side_, request.quantity_);
+		gate.Observe(results[i].trades_);
+		if (!results[i].resting_)
+			gate.Close(request.orderId_);
+	}
+	const double gateNanoseconds = NanosecondsPerOrder(start, requests.size());
+
+	// the whole order path, book and gate together, in session sized batches
+	OrderBook inboxBook;
+	OrderInbox inbox(limits.ForSymbol("BENCH"), limits.Participants());
+	Trades inboxTrades;
+	size_t inboxRejects = 0;
+	start = chrono::steady_clock::now();
+	for (size_t first = 0; first < requests.size(); first += BenchmarkBatch) {
+		OrderBatch batch;
+		batch.requests_.assign(requests.begin() + first, requests.begin() + min(first + BenchmarkBatch, requests.size()));
+		batch.reply_ = [&inboxRejects](OrderAcks acks) {
+			for (const auto& ack : acks)
+				inboxRejects += ack.status_ != OrderStatus::Accepted && ack.status_ != OrderStatus::UnknownOrder;
+		};
+		inbox.Submit(std::move(batch));
+		inbox.Drain(inboxBook, inboxTrades);
+		inboxTrades.clear();
+	}
+	const double inboxNanoseconds = NanosecondsPerOrder(start, requests.size());
+
+	cout << format("{} orders, {} trades, {} participants\n", requests.size(), trades, BenchmarkParticipants);
+	cout << format("book only:      {:8.1f} ns/order\n", bookNanoseconds);
+	cout << format("risk gate only: {:8.1f} ns/order, {:.1f}% of matching, {} rejects\n", gateNanoseconds, 100.0 * gateNanoseconds / bookNanoseconds, gateRejects);
+	cout << format("order inbox:    {:8.1f} ns/order, {} rejects\n", inboxNanoseconds, inboxRejects);
+	cout << format("price band after a sell limited below the bid: {}\n", band ? "follows the traded price" : "FAILED");
+	return gateRejects == 0 && inboxRejects == 0 && band ? EXIT_SUCCESS : EXIT_FAILURE;
+}
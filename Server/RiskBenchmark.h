@@ -0,0 +1,16 @@
+#ifndef RISK_BENCHMARK_H
+#define RISK_BENCHMARK_H
+
+#include "common_includes.h"
+
+// measures what the pre-trade risk stage adds per order
+// a deterministic stream of client orders for one book is timed three ways: straight into an OrderBook,
+// through a RiskGate alone with every limit switched on, and through an OrderInbox, the order path sessions use
+// before timing, a short scenario checks the price band follows where a sell limited below the bid actually traded
+class RiskBenchmark {
+public:
+	// returns a process exit code
+	static int Run(std::size_t orders);
+};
+
+#endif
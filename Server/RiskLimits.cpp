@@ -0,0 +1,233 @@
+// risk limits: per-symbol and per-participant pre-trade limits, and the gate each book's matching thread runs them in
+
+#include "common_includes.h"
+#include "RiskLimits.h"
+#include <charconv>
+
+using namespace std;
+
+static bool ParseInt64(string_view text, int64_t& value) {
+	auto [last, error] = from_chars(text.data(), text.data() + text.size(), value);
+	return error == errc{} && last == text.data() + text.size() && value >= 0;
+}
+
+// splits the next space separated word off text
+static string_view NextWord(string_view& text) {
+	const size_t start = min(text.find_first_not_of(" \t\r"), text.size());
+	text.remove_prefix(start);
+	const size_t end = min(text.find_first_of(" \t\r"), text.size());
+	const string_view word = text.substr(0, end);
+	text.remove_prefix(end);
+	return word;
+}
+
+RiskLimits::RiskLimits()
+	: participants_{ make_unique<ParticipantRiskLimits[]>(MaxParticipants) }
+{ }
+
+SymbolRiskLimits& RiskLimits::ForSymbol(const string& symbol) {
+	auto& limits = symbols_[symbol];
+	if (!limits)
+		limits = make_unique<SymbolRiskLimits>();
+	return *limits;
+}
+
+const ParticipantRiskLimits* RiskLimits::Participants() const {
+	return participants_.get();
+}
+
+void RiskLimits::Set(string_view command) {
+	const string_view scope = NextWord(command);
+	const string_view name = NextWord(command);
+
+	SymbolRiskLimits* symbol = nullptr;
+	ParticipantRiskLimits* participant = nullptr;
+	int64_t id = 0;
+	if (scope == "symbol") {
+		auto it = symbols_.find(string(name));
+		if (it == symbols_.end())
+			throw logic_error(format("Risk limit for an unknown symbol ({}).", name));
+		symbol = it->second.get();
+	}
+	else if (scope == "participant" && ParseInt64(name, id) && id < MaxParticipants) {
+		participant = &participants_[static_cast<size_t>(id)];
+	}
+	else {
+		throw logic_error(format("Risk limit ({} {}) is not for a symbol or a participant below {}.", scope, name, MaxParticipants));
+	}
+
+	for (string_view setting = NextWord(command); !setting.empty(); setting = NextWord(command)) {
+		const size_t equals = setting.find('=');
+		const string_view key = setting.substr(0, equals);
+		int64_t value = 0;
+		if (equals == string_view::npos || !ParseInt64(setting.substr(equals + 1), value))
+			throw logic_error(format("Risk limit ({}) is not of the form key=value with a value of 0 or more.", setting));
+
+		const bool fitsQuantity = value <= numeric_limits<Quantity>::max();
+		if (symbol && key == "max_quantity" && fitsQuantity)
+			symbol->maxOrderQuantity_.store(static_cast<Quantity>(value), memory_order_relaxed);
+		else if (symbol && key == "max_notional")
+			symbol->maxOrderNotional_.store(value, memory_order_relaxed);
+		else if (symbol && key == "price_band" && value <= numeric_limits<Price>::max())
+			symbol->priceBand_.store(static_cast<Price>(value), memory_order_relaxed);
+		else if (participant && key == "max_quantity" && fitsQuantity)
+			participant->maxOrderQuantity_.store(static_cast<Quantity>(value), memory_order_relaxed);
+		else if (participant && key == "max_position")
+			participant->maxPosition_.store(value, memory_order_relaxed);
+		else if (participant && key == "blocked" && value <= 1)
+			participant->blocked_.store(value == 1, memory_order_relaxed);
+		else if (participant && key == "token" && id != 0 && Login(static_cast<uint64_t>(value)).value_or(id) == id)
+			participant->loginToken_.store(static_cast<uint64_t>(value), memory_order_relaxed);
+		else
+			throw logic_error(format("Risk limit ({}) has an unknown key or a value out of range.", setting));
+	}
+}
+
+optional<ParticipantId> RiskLimits::Login(uint64_t token) const {
+	// only called when a session logs in, a scan of the table is cheap enough
+	for (ParticipantId id = 1; token != 0 && id < MaxParticipants; ++id)
+		if (participants_[id].loginToken_.load(memory_order_relaxed) == token)
+			return id;
+	return nullopt;
+}
+
+string RiskLimits::Describe() const {
+	vector<string> names;
+	for (const auto& [name, limits] : symbols_)
+		names.push_back(name);
+	sort(names.begin(), names.end());
+
+	string description;
+	for (const auto& name : names) {
+		const SymbolRiskLimits& limits = *symbols_.at(name);
+		format_to(back_inserter(description), "symbol {} max_quantity={} max_notional={} price_band={}\n", name,
+			limits.maxOrderQuantity_.load(memory_order_relaxed), limits.maxOrderNotional_.load(memory_order_relaxed), limits.priceBand_.load(memory_order_relaxed));
+	}
+	for (ParticipantId id = 0; id < MaxParticipants; ++id) {
+		const ParticipantRiskLimits& limits = participants_[id];
+		const Quantity maxQuantity = limits.maxOrderQuantity_.load(memory_order_relaxed);
+		const int64_t maxPosition = limits.maxPosition_.load(memory_order_relaxed);
+		const bool blocked = limits.blocked_.load(memory_order_relaxed);
+		const uint64_t token = limits.loginToken_.load(memory_order_relaxed);
+		if (maxQuantity || maxPosition || blocked || token)
+			format_to(back_inserter(description), "participant {} max_quantity={} max_position={} blocked={} token={}\n", id, maxQuantity, maxPosition, blocked ? 1 : 0, token);
+	}
+	return description;
+}
+
+RiskGate::RiskGate(const SymbolRiskLimits& symbol, const ParticipantRiskLimits* participants)
+	: symbol_{ &symbol }, participants_{ participants }, exposures_(RiskLimits::MaxParticipants)
+{ }
+
+RiskCheck RiskGate::Check(ParticipantId participant, OrderType orderType, Side side, Price price, Quantity quantity, OrderId replaces) const {
+	const ParticipantRiskLimits& limits = participants_[participant];
+	if (limits.blocked_.load(memory_order_relaxed))
+		return RiskCheck::Blocked;
+
+	const Quantity maxQuantity = symbol_->maxOrderQuantity_.load(memory_order_relaxed);
+	const Quantity participantMaxQuantity = limits.maxOrderQuantity_.load(memory_order_relaxed);
+	if ((maxQuantity && quantity > maxQuantity) || (participantMaxQuantity && quantity > participantMaxQuantity))
+		return RiskCheck::OrderQuantity;
+
+	// a market order carries no price, it is valued at the last trade and has no band to stay in
+	// before the first trade there is nothing to value it at, and a notional limit turns it away
+	const bool market = orderType == OrderType::Market;
+	const int64_t maxNotional = symbol_->maxOrderNotional_.load(memory_order_relaxed);
+	if (maxNotional && ((market && !lastPrice_) || static_cast<int64_t>(market ? lastPrice_ : price) * quantity > maxNotional))
+		return RiskCheck::OrderNotional;
+
+	const Price band = symbol_->priceBand_.load(memory_order_relaxed);
+	if (band && lastPrice_ && !market && abs(static_cast<int64_t>(price) - lastPrice_) > band)
+		return RiskCheck::PriceBand;
+
+	const int64_t maxPosition = limits.maxPosition_.load(memory_order_relaxed);
+	if (maxPosition) {
+		const Exposure& exposure = exposures_[participant];
+		int64_t openBuys = exposure.openBuys_;
+		int64_t openSells = exposure.openSells_;
+		if (const OpenOrder* replaced = replaces ? openOrders_.Find(replaces) : nullptr)
+			(replaced->side_ == Side::Buy ? openBuys : openSells) -= replaced->remaining_;
+
+		const int64_t worst = side == Side::Buy
+			? exposure.position_ + openBuys + quantity
+			: openSells + quantity - exposure.position_;
+		if (worst > maxPosition)
+			return RiskCheck::Position;
+	}
+	return RiskCheck::Passed;
+}
+
+bool RiskGate::Owns(ParticipantId participant, OrderId orderId) const {
+	const OpenOrder* order = participant != 0 ? openOrders_.Find(orderId) : nullptr;
+	return order && order->participant_ == participant;
+}
+
+void RiskGate::Open(ParticipantId participant, OrderId orderId, OrderType orderType, Side side, Quantity quantity) {
+	if (!openOrders_.Insert(orderId, OpenOrder{ participant, side, quantity }))
+		return;
+	Exposure& exposure = exposures_[participant];
+	(side == Side::Buy ? exposure.openBuys_ : exposure.openSells_) += quantity;
+	if (orderType == OrderType::GoodForDay)
+		goodForDayOrders_.push_back(orderId);
+}
+
+void RiskGate::Close(OrderId orderId) {
+	if (auto order = openOrders_.Take(orderId)) {
+		Exposure& exposure = exposures_[order->participant_];
+		(order->side_ == Side::Buy ? exposure.openBuys_ : exposure.openSells_) -= order->remaining_;
+	}
+}
+
+void RiskGate::Fill(OrderId orderId, Quantity quantity) {
+	OpenOrder* order = openOrders_.Find(orderId);
+	if (!order)
+		return;
+
+	Exposure& exposure = exposures_[order->participant_];
+	if (order->side_ == Side::Buy) {
+		exposure.position_ += quantity;
+		exposure.openBuys_ -= quantity;
+	}
+	else {
+		exposure.position_ -= quantity;
+		exposure.openSells_ -= quantity;
+	}
+	order->remaining_ -= quantity;
+	if (order->remaining_ == 0)
+		openOrders_.Erase(orderId);
+}
+
+void RiskGate::Observe(const Trades& trades) {
+	if (trades.empty())
+		return;
+	// most trades are between the simulator's own orders, two misses in a table that holds only client orders
+	if (openOrders_.Size() != 0) {
+		for (const auto& trade : trades) {
+			Fill(trade.GetBidTrade().orderId_, trade.GetBidTrade().quantity_);
+			Fill(trade.GetAskTrade().orderId_, trade.GetAskTrade().quantity_);
+		}
+	}
+	// not either side's reported price, an aggressive limit reports its own limit rather than where it traded
+	lastPrice_ = trades.back().GetPrice();
+}
+
+void RiskGate::Observe(const PreventedFill& prevented) {
+	OpenOrder* order = openOrders_.Find(prevented.orderId_);
+	if (!order)
+		return;
+
+	Exposure& exposure = exposures_[order->participant_];
+	(order->side_ == Side::Buy ? exposure.openBuys_ : exposure.openSells_) -= prevented.quantity_;
+	order->remaining_ -= prevented.quantity_;
+	if (order->remaining_ == 0)
+		openOrders_.Erase(prevented.orderId_);
+}
+
+void RiskGate::Expire(const OrderBook& book) {
+	erase_if(goodForDayOrders_, [&](OrderId orderId) {
+		if (book.Contains(orderId))
+			return false;
+		Close(orderId);
+		return true;
+	});
+}
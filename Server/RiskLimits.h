@@ -0,0 +1,106 @@
+#ifndef RISK_LIMITS_H
+#define RISK_LIMITS_H
+
+#include "common_includes.h"
+#include "OrderBook.h"
+#include <atomic>
+
+// outcome of the pre-trade checks on one order, the first limit it breaks
+enum class RiskCheck {
+	Passed,
+	Blocked,
+	OrderQuantity,
+	OrderNotional,
+	PriceBand,
+	Position
+};
+
+// limits of one symbol, zero disables a check
+// each field is stored on its own by the admin endpoint, so an order may see half of an update but never a torn value
+struct alignas(64) SymbolRiskLimits {
+	std::atomic<Quantity> maxOrderQuantity_{ 0 };
+	std::atomic<std::int64_t> maxOrderNotional_{ 0 };	// price times quantity, market orders are valued at the last trade and rejected before one
+	std::atomic<Price> priceBand_{ 0 };					// ticks either side of the last trade a limit price may be
+};
+
+// limits of one participant, applied in every symbol, zero disables a check
+struct alignas(64) ParticipantRiskLimits {
+	std::atomic<Quantity> maxOrderQuantity_{ 0 };
+	std::atomic<std::int64_t> maxPosition_{ 0 };		// per symbol, net position if every open order on one side filled
+	std::atomic<bool> blocked_{ false };				// rejects all new orders and modifies, cancels still go through
+	std::atomic<std::uint64_t> loginToken_{ 0 };		// a session that logs in with it trades as this participant, 0 allows no login
+};
+
+// every limit the order path reads, one cache line per symbol and per participant
+// entries are only made at startup, after that the tables never move and are read without locks
+class RiskLimits {
+private:
+	std::unordered_map<std::string, std::unique_ptr<SymbolRiskLimits>> symbols_;
+	std::unique_ptr<ParticipantRiskLimits[]> participants_;
+public:
+	static constexpr ParticipantId MaxParticipants = 4096;
+
+	RiskLimits();
+
+	// the entry for symbol, made on first use
+	SymbolRiskLimits& ForSymbol(const std::string& symbol);
+	const ParticipantRiskLimits* Participants() const;
+
+	// applies "symbol SYMBOL key=value..." or "participant ID key=value...", one relaxed store per key
+	// symbol keys are max_quantity, max_notional and price_band, participant keys max_quantity, max_position, blocked
+	// and token; a token must be unique and cannot be given to participant 0, the one sessions trade as before a login
+	// throws logic_error naming the first thing it does not understand, keys before it have been applied
+	void Set(std::string_view command);
+	// the participant token is the login token of, nullopt for 0 or a token no participant has
+	std::optional<ParticipantId> Login(std::uint64_t token) const;
+	// the symbols and the participants with any limit set, one line each in Set's syntax
+	std::string Describe() const;
+};
+
+// the pre-trade stage of one book, owned by the book's matching thread
+// it follows every client order from acceptance until it leaves the book, so a position check is one array read
+// and never a walk of the book: open quantity per side is added on Open and taken off as the order fills or goes
+class RiskGate {
+private:
+	struct Exposure {
+		std::int64_t position_{ 0 };	// bought minus sold
+		std::int64_t openBuys_{ 0 };
+		std::int64_t openSells_{ 0 };
+	};
+
+	struct OpenOrder {
+		ParticipantId participant_;
+		Side side_;
+		Quantity remaining_;
+	};
+
+	const SymbolRiskLimits* symbol_;
+	const ParticipantRiskLimits* participants_;
+	std::vector<Exposure> exposures_;				// indexed by participant
+	OrderIdIndex<OrderId, OpenOrder> openOrders_;	// client orders only, the simulator's are never checked
+	std::vector<OrderId> goodForDayOrders_;			// may hold ids already gone, like the book's own list
+	Price lastPrice_{ 0 };							// price of the book's last trade, 0 before the first
+
+	void Fill(OrderId orderId, Quantity quantity);
+public:
+	RiskGate(const SymbolRiskLimits& symbol, const ParticipantRiskLimits* participants);
+
+	// whether participant may send the order, a modify passes the id it replaces so its open quantity is not counted twice
+	RiskCheck Check(ParticipantId participant, OrderType orderType, Side side, Price price, Quantity quantity, OrderId replaces = 0) const;
+	// whether orderId is an open order of participant, the only orders it may cancel or modify
+	// never for participant 0: every session that has not logged in trades as it, and ids are handed out in sequence
+	bool Owns(ParticipantId participant, OrderId orderId) const;
+
+	// call before the order reaches the book, then Observe its trades and Close it unless it rests
+	void Open(ParticipantId participant, OrderId orderId, OrderType orderType, Side side, Quantity quantity);
+	// forgets an order that left the book without trading its remainder: cancelled, killed or replaced
+	void Close(OrderId orderId);
+	// every trade the book makes, client orders or not, fills the client orders on either side
+	void Observe(const Trades& trades);
+	// quantity self-trade prevention took off an order, it leaves the open quantity without a fill
+	void Observe(const PreventedFill& prevented);
+	// closes the good-for-day orders the book has expired
+	void Expire(const OrderBook& book);
+};
+
+#endif
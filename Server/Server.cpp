@@ -9,19 +9,40 @@
 
 //------------------------------------------------------------------------------
 //
-// Example: WebSocket server, asynchronous
+// Example: WebSocket server, C++20 coroutines
 //
 //------------------------------------------------------------------------------
 
 #include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
 #include <boost/beast/websocket.hpp>
-#include <boost/asio/dispatch.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/asio/strand.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <atomic>
+#include <charconv>
+#include <condition_variable>
 #include <cstdlib>
+#include <cstring>
 #include <functional>
+#include <mutex>
 #include <thread>
 #include "common_includes.h"
 #include "OrderBookManager.h"
+#include "Metrics.h"
+#include "EventClock.h"
+#include "ThreadConfig.h"
+#include "Backtest.h"
+#include "RiskBenchmark.h"
+#include "BookFuzz.h"
+#include "LevelBenchmark.h"
+#include "IndexBenchmark.h"
+#include "MetricsBenchmark.h"
+#include "ColumnarWriter.h"
 
 namespace beast = boost::beast;         // from <boost/beast.hpp>
 namespace http = beast::http;           // from <boost/beast/http.hpp>
@@ -31,8 +52,27 @@ using tcp = boost::asio::ip::tcp;       // from <boost/asio/ip/tcp.hpp>
 
 using namespace std;
 
+// Encoded market data, built once and shared by every session it is sent to
+using OutboundMessage = shared_ptr<const string>;
+
+// One message for the subscribers of one channel. A matching step hands all
+// of its publications to each session in a single post.
+struct publication
+{
+    Symbol channel;
+    OutboundMessage message;
+};
+using publications = shared_ptr<const vector<publication>>;
+
+// Separates the messages packed into one frame for clients that batch
+constexpr char record_separator = '\x1e';
+
+class session_registry;
+
 shared_ptr<OrderBookManager> orderBookManager;
-unique_ptr<vector<string>> clientSubList;
+shared_ptr<session_registry> sessionRegistry;
+shared_ptr<ColumnarWriter> columnarWriter;     // set when trades and depth are exported
+std::atomic<std::int64_t> deltaSubscriptions{ 0 };  // delta channels held by all sessions, none means no delta encoding
 
 //------------------------------------------------------------------------------
 
@@ -43,218 +83,768 @@ fail(beast::error_code ec, char const* what)
     std::cerr << what << ": " << ec.message() << "\n";
 }
 
-// Echoes back all received WebSocket messages
+// Formats trades once per match, the result is shared by all subscribers
+string
+format_trades(vector<Trade> const& trades)
+{
+    string tradesString{""};
+
+    for (auto const& trade : trades) {
+        tradesString += "Seq: ";
+        tradesString += to_string(trade.GetSequence());
+        tradesString += " Time: ";
+        tradesString += to_string(trade.GetTimestamp());
+        tradesString += " Bid: ";
+        tradesString += to_string(trade.GetBidTrade().orderId_);
+        tradesString += " Price: ";
+        tradesString += to_string(trade.GetBidTrade().price_);
+        tradesString += " Quantity: ";
+        tradesString += to_string(trade.GetBidTrade().quantity_);
+        tradesString += " | ";
+        tradesString += "Ask: ";
+        tradesString += to_string(trade.GetAskTrade().orderId_);
+        tradesString += " Price: ";
+        tradesString += to_string(trade.GetAskTrade().price_);
+        tradesString += " Quantity: ";
+        tradesString += to_string(trade.GetAskTrade().quantity_);
+        tradesString += ",";
+    }
+    return tradesString;
+}
+
+// Level updates go out on their own channel per symbol, next to the trades
+string
+book_channel(Symbol const& symbol)
+{
+    return "book:" + symbol;
+}
+
+// The same channel with delta encoded prices and timestamps
+string
+delta_channel(string const& channel)
+{
+    return "delta:" + channel;
+}
+
+// Fills and self-trade prevention of one participant's orders, only sessions
+// trading as that participant are subscribed to it
+string
+private_channel(ParticipantId participant)
+{
+    return "private:" + to_string(participant);
+}
+
+// Channel names are prefixed with "name:", so a symbol never holds a ':' and
+// no subscription command can name another participant's private channel.
+// The only private channel a session gets is its own, at login.
+bool
+is_symbol(std::string_view name)
+{
+    return !name.empty() && name.find(':') == std::string_view::npos;
+}
+
+// Per participant, "fill SYMBOL SEQUENCE ORDERID B|S PRICE QUANTITY TIMESTAMP"
+// for each side of a trade it owns and "prevented SYMBOL ORDERID QUANTITY
+// open|done" for quantity self-trade prevention took off one of its orders.
+// Public trades never carry owners, only these messages do.
+void
+format_private(Symbol const& symbol, std::vector<Trade> const& trades, PreventedFills const& prevented, std::map<ParticipantId, string>& messages)
+{
+    for (auto const& trade : trades)
+    {
+        for (auto const side : { Side::Buy, Side::Sell })
+        {
+            auto const& info = side == Side::Buy ? trade.GetBidTrade() : trade.GetAskTrade();
+            if (info.owner_ != 0)
+                format_to(back_inserter(messages[info.owner_]), "fill {} {} {} {} {} {} {}\n",
+                    symbol, trade.GetSequence(), info.orderId_, side == Side::Buy ? 'B' : 'S', info.price_, info.quantity_, trade.GetTimestamp());
+        }
+    }
+    for (auto const& p : prevented)
+        format_to(back_inserter(messages[p.owner_]), "prevented {} {} {} {}\n", symbol, p.orderId_, p.quantity_, p.cancelled_ ? "done" : "open");
+}
+
+// "update SYMBOL SEQUENCE" followed by one "B|A PRICE QUANTITY TIMESTAMP"
+// line per touched level. SEQUENCE belongs to the first line and each line
+// after it is numbered one higher.
+//
+// The delta form is headed "dupdate" and writes each line's price and
+// timestamp as the difference from the line before it, which turns most of
+// them into one or two digits.
+string
+format_level_updates(Symbol const& symbol, LevelUpdates const& updates, bool delta)
+{
+    string updatesString = format("{} {} {}\n", delta ? "dupdate" : "update", symbol, updates.front().sequence_);
+
+    int64_t price = 0;
+    int64_t timestamp = 0;
+    for (auto const& update : updates)
+    {
+        format_to(back_inserter(updatesString), "{} {} {} {}\n",
+            update.side_ == Side::Buy ? 'B' : 'A',
+            delta ? update.price_ - price : update.price_,
+            update.quantity_,
+            delta ? static_cast<int64_t>(update.timestamp_) - timestamp : static_cast<int64_t>(update.timestamp_));
+        price = update.price_;
+        timestamp = static_cast<int64_t>(update.timestamp_);
+    }
+    return updatesString;
+}
+
+// Order entry acks, one "ack TAG ORDERID ACTION FILLED open|done" or
+// "reject TAG ACTION REASON" line each
+string
+format_acks(OrderAcks const& acks)
+{
+    static constexpr char const* actions[] = { "new", "cancel", "modify" };
+    static constexpr char const* reasons[] = {
+        "accepted", "unknown-symbol", "unknown-order", "malformed",
+        "blocked", "max-quantity", "max-notional", "price-band", "position-limit" };
+
+    string acksString;
+    for (auto const& ack : acks)
+    {
+        char const* action = actions[static_cast<int>(ack.action_)];
+        if (ack.status_ == OrderStatus::Accepted)
+            format_to(back_inserter(acksString), "ack {} {} {} {} {}\n", ack.clientTag_, ack.orderId_, action, ack.filled_, ack.resting_ ? "open" : "done");
+        else
+            format_to(back_inserter(acksString), "reject {} {} {}\n", ack.clientTag_, action, reasons[static_cast<int>(ack.status_)]);
+    }
+    return acksString;
+}
+
+// Binary order entry record, little-endian, any number of them back to back
+// in one binary frame:
+//   0  u8       action       0 new, 1 cancel, 2 modify
+//   1  u8       side         0 buy, 1 sell
+//   2  u8       order type   0 gtc, 1 fak, 2 fok, 3 market, 4 gfd
+//   3  u8       reserved
+//   4  char[8]  symbol, NUL padded
+//  12  u64      client tag
+//  20  u64      order id, for cancel and modify
+//  28  i32      price
+//  32  u32      quantity
+constexpr std::size_t order_record_size = 36;
+
+template <class Number>
+bool
+parse_number(std::string_view field, Number& value)
+{
+    auto [last, errc] = std::from_chars(field.data(), field.data() + field.size(), value);
+    return errc == std::errc{} && last == field.data() + field.size();
+}
+
+// Serves one WebSocket client as two coroutines on the connection's strand:
+// the read loop handles options/subscribe/book/unsubscribe commands for as
+// long as the client stays connected, the write loop drains the outbound
+// queue. Plain HTTP requests on the same port are answered by the admin
+// endpoint.
 class session : public std::enable_shared_from_this<session>
 {
+    // A client this far behind is dropping messages rather than growing the queue
+    static constexpr std::size_t max_queued_messages = 4096;
+
+    // Limits on what a client may ask for with "options:"
+    static constexpr std::size_t max_batch_bytes = 1 << 20;
+    static constexpr std::chrono::microseconds max_linger{ 100'000 };
+
     websocket::stream<beast::tcp_stream> ws_;
     beast::flat_buffer buffer_;
+    net::steady_timer signal_;              // cancelled to wake the write loop, expires when a batch has lingered long enough
+    std::deque<OutboundMessage> queue_;
+    std::set<Symbol> subscriptions_;
+    bool open_ = true;
+
+    // Set by the client with "options:", each frame carries one message unless batching is on
+    std::size_t batch_bytes_ = 0;
+    std::chrono::microseconds linger_{ 0 };
+    bool delta_ = false;
+    SelfTradePrevention self_trade_prevention_ = SelfTradePrevention::None;
+
+    // Bound by "login:", the owner of every order the session sends
+    ParticipantId participant_ = 0;
+    bool ordered_ = false;                  // an order has been sent, the participant can no longer change
+
+    // The frame being written: the shared messages themselves, no copy is made
+    std::vector<OutboundMessage> batch_;
+    std::vector<net::const_buffer> frame_;
+
+    // Order entry requests of the frame being read, grouped by symbol
+    std::vector<std::pair<Symbol, std::vector<OrderRequest>>> orders_;
+    OrderAcks rejects_;
 
 public:
     // Take ownership of the socket
     explicit
         session(tcp::socket&& socket)
         : ws_(std::move(socket))
+        , signal_(ws_.get_executor(), net::steady_timer::time_point::max())
+    {
+    }
+
+    ~session()
     {
+        for (auto const& channel : subscriptions_)
+            if (channel.starts_with("delta:"))
+                deltaSubscriptions.fetch_sub(1);
     }
 
-    // Get on the correct executor
+    // Start serving on the connection's strand
     void
         run()
     {
-        // We need to be executing within a strand to perform async operations
-        // on the I/O objects in this session. Although not strictly necessary
-        // for single-threaded contexts, this example code is written to be
-        // thread-safe by default.
-        net::dispatch(ws_.get_executor(),
-            beast::bind_front_handler(
-                &session::on_run,
-                shared_from_this()));
+        net::co_spawn(
+            ws_.get_executor(),
+            [self = shared_from_this()] { return self->serve(); },
+            net::detached);
     }
 
-    // Start the asynchronous operation
+    // Queue the publications whose channel this client is subscribed to.
+    // Safe to call from any thread, the check and the queueing happen
+    // on the session's strand.
     void
-        on_run()
+        deliver(publications batch)
     {
+        net::post(
+            ws_.get_executor(),
+            [self = shared_from_this(), batch = std::move(batch)]
+            {
+                for (auto const& p : *batch)
+                    if (self->subscriptions_.contains(p.channel))
+                        self->enqueue(p.message);
+            });
+    }
+
+private:
+    // Order entry acks are never dropped, a client cannot have more of
+    // them outstanding than it sent requests
+    void
+        enqueue(OutboundMessage message, bool droppable = true)
+    {
+        if (droppable && queue_.size() >= max_queued_messages)
+        {
+            Metrics::Add(Counter::SlowConsumerDrops);
+            return;
+        }
+        queue_.push_back(std::move(message));
+        Metrics::Add(Counter::QueuedMessages);
+        signal_.cancel_one();
+    }
+
+    net::awaitable<void>
+        serve()
+    {
+        beast::error_code ec;
+
+        // Every connection starts as HTTP, websocket upgrades become market
+        // data sessions and anything else goes to the admin endpoint
+        http::request<http::string_body> req;
+        beast::get_lowest_layer(ws_).expires_after(std::chrono::seconds(30));
+        co_await http::async_read(ws_.next_layer(), buffer_, req, net::redirect_error(net::use_awaitable, ec));
+        if (ec)
+        {
+            fail(ec, "read");
+            co_return;
+        }
+        buffer_.consume(buffer_.size());
+
+        if (!websocket::is_upgrade(req))
+        {
+            co_await serve_admin(req);
+            co_return;
+        }
+
+        // The websocket stream runs its own timeouts from here on
+        beast::get_lowest_layer(ws_).expires_never();
+
         // Set suggested timeout settings for the websocket
         ws_.set_option(
             websocket::stream_base::timeout::suggested(
                 beast::role_type::server));
 
+        // Compress frames for clients that offer permessage-deflate in their
+        // handshake. A fast level, since every subscriber compresses its own
+        // stream; the window stays per connection for the best ratio on
+        // repetitive market data text.
+        websocket::permessage_deflate deflate;
+        deflate.server_enable = true;
+        deflate.compLevel = 3;
+        ws_.set_option(deflate);
+
         // Set a decorator to change the Server of the handshake
         ws_.set_option(websocket::stream_base::decorator(
             [](websocket::response_type& res)
             {
                 res.set(http::field::server,
                     std::string(BOOST_BEAST_VERSION_STRING) +
-                    " websocket-server-async");
+                    " websocket-server-coro");
             }));
+
         // Accept the websocket handshake
-        ws_.async_accept(
-            beast::bind_front_handler(
-                &session::on_accept,
-                shared_from_this()));
+        co_await ws_.async_accept(req, net::redirect_error(net::use_awaitable, ec));
+        if (ec)
+        {
+            fail(ec, "accept");
+            co_return;
+        }
+
+        net::co_spawn(
+            ws_.get_executor(),
+            [self = shared_from_this()] { return self->write_loop(); },
+            net::detached);
+
+        co_await read_loop();
+
+        // Stop the write loop, it exits once it sees the session closed
+        open_ = false;
+        signal_.cancel();
     }
 
-    void
-        on_accept(beast::error_code ec)
+    // GET /metrics from the local machine returns the runtime metrics, GET
+    // /risk the risk limits. POST /risk applies a body of limit lines such as
+    // "symbol META max_quantity=500 price_band=20" or "participant 7
+    // max_position=1000 blocked=0 token=4711", see RiskLimits::Set; a bad line is
+    // answered with 400 and the lines after it are not applied.
+    net::awaitable<void>
+        serve_admin(http::request<http::string_body> const& req)
     {
+        beast::error_code ec;
+        auto const remote = beast::get_lowest_layer(ws_).socket().remote_endpoint(ec);
+
+        http::response<http::string_body> res;
+        res.version(req.version());
+        res.keep_alive(false);
+        res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+        res.set(http::field::content_type, "text/plain");
+
+        if (ec || !remote.address().is_loopback())
+        {
+            res.result(http::status::forbidden);
+            res.body() = "admin endpoint is local only\n";
+        }
+        else if (req.method() == http::verb::get && req.target() == "/metrics")
+        {
+            res.result(http::status::ok);
+            res.body() = Metrics::Render();
+        }
+        else if (req.target() == "/risk" && (req.method() == http::verb::get || req.method() == http::verb::post))
+        {
+            RiskLimits& limits = orderBookManager->GetRiskLimits();
+            res.result(http::status::ok);
+            try
+            {
+                std::string_view body = req.body();
+                while (req.method() == http::verb::post && !body.empty())
+                {
+                    auto const end = std::min(body.find('\n'), body.size());
+                    if (body.substr(0, end).find_first_not_of(" \t\r") != std::string_view::npos)
+                        limits.Set(body.substr(0, end));
+                    body.remove_prefix(std::min(end + 1, body.size()));
+                }
+                res.body() = limits.Describe();
+            }
+            catch (std::logic_error const& e)
+            {
+                res.result(http::status::bad_request);
+                res.body() = std::string(e.what()) + "\n";
+            }
+        }
+        else
+        {
+            res.result(http::status::not_found);
+            res.body() = "not found\n";
+        }
+        res.prepare_payload();
+
+        co_await http::async_write(ws_.next_layer(), res, net::redirect_error(net::use_awaitable, ec));
         if (ec)
-            return fail(ec, "accept");
+            fail(ec, "write");
 
-        // Read a message
-        do_read();
+        beast::get_lowest_layer(ws_).socket().shutdown(tcp::socket::shutdown_send, ec);
     }
 
-    void
-        do_read()
+    net::awaitable<void>
+        read_loop()
     {
-        // Read a message into our buffer
-        ws_.async_read(
-            buffer_,
-            beast::bind_front_handler(
-                &session::on_read,
-                shared_from_this()));
+        beast::error_code ec;
+
+        for (;;)
+        {
+            co_await ws_.async_read(buffer_, net::redirect_error(net::use_awaitable, ec));
+
+            // This indicates that the session was closed
+            if (ec == websocket::error::closed)
+                co_return;
+
+            if (ec)
+            {
+                fail(ec, "read");
+                co_return;
+            }
+
+            // Several commands may share a frame, split by a record separator
+            auto const data = buffer_.data();
+            std::string_view frame(static_cast<char const*>(data.data()), data.size());
+            if (ws_.got_binary())
+            {
+                handle_binary_orders(frame);
+            }
+            else
+            {
+                while (!frame.empty())
+                {
+                    auto const end = std::min(frame.find(record_separator), frame.size());
+                    handle_command(frame.substr(0, end));
+                    frame.remove_prefix(std::min(end + 1, frame.size()));
+                }
+            }
+            submit_orders();
+            buffer_.consume(buffer_.size());
+        }
     }
 
-    void
-        on_read(
-            beast::error_code ec,
-            std::size_t bytes_transferred)
+    net::awaitable<void>
+        write_loop()
     {
-        boost::ignore_unused(bytes_transferred);
+        beast::error_code ec;
 
-        // This indicates that the session was closed
-        if (ec == websocket::error::closed)
-            return;
+        while (open_)
+        {
+            if (queue_.empty())
+            {
+                // Completes with operation_aborted when enqueue or serve cancels it
+                signal_.expires_at(net::steady_timer::time_point::max());
+                co_await signal_.async_wait(net::redirect_error(net::use_awaitable, ec));
+                continue;
+            }
 
-        if (ec)
-            return fail(ec, "read");
+            // How far behind this client is, sampled once per frame
+            Metrics::Record(Histogram::SessionQueueDepth, queue_.size());
+
+            // The shared messages stay alive in batch_ until the write completes
+            co_await fill_batch();
+
+            frame_.clear();
+            for (auto const& message : batch_)
+            {
+                if (!frame_.empty())
+                    frame_.push_back(net::buffer(&record_separator, 1));
+                frame_.push_back(net::buffer(*message));
+            }
 
-        string bufferAsString = beast::buffers_to_string(buffer_.data());
+            ws_.text(true);
+            std::size_t bytes = co_await ws_.async_write(frame_, net::redirect_error(net::use_awaitable, ec));
+            if (ec)
+            {
+                fail(ec, "write");
+                open_ = false;
+                co_return;
+            }
+            Metrics::Add(Counter::MessagesSent, static_cast<std::int64_t>(batch_.size()));
+            Metrics::Add(Counter::FramesSent);
+            Metrics::Add(Counter::BytesSent, static_cast<std::int64_t>(bytes));
+            batch_.clear();
+        }
+    }
 
+    // Moves queued messages into batch_ until they fill batch_bytes_ or the
+    // linger time since the first of them runs out, whichever comes first.
+    // Without batching that is always just the first message.
+    net::awaitable<void>
+        fill_batch()
+    {
+        beast::error_code ec;
+        auto const deadline = std::chrono::steady_clock::now() + linger_;
+        std::size_t bytes = 0;
+
+        for (;;)
+        {
+            do
+            {
+                bytes += queue_.front()->size() + 1;
+                batch_.push_back(std::move(queue_.front()));
+                queue_.pop_front();
+                Metrics::Add(Counter::QueuedMessages, -1);
+            } while (!queue_.empty() && bytes < batch_bytes_);
+
+            if (bytes >= batch_bytes_ || !open_ || std::chrono::steady_clock::now() >= deadline)
+                co_return;
+
+            // Woken early by enqueue, otherwise at the deadline
+            signal_.expires_at(deadline);
+            co_await signal_.async_wait(net::redirect_error(net::use_awaitable, ec));
+            if (queue_.empty())
+                co_return;
+        }
+    }
+
+    void
+        handle_command(std::string_view command)
+    {
         // "subscribe:SYMBOL"
-        if (bufferAsString.starts_with("subscribe")) {
-            string symbol = bufferAsString.substr(10);
-            if (orderBookManager->GetOrderBook(symbol)) {
-                clientSubList->push_back(symbol);
+        if (command.starts_with("subscribe:")) {
+            string symbol(command.substr(10));
+            if (is_symbol(symbol) && orderBookManager->GetOrderBook(symbol)) {
+                subscriptions_.insert(symbol);
                 write_snapshot(symbol);
             }
         }
-        // "unsubscribe:SYMBOL"
-        else if (bufferAsString.starts_with("unsubscribe")) {
-            string symbol = bufferAsString.substr(12);
-            auto it = find(clientSubList->begin(), clientSubList->end(), symbol);
-            if (it != clientSubList->end()) {
-                clientSubList->erase(it);
+        // "book:SYMBOL", a full levels snapshot followed by sequenced level updates.
+        // Sent again after a gap it resynchronises the client from a fresh snapshot.
+        else if (command.starts_with("book:")) {
+            string symbol(command.substr(5));
+            if (is_symbol(symbol) && orderBookManager->GetOrderBook(symbol)) {
+                if (delta_) {
+                    // Counted before the snapshot is taken, so the publisher
+                    // encodes every update the snapshot does not include
+                    if (subscriptions_.insert(delta_channel(book_channel(symbol))).second)
+                        deltaSubscriptions.fetch_add(1);
+                    write_snapshot(symbol, SnapshotEncoding::LevelsDelta);
+                }
+                else {
+                    subscriptions_.insert(book_channel(symbol));
+                    write_snapshot(symbol, SnapshotEncoding::Levels);
+                }
             }
         }
+        // "unsubscribe:SYMBOL" or "unsubscribe:book:SYMBOL"
+        else if (command.starts_with("unsubscribe:")) {
+            string channel(command.substr(12));
+            if (subscriptions_.erase(delta_channel(channel)))
+                deltaSubscriptions.fetch_sub(1);
+            subscriptions_.erase(channel);
+        }
+        // "options:batch=BYTES,linger=MICROSECONDS,delta=0|1,stp=0-3", any
+        // subset. delta applies to book subscriptions made after it, stp to
+        // the orders sent after it. stp is the self-trade prevention against
+        // the participant's own orders: 0 none, 1 cancel resting, 2 cancel
+        // aggressor, 3 decrement both.
+        else if (command.starts_with("options:")) {
+            handle_options(command.substr(8));
+        }
+        // "login:TOKEN", trades as the participant the risk limits give that
+        // token, see RiskLimits::Set. Risk limits and order ownership are per
+        // participant, and a logged in participant gets its fills on the
+        // private channel. Without a login a session can only send new
+        // orders, its cancels and modifies are rejected as unknown-order. Answered "login ID", or "login rejected" for an
+        // unknown token or once the session has sent an order.
+        else if (command.starts_with("login:")) {
+            handle_login(command.substr(6));
+        }
+        else if (command.starts_with("new:")) {
+            handle_order(OrderAction::New, command.substr(4));
+        }
+        else if (command.starts_with("cancel:")) {
+            handle_order(OrderAction::Cancel, command.substr(7));
+        }
+        else if (command.starts_with("modify:")) {
+            handle_order(OrderAction::Modify, command.substr(7));
+        }
     }
 
+    // "new:SYMBOL,TAG,B|S,PRICE,QUANTITY[,gtc|fak|fok|market|gfd]"
+    // "cancel:SYMBOL,TAG,ORDERID"
+    // "modify:SYMBOL,TAG,ORDERID,B|S,PRICE,QUANTITY"
+    // TAG is the client's own number for the request, echoed in its ack
     void
-        do_write()
+        handle_order(OrderAction action, std::string_view fields)
     {
-        // Echo the message
-        ws_.text(ws_.got_text());
-        ws_.async_write(
-            buffer_.data(),
-            beast::bind_front_handler(
-                &session::on_write,
-                shared_from_this()));
+        auto next = [&fields]
+        {
+            auto const end = std::min(fields.find(','), fields.size());
+            auto const field = fields.substr(0, end);
+            fields.remove_prefix(std::min(end + 1, fields.size()));
+            return field;
+        };
+
+        OrderRequest request{ action, OrderType::GoodTillCancel, Side::Buy, 0, 0, 0, 0, 0, SelfTradePrevention::None };
+        std::string_view const symbol = next();
+        bool valid = parse_number(next(), request.clientTag_);
+        if (action != OrderAction::New)
+            valid = valid && parse_number(next(), request.orderId_);
+        if (action != OrderAction::Cancel)
+        {
+            std::string_view const side = next();
+            valid = valid && (side == "B" || side == "S")
+                && parse_number(next(), request.price_) && parse_number(next(), request.quantity_);
+            request.side_ = side == "S" ? Side::Sell : Side::Buy;
+        }
+        if (action == OrderAction::New && !fields.empty())
+        {
+            static constexpr std::string_view types[] = { "gtc", "fak", "fok", "market", "gfd" };
+            auto const type = std::find(std::begin(types), std::end(types), next());
+            valid = valid && type != std::end(types);
+            request.orderType_ = static_cast<OrderType>(type - std::begin(types));
+        }
+        queue_order(symbol, request, valid && fields.empty());
     }
+
     void
-        on_write(
-            beast::error_code ec,
-            std::size_t bytes_transferred)
+        handle_binary_orders(std::string_view frame)
     {
-        boost::ignore_unused(bytes_transferred);
+        if (frame.size() % order_record_size != 0)
+        {
+            queue_order({}, OrderRequest{}, false);
+            return;
+        }
 
-        if (ec)
-            return fail(ec, "write");
+        for (; !frame.empty(); frame.remove_prefix(order_record_size))
+        {
+            auto const* record = reinterpret_cast<unsigned char const*>(frame.data());
+            OrderRequest request{};
+            std::memcpy(&request.clientTag_, record + 12, 8);
+            std::memcpy(&request.orderId_, record + 20, 8);
+            std::memcpy(&request.price_, record + 28, 4);
+            std::memcpy(&request.quantity_, record + 32, 4);
+            request.action_ = static_cast<OrderAction>(record[0]);
+            request.side_ = record[1] ? Side::Sell : Side::Buy;
+            request.orderType_ = static_cast<OrderType>(record[2]);
+
+            std::string_view symbol(frame.data() + 4, 8);
+            symbol = symbol.substr(0, symbol.find('\0'));
+            queue_order(symbol, request, record[0] <= 2 && record[1] <= 1 && record[2] <= 4);
+        }
     }
+
     void
-        write_trades(vector<Trade> trades)
+        queue_order(std::string_view symbol, OrderRequest const& request, bool valid)
     {
-        // Clear the buffer
-        buffer_.consume(buffer_.size());
+        ordered_ = true;
+        if (!valid || (request.action_ != OrderAction::Cancel && request.quantity_ == 0))
+        {
+            rejects_.push_back({ request.action_, OrderStatus::Malformed, request.clientTag_, 0, 0, false });
+            return;
+        }
 
-        // write trades to buffer
-        string tradesString{""};
-
-        for (auto trade : trades) {
-            tradesString += "Bid: ";
-            tradesString += to_string(trade.GetBidTrade().orderId_);
-            tradesString += " Price: ";
-            tradesString += to_string(trade.GetBidTrade().price_);
-            tradesString += " Quantity: ";
-            tradesString += to_string(trade.GetBidTrade().quantity_);
-            tradesString += " | ";
-            tradesString += "Ask: ";
-            tradesString += to_string(trade.GetAskTrade().orderId_);
-            tradesString += " Price: ";
-            tradesString += to_string(trade.GetAskTrade().price_);
-            tradesString += " Quantity: ";
-            tradesString += to_string(trade.GetAskTrade().quantity_);
-            tradesString += ",";
-        }
-
-        // Allocate space in the buffer
-        auto size = tradesString.size();
-        auto buffer_space = buffer_.prepare(size);
-        // Copy the data into the buffer
-        memcpy(buffer_space.data(), tradesString.data(), size);
-        // Commit the data to the buffer
-        buffer_.commit(size);
-
-        ws_.async_write(
-            buffer_.data(),
-            beast::bind_front_handler(
-                &session::on_write,
-                shared_from_this()));
+        auto group = std::find_if(orders_.begin(), orders_.end(), [symbol](auto const& g) { return g.first == symbol; });
+        if (group == orders_.end())
+            group = orders_.emplace(orders_.end(), Symbol(symbol), std::vector<OrderRequest>{});
+        group->second.push_back(request);
+        group->second.back().participant_ = participant_;
+        group->second.back().selfTradePrevention_ = self_trade_prevention_;
     }
+
+    // Hands the requests of the frame just read to the matching threads, one
+    // batch per symbol, and answers the ones that never get that far
     void
-        write_snapshot(Symbol symbol)
+        submit_orders()
     {
-        shared_ptr<OrderBook> orderBook = orderBookManager->GetOrderBook(symbol);
-        size_t orderBookDepth = orderBookManager->GetOrderBookDepth(symbol);
+        for (auto& [symbol, requests] : orders_)
+        {
+            OrderBatch batch{ std::move(requests), {} };
+            batch.reply_ = [self = shared_from_this()](OrderAcks acks)
+            {
+                net::post(
+                    self->ws_.get_executor(),
+                    [self, acks = std::move(acks)]
+                    {
+                        self->enqueue(make_shared<const string>(format_acks(acks)), false);
+                    });
+            };
+            if (!orderBookManager->SubmitOrders(symbol, std::move(batch)))
+            {
+                for (auto const& request : batch.requests_)
+                    rejects_.push_back({ request.action_, OrderStatus::UnknownSymbol, request.clientTag_, 0, 0, false });
+            }
+        }
+        orders_.clear();
 
-        // we have our orderbook for a certain symbol, we now need to make a snapshot to send to client
-        // orderBookDepth has the number of levels on the bids and asks that we will desseminate to client
-        OrderBookLevelInfos levelInfos = orderBook->GetOrderInfos();
+        if (!rejects_.empty())
+        {
+            enqueue(make_shared<const string>(format_acks(rejects_)), false);
+            rejects_.clear();
+        }
+    }
 
-        const LevelInfos& BidLevelInfos = levelInfos.GetBids();
-        const LevelInfos& AskLevelInfos = levelInfos.GetAsks();
+    void
+        handle_options(std::string_view options)
+    {
+        while (!options.empty())
+        {
+            auto const end = std::min(options.find(','), options.size());
+            auto const option = options.substr(0, end);
+            options.remove_prefix(std::min(end + 1, options.size()));
 
-        orderBookDepth = min(orderBookDepth, BidLevelInfos.size());
-        orderBookDepth = min(orderBookDepth, AskLevelInfos.size());
+            auto const equals = option.find('=');
+            if (equals == std::string_view::npos)
+                continue;
+            auto const name = option.substr(0, equals);
+            auto const value = option.substr(equals + 1);
 
-        string snapshot = format(" {}    \t\t  {}   \n", "Bids", "Asks");
-        
-        size_t counter = 0;
-        while (counter < orderBookDepth) {
-            BidLevelInfos[counter].price_;
-            BidLevelInfos[counter].quantity_;
+            std::uint64_t number;
+            auto [last, errc] = std::from_chars(value.data(), value.data() + value.size(), number);
+            if (errc != std::errc{} || last != value.data() + value.size())
+                continue;
 
-            AskLevelInfos[counter].price_;
-            AskLevelInfos[counter].quantity_;
+            if (name == "batch")
+                batch_bytes_ = std::min<std::size_t>(number, max_batch_bytes);
+            else if (name == "linger")
+                linger_ = std::min(std::chrono::microseconds(number), max_linger);
+            else if (name == "delta")
+                delta_ = number != 0;
+            else if (name == "stp" && number <= 3)
+                self_trade_prevention_ = static_cast<SelfTradePrevention>(number);
+        }
+    }
 
-            snapshot += format("${}:{} \t\t ${}:{}\n", to_string(BidLevelInfos[counter].price_), to_string(BidLevelInfos[counter].quantity_), to_string(AskLevelInfos[counter].price_), to_string(AskLevelInfos[counter].quantity_));
-            counter++;
+    void
+        handle_login(std::string_view token)
+    {
+        std::uint64_t number = 0;
+        std::optional<ParticipantId> participant;
+        if (!ordered_ && parse_number(token, number))
+            participant = orderBookManager->GetRiskLimits().Login(number);
+        if (!participant)
+        {
+            enqueue(make_shared<const string>("login rejected\n"), false);
+            return;
         }
 
-        // now desseminate snapshot
-        // Allocate space in the buffer
-        auto size = snapshot.size();
-        auto buffer_space = buffer_.prepare(size);
-        // Copy the data into the buffer
-        memcpy(buffer_space.data(), snapshot.data(), size);
-        // Commit the data to the buffer
-        buffer_.commit(size);
+        subscriptions_.erase(private_channel(participant_));
+        participant_ = *participant;
+        subscriptions_.insert(private_channel(participant_));
+        enqueue(make_shared<const string>(format("login {}\n", participant_)), false);
+    }
 
-        ws_.async_write(
-            buffer_.data(),
-            beast::bind_front_handler(
-                &session::on_write,
-                shared_from_this()));
+    void
+        write_snapshot(Symbol symbol, SnapshotEncoding encoding = SnapshotEncoding::Text)
+    {
+        // the encoded snapshot is shared with every other subscriber of this symbol
+        // until the book changes, so there is nothing to format or copy here
+        SnapshotBuffer snapshot = orderBookManager->GetSnapshot(symbol, encoding);
+        if (snapshot)
+            enqueue(std::move(snapshot));
+    }
+};
+
+// Sessions that published market data fans out to
+class session_registry
+{
+    std::mutex mutex_;
+    std::vector<std::weak_ptr<session>> sessions_;
+
+public:
+    void
+        add(std::weak_ptr<session> s)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        sessions_.push_back(std::move(s));
+        Metrics::Set(Gauge::Sessions, static_cast<std::int64_t>(sessions_.size()));
+    }
+
+    // Hand the publications to every live session, each one filters on its own subscriptions
+    void
+        publish(publications const& batch)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::erase_if(sessions_, [](std::weak_ptr<session> const& s) { return s.expired(); });
+        Metrics::Set(Gauge::Sessions, static_cast<std::int64_t>(sessions_.size()));
+
+        for (auto const& weak : sessions_)
+        {
+            if (auto s = weak.lock())
+                s->deliver(batch);
+        }
     }
 };
 
@@ -315,12 +905,8 @@ public:
     {
         do_accept();
     }
-    shared_ptr<session> getSession() {
-        return session_;
-    }
 
 private:
-    shared_ptr<session> session_;
     void
         do_accept()
     {
@@ -341,9 +927,10 @@ private:
         }
         else
         {
-            // Create the session and run it
-            session_ = std::make_shared<session>(std::move(socket));
-            session_->run();
+            // Create the session, make it reachable for publishing and run it
+            auto s = std::make_shared<session>(std::move(socket));
+            sessionRegistry->add(s);
+            s->run();
         }
 
         // Accept another connection
@@ -353,54 +940,400 @@ private:
 
 //------------------------------------------------------------------------------
 
+// What one matching step produced for one symbol
+struct book_events
+{
+    Symbol symbol;
+    std::vector<Trade> trades;
+    LevelUpdates levelUpdates;
+    std::optional<OrderBookLevelInfos> depth;   // top levels after the step, only taken for the export
+    PreventedFills prevented;
+};
+
+// Hands book events from the matching threads to one publisher thread. A
+// matcher only appends under a short lock, encoding and the fan-out to the
+// sessions happen on the publisher. A spinning publisher polls the pending
+// flag instead of sleeping on the condition variable.
+class publish_queue
+{
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::vector<book_events> events_;
+    std::atomic<bool> pending_{ false };
+    bool spin_;
+
+public:
+    explicit
+        publish_queue(bool spin)
+        : spin_(spin)
+    {
+    }
+
+    void
+        push(book_events events)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            events_.push_back(std::move(events));
+            pending_.store(true, std::memory_order_release);
+        }
+        if (!spin_)
+            ready_.notify_one();
+    }
+
+    // Waits for events and swaps all of them into events
+    void
+        take(std::vector<book_events>& events)
+    {
+        events.clear();
+        if (spin_)
+        {
+            while (!pending_.load(std::memory_order_acquire))
+                ThreadConfig::Pause();
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait(lock, [this] { return !events_.empty(); });
+        events_.swap(events);
+        pending_.store(false, std::memory_order_relaxed);
+    }
+};
+
+// Encodes the events of its queue and publishes them. Each symbol is
+// served by one publisher, so its messages keep their sequence order.
+void
+run_publisher(publish_queue& queue)
+{
+    std::vector<book_events> events;
+    for (;;)
+    {
+        queue.take(events);
+
+        // Everything taken reaches each session in one post. Read after the
+        // take, a session counted too late already has these updates in its
+        // snapshot.
+        bool const delta = deltaSubscriptions.load() != 0;
+        vector<publication> batch;
+        std::map<ParticipantId, string> privateMessages;
+        for (auto const& e : events)
+        {
+            if (columnarWriter)
+            {
+                columnarWriter->AppendTrades(e.symbol, e.trades);
+                if (e.depth)
+                    columnarWriter->AppendDepth(e.symbol, e.levelUpdates.back().sequence_, e.levelUpdates.back().timestamp_, *e.depth);
+            }
+
+            if (!e.trades.empty())
+                batch.push_back({ e.symbol, make_shared<const string>(format_trades(e.trades)) });
+            if (!e.levelUpdates.empty())
+            {
+                Symbol const channel = book_channel(e.symbol);
+                batch.push_back({ channel, make_shared<const string>(format_level_updates(e.symbol, e.levelUpdates, false)) });
+                if (delta)
+                    batch.push_back({ delta_channel(channel), make_shared<const string>(format_level_updates(e.symbol, e.levelUpdates, true)) });
+            }
+            format_private(e.symbol, e.trades, e.prevented, privateMessages);
+        }
+        for (auto& [participant, message] : privateMessages)
+            batch.push_back({ private_channel(participant), make_shared<const string>(std::move(message)) });
+        if (!batch.empty())
+            sessionRegistry->publish(make_shared<const vector<publication>>(std::move(batch)));
+    }
+}
+
+// Drives the books of one matching shard. Client orders are applied as
+// soon as they arrive, the simulator's own random order every interval. A
+// spinning shard never gives up its core while it waits, so it is not
+// descheduled behind an I/O thread when the next order comes in.
+void
+run_matching(
+    std::vector<Symbol> const& symbols,
+    std::vector<publish_queue*> const& publishers,
+    std::shared_ptr<OrderSignal> signal,
+    std::chrono::microseconds interval,
+    bool resync)
+{
+    std::vector<shared_ptr<OrderBook>> books;
+    std::vector<shared_ptr<mutex>> mutexes;
+    std::vector<shared_ptr<OrderInbox>> inboxes;
+    std::vector<std::size_t> depths;
+    for (auto const& symbol : symbols)
+    {
+        books.push_back(orderBookManager->GetOrderBook(symbol));
+        mutexes.push_back(orderBookManager->GetOrderBookMutex(symbol));
+        inboxes.push_back(orderBookManager->GetOrderInbox(symbol));
+        depths.push_back(orderBookManager->GetOrderBookDepth(symbol));
+    }
+
+    // This shard's share of the book gauges, which sum over all shards
+    std::int64_t reportedOrders = 0;
+    std::int64_t reportedLevels = 0;
+
+    auto next = chrono::steady_clock::now();
+    for (;;)
+    {
+        // Steers the event clock back onto the system clock about once a second
+        if (resync)
+            EventClock::Resync();
+
+        bool const step = chrono::steady_clock::now() >= next;
+        std::int64_t orders = 0;
+        std::int64_t levels = 0;
+        for (std::size_t i = 0; i < books.size(); ++i)
+        {
+            book_events events{ symbols[i], {}, {}, std::nullopt, {} };
+            {
+                lock_guard<mutex> lock(*mutexes[i]);
+                std::size_t const received = inboxes[i]->Drain(*books[i], events.trades);
+
+                if (step)
+                {
+                    // The gate's good-for-day list is pruned at every close, even
+                    // one that found no order left to expire
+                    auto const sessionClose = books[i]->GetSessionClose();
+                    books[i]->ExpireOrders(chrono::system_clock::now());
+                    if (books[i]->GetSessionClose() != sessionClose)
+                        inboxes[i]->Expire(*books[i]);
+
+                    auto const matchStart = chrono::steady_clock::now();
+                    Trades trades = books[i]->GenerateRandomOrder();
+                    Metrics::Record(Histogram::MatchLatency, static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - matchStart).count()));
+                    inboxes[i]->Observe(trades);
+                    events.trades.insert(events.trades.end(), trades.begin(), trades.end());
+                }
+
+                Metrics::Add(Counter::OrdersReceived, static_cast<int64_t>(received + step));
+                Metrics::Add(Counter::Trades, static_cast<int64_t>(events.trades.size()));
+                orders += static_cast<int64_t>(books[i]->Size());
+                levels += static_cast<int64_t>(books[i]->LevelCount());
+
+                books[i]->TakeLevelUpdates(events.levelUpdates);
+                books[i]->TakePreventedFills(events.prevented);
+                if (columnarWriter && !events.levelUpdates.empty())
+                    events.depth = books[i]->GetOrderInfos(depths[i]);
+            }
+            if (!events.trades.empty() || !events.levelUpdates.empty() || !events.prevented.empty())
+                publishers[i]->push(std::move(events));
+        }
+        Metrics::Adjust(Gauge::BookOrders, orders - reportedOrders);
+        Metrics::Adjust(Gauge::BookLevels, levels - reportedLevels);
+        reportedOrders = orders;
+        reportedLevels = levels;
+
+        // A shard that fell behind starts counting again rather than catching up in a burst
+        if (step)
+            next = std::max(next + interval, chrono::steady_clock::now());
+        signal->WaitUntil(next);
+    }
+}
+
+//------------------------------------------------------------------------------
+
 int main(int argc, char* argv[])
 {
+    // Offline modes, no sockets: replay event files, or make some to replay
+    if ((argc == 4 || argc == 5) && std::string(argv[1]) == "--backtest")
+    {
+        auto const threads = argc == 5 ? std::max(1, std::atoi(argv[4])) : std::max(1u, std::thread::hardware_concurrency());
+        return Backtest::Run(argv[2], argv[3], static_cast<std::size_t>(threads));
+    }
+    if (argc == 5 && std::string(argv[1]) == "--generate-events")
+    {
+        auto const symbols = static_cast<std::size_t>(std::max(1, std::atoi(argv[3])));
+        auto const events = static_cast<std::size_t>(std::max(1, std::atoi(argv[4])));
+        return Backtest::GenerateEvents(argv[2], symbols, events);
+    }
+    if (argc == 3 && std::string(argv[1]) == "--bench-risk")
+        return RiskBenchmark::Run(static_cast<std::size_t>(std::max(1, std::atoi(argv[2]))));
+    if (argc == 4 && std::string(argv[1]) == "--bench-levels")
+        return LevelBenchmark::Run(static_cast<std::size_t>(std::max(1, std::atoi(argv[2]))), static_cast<std::size_t>(std::max(1, std::atoi(argv[3]))));
+    if (argc == 3 && std::string(argv[1]) == "--bench-index")
+        return IndexBenchmark::Run(static_cast<std::size_t>(std::max(1, std::atoi(argv[2]))));
+    if (argc == 3 && std::string(argv[1]) == "--bench-metrics")
+        return MetricsBenchmark::Run(static_cast<std::size_t>(std::max(1, std::atoi(argv[2]))));
+    if ((argc == 5 || argc == 6) && std::string(argv[1]) == "--fuzz-book")
+    {
+        auto const runs = static_cast<std::size_t>(std::max(1, std::atoi(argv[3])));
+        auto const steps = static_cast<std::size_t>(std::max(1, std::atoi(argv[4])));
+        auto const threads = argc == 6 ? std::max(1, std::atoi(argv[5])) : std::max(1u, std::thread::hardware_concurrency());
+        return BookFuzz::Run(std::strtoull(argv[2], nullptr, 10), runs, steps, static_cast<std::size_t>(threads));
+    }
+
     // Check command line arguments.
-    if (argc != 4)
+    if (argc < 4)
     {
         std::cerr <<
-            "Usage: websocket-server-async <address> <port> <threads>\n" <<
+            "Usage: websocket-server-async <address> <port> <threads> [symbols=<list>] [export=<directory>] [config=<file>] [<role>.<key>=<value> ...]\n" <<
+            "  <list> is a comma separated list of the symbols to make books for, META by default\n" <<
+            "  <threads> is the number of I/O threads, io.count overrides it\n" <<
+            "  export writes every trade and a top levels snapshot after every book change to columnar files\n" <<
+            "  roles: matching, publisher, io\n" <<
+            "  keys: count, cpus=<list>, spin=0|1, priority=<1-99>, and matching.interval=<microseconds>\n" <<
+            "       websocket-server-async --backtest <input directory> <output directory> [threads]\n" <<
+            "       websocket-server-async --generate-events <directory> <symbols> <events per symbol>\n" <<
+            "       websocket-server-async --bench-risk <orders>\n" <<
+            "       websocket-server-async --bench-levels <levels> <orders per level>\n" <<
+            "       websocket-server-async --bench-index <operations>\n" <<
+            "       websocket-server-async --bench-metrics <orders>\n" <<
+            "       websocket-server-async --fuzz-book <seed> <runs> <steps per run> [threads]\n" <<
             "Example:\n" <<
-            "    websocket-server-async 0.0.0.0 8080 1\n";
+            "    websocket-server-async 0.0.0.0 8080 1\n" <<
+            "    websocket-server-async 0.0.0.0 8080 4 symbols=META,AAPL,MSFT matching.count=2 matching.cpus=2 matching.spin=1 matching.priority=80 publisher.cpus=3 io.cpus=4-7\n" <<
+            "    websocket-server-async --generate-events day 2000 100000\n" <<
+            "    websocket-server-async --backtest day out 8\n" <<
+            "    websocket-server-async --bench-risk 2000000\n" <<
+            "    websocket-server-async --bench-levels 1000 1000\n" <<
+            "    websocket-server-async --bench-index 10000000\n" <<
+            "    websocket-server-async --bench-metrics 2000000\n" <<
+            "    websocket-server-async --fuzz-book 1 1000 5000\n";
         return EXIT_FAILURE;
     }
     auto const address = net::ip::make_address(argv[1]);
     auto const port = static_cast<unsigned short>(std::atoi(argv[2]));
-    auto const threads = std::max<int>(1, std::atoi(argv[3]));
+
+    // Settings apply in order, so later ones override a config file
+    ThreadConfig config;
+    config.Get(ThreadRole::Io).count_ = std::max<int>(1, std::atoi(argv[3]));
+    std::vector<Symbol> symbols{ "META" };
+    std::string exportDirectory;
+    try
+    {
+        for (int i = 4; i < argc; ++i)
+        {
+            std::string const setting = argv[i];
+            if (setting.starts_with("symbols="))
+            {
+                symbols.clear();
+                for (std::string_view list = std::string_view(setting).substr(8); !list.empty();)
+                {
+                    auto const end = std::min(list.find(','), list.size());
+                    Symbol const symbol(list.substr(0, end));
+                    if (!symbol.empty() && !is_symbol(symbol))
+                        throw std::logic_error(format("Symbol ({}) cannot hold a ':', it separates channel names.", symbol));
+                    if (!symbol.empty() && std::find(symbols.begin(), symbols.end(), symbol) == symbols.end())
+                        symbols.push_back(symbol);
+                    list.remove_prefix(std::min(end + 1, list.size()));
+                }
+                if (symbols.empty())
+                    throw std::logic_error("symbols= needs at least one symbol.");
+            }
+            else if (setting.starts_with("export="))
+                exportDirectory = setting.substr(7);
+            else if (setting.starts_with("config="))
+                config.Load(setting.substr(7));
+            else
+                config.Set(setting);
+        }
+    }
+    catch (std::logic_error const& e)
+    {
+        std::cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    if (!exportDirectory.empty())
+    {
+        try
+        {
+            columnarWriter = make_shared<ColumnarWriter>(exportDirectory);
+        }
+        catch (std::logic_error const& e)
+        {
+            std::cerr << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Book events are stamped from the TSC once it is calibrated
+    EventClock::Calibrate();
+
+    orderBookManager = make_shared<OrderBookManager>();
+    sessionRegistry = make_shared<session_registry>();
+
+    // good-for-day orders expire at the next 21:00 UTC session close
+    auto const now = chrono::system_clock::now();
+    auto sessionClose = chrono::floor<chrono::days>(now) + chrono::hours(21);
+    if (sessionClose <= now)
+        sessionClose += chrono::days(1);
+    orderBookManager->SetSessionClose(sessionClose);
+
+    for (auto const& symbol : symbols)
+        orderBookManager->AddSymbol(symbol, 5);
+
+    // Symbols are dealt round robin to the matching shards and, separately,
+    // to the publishers. A role gets no more threads than there are symbols.
+    ThreadRoleSettings const& matching = config.Get(ThreadRole::Matching);
+    ThreadRoleSettings const& publishing = config.Get(ThreadRole::Publisher);
+    ThreadRoleSettings const& io = config.Get(ThreadRole::Io);
+    int const shards = std::min<int>(matching.count_, static_cast<int>(symbols.size()));
+    int const publishers = std::min<int>(publishing.count_, static_cast<int>(symbols.size()));
+
+    std::vector<std::unique_ptr<publish_queue>> queues;
+    for (int i = 0; i < publishers; ++i)
+        queues.push_back(std::make_unique<publish_queue>(publishing.busySpin_));
+
+    // Orders for a book wake the shard that owns it. The inboxes know their
+    // signal before the first session can submit to them.
+    std::vector<std::vector<Symbol>> shardSymbols(shards);
+    std::vector<std::vector<publish_queue*>> shardQueues(shards);
+    std::vector<std::shared_ptr<OrderSignal>> shardSignals;
+    for (int i = 0; i < shards; ++i)
+        shardSignals.push_back(std::make_shared<OrderSignal>(matching.busySpin_));
+    for (std::size_t i = 0; i < symbols.size(); ++i)
+    {
+        shardSymbols[i % shards].push_back(symbols[i]);
+        shardQueues[i % shards].push_back(queues[i % publishers].get());
+        orderBookManager->GetOrderInbox(symbols[i])->SetSignal(shardSignals[i % shards]);
+    }
+
+    std::cerr << "threads: " << config.Describe() << "\n";
 
     // The io_context is required for all I/O
-    net::io_context ioc{ threads };
+    net::io_context ioc{ io.count_ };
 
     // Create and launch a listening port
     shared_ptr<listener> listener_ = std::make_shared<listener>(ioc, tcp::endpoint{ address, port });
     listener_->run();
 
-    // Run the I/O service on the requested number of threads
+    // Run the I/O service on the requested number of threads, a spinning
+    // one polls for ready handlers instead of blocking in the reactor
     std::vector<std::thread> v;
-    v.reserve(threads - 1);
-    for (auto i = threads - 1; i > 0; --i)
+    v.reserve(io.count_ + publishers + shards);
+    for (int i = 0; i < io.count_; ++i)
         v.emplace_back(
-            [&ioc]
+            [&ioc, &config, i, spin = io.busySpin_]
             {
-                ioc.run();
+                config.Apply(ThreadRole::Io, i);
+                if (!spin)
+                {
+                    ioc.run();
+                    return;
+                }
+                while (!ioc.stopped())
+                    if (ioc.poll() == 0)
+                        ThreadConfig::Pause();
             });
-    ioc.run();
-
-    orderBookManager = make_shared<OrderBookManager>();
-    clientSubList = make_unique<vector<string>>();
 
-    orderBookManager->AddSymbol("META", 5);
+    for (int i = 0; i < publishers; ++i)
+        v.emplace_back(
+            [&queues, &config, i]
+            {
+                config.Apply(ThreadRole::Publisher, i);
+                run_publisher(*queues[i]);
+            });
 
-    shared_ptr<OrderBook> orderBook = orderBookManager->GetOrderBook("META");
+    for (int i = 1; i < shards; ++i)
+        v.emplace_back(
+            [&, i]
+            {
+                config.Apply(ThreadRole::Matching, i);
+                run_matching(shardSymbols[i], shardQueues[i], shardSignals[i], config.GetMatchingInterval(), false);
+            });
 
-    while (1) {
-        vector<Trade> trades = orderBook->GenerateRandomOrder();
-        if (!trades.empty()) {
-            auto session = listener_->getSession();
-            session->write_trades(trades);
-        }
-        this_thread::sleep_for(std::chrono::milliseconds(500));
-    }
+    // This thread drives the first shard and keeps the event clock in step
+    config.Apply(ThreadRole::Matching, 0);
+    run_matching(shardSymbols[0], shardQueues[0], shardSignals[0], config.GetMatchingInterval(), true);
 
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
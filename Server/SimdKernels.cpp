@@ -0,0 +1,179 @@
+// SIMD kernels for depth aggregation and level scans
+// the order book keeps each side as parallel price/quantity arrays with the best level at the back,
+// so snapshots and sweeps walk those arrays backwards
+
+#include "common_includes.h"
+#include "OrderBook.h"
+#include "SimdKernels.h"
+#include <bit>
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SIMD_KERNELS_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define SIMD_TARGET_AVX2
+#else
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+using namespace std;
+
+static_assert(sizeof(LevelInfo) == 2 * sizeof(std::int32_t), "LevelInfo must pack as price/quantity pairs");
+static_assert(offsetof(LevelInfo, price_) == 0 && offsetof(LevelInfo, quantity_) == sizeof(Price), "LevelInfo must pack as price/quantity pairs");
+
+//------------------------------------------------------------------------------
+// scalar fallbacks
+
+static uint64_t SumQuantitiesScalar(const Quantity* quantities, size_t count) {
+	uint64_t sum = 0;
+	for (size_t i = 0; i < count; ++i)
+		sum += quantities[i];
+	return sum;
+}
+static size_t CountTrailingAtLeastScalar(const Price* prices, size_t count, Price bound) {
+	size_t matched = 0;
+	while (matched < count && prices[count - 1 - matched] >= bound)
+		++matched;
+	return matched;
+}
+static size_t CountTrailingAtMostScalar(const Price* prices, size_t count, Price bound) {
+	size_t matched = 0;
+	while (matched < count && prices[count - 1 - matched] <= bound)
+		++matched;
+	return matched;
+}
+static void PackLevelInfosReversedScalar(const Price* prices, const Quantity* quantities, size_t count, LevelInfo* out) {
+	for (size_t i = 0; i < count; ++i)
+		out[i] = LevelInfo{ prices[count - 1 - i], quantities[count - 1 - i] };
+}
+
+//------------------------------------------------------------------------------
+// AVX2
+
+#if defined(SIMD_KERNELS_X86)
+
+// widens each block of eight quantities into two vectors of 64-bit lanes before adding
+SIMD_TARGET_AVX2 static uint64_t SumQuantitiesAvx2(const Quantity* quantities, size_t count) {
+	__m256i sum = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(quantities + i));
+		sum = _mm256_add_epi64(sum, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(block)));
+		sum = _mm256_add_epi64(sum, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(block, 1)));
+	}
+
+	alignas(32) uint64_t lanes[4];
+	_mm256_store_si256(reinterpret_cast<__m256i*>(lanes), sum);
+
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3] + SumQuantitiesScalar(quantities + i, count - i);
+}
+
+// mask has a bit set per lane that fails the predicate, the highest one ends the trailing run
+SIMD_TARGET_AVX2 static size_t CountTrailingAvx2(const Price* prices, size_t count, Price bound, bool atLeast) {
+	const __m256i bounds = _mm256_set1_epi32(bound);
+	size_t end = count;
+
+	while (end >= 8) {
+		__m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prices + end - 8));
+		__m256i failed = atLeast ? _mm256_cmpgt_epi32(bounds, block) : _mm256_cmpgt_epi32(block, bounds);
+		unsigned mask = static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(failed)));
+
+		if (mask != 0)
+			return count - (end - 8 + bit_width(mask));
+		end -= 8;
+	}
+	size_t tail = atLeast ? CountTrailingAtLeastScalar(prices, end, bound) : CountTrailingAtMostScalar(prices, end, bound);
+	return (count - end) + tail;
+}
+SIMD_TARGET_AVX2 static size_t CountTrailingAtLeastAvx2(const Price* prices, size_t count, Price bound) {
+	return CountTrailingAvx2(prices, count, bound, true);
+}
+SIMD_TARGET_AVX2 static size_t CountTrailingAtMostAvx2(const Price* prices, size_t count, Price bound) {
+	return CountTrailingAvx2(prices, count, bound, false);
+}
+
+SIMD_TARGET_AVX2 static void PackLevelInfosReversedAvx2(const Price* prices, const Quantity* quantities, size_t count, LevelInfo* out) {
+	const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		size_t source = count - i - 8;
+		__m256i p = _mm256_permutevar8x32_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(prices + source)), reverse);
+		__m256i q = _mm256_permutevar8x32_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(quantities + source)), reverse);
+
+		// interleave into price/quantity pairs: lo holds levels 0,1,4,5 and hi holds 2,3,6,7
+		__m256i lo = _mm256_unpacklo_epi32(p, q);
+		__m256i hi = _mm256_unpackhi_epi32(p, q);
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i + 4), _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+	PackLevelInfosReversedScalar(prices, quantities, count - i, out + i);
+}
+
+static bool CpuSupportsAvx2() {
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+
+	__cpuid(info, 1);
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#else
+
+static bool CpuSupportsAvx2() { return false; }
+
+#endif
+
+//------------------------------------------------------------------------------
+// dispatch, resolved once
+
+struct SimdKernelTable {
+	bool avx2_;
+	uint64_t(*sumQuantities_)(const Quantity*, size_t);
+	size_t(*countTrailingAtLeast_)(const Price*, size_t, Price);
+	size_t(*countTrailingAtMost_)(const Price*, size_t, Price);
+	void(*packLevelInfosReversed_)(const Price*, const Quantity*, size_t, LevelInfo*);
+};
+
+static SimdKernelTable SelectKernels() {
+#if defined(SIMD_KERNELS_X86)
+	if (CpuSupportsAvx2())
+		return { true, SumQuantitiesAvx2, CountTrailingAtLeastAvx2, CountTrailingAtMostAvx2, PackLevelInfosReversedAvx2 };
+#endif
+	return { false, SumQuantitiesScalar, CountTrailingAtLeastScalar, CountTrailingAtMostScalar, PackLevelInfosReversedScalar };
+}
+
+static const SimdKernelTable& Kernels() {
+	static const SimdKernelTable kernels = SelectKernels();
+	return kernels;
+}
+
+uint64_t SumQuantities(const Quantity* quantities, size_t count) {
+	return Kernels().sumQuantities_(quantities, count);
+}
+size_t CountTrailingAtLeast(const Price* prices, size_t count, Price bound) {
+	return Kernels().countTrailingAtLeast_(prices, count, bound);
+}
+size_t CountTrailingAtMost(const Price* prices, size_t count, Price bound) {
+	return Kernels().countTrailingAtMost_(prices, count, bound);
+}
+void PackLevelInfosReversed(const Price* prices, const Quantity* quantities, size_t count, LevelInfo* out) {
+	Kernels().packLevelInfosReversed_(prices, quantities, count, out);
+}
+bool SimdKernelsUseAvx2() { return Kernels().avx2_; }
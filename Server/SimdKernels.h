@@ -0,0 +1,23 @@
+#ifndef SIMD_KERNELS_H
+#define SIMD_KERNELS_H
+
+#include "common_includes.h"
+#include "OrderBook.h"
+
+// vectorized scans over contiguous price level storage
+// every kernel has a scalar fallback, the AVX2 variant is picked once at startup when the cpu supports it
+
+// summed in 64 bits so adding up many deep levels cannot wrap
+std::uint64_t SumQuantities(const Quantity* quantities, std::size_t count);
+
+// number of entries at the back of prices with price >= bound (resp. <= bound),
+// stopping at the first entry from the back that fails
+std::size_t CountTrailingAtLeast(const Price* prices, std::size_t count, Price bound);
+std::size_t CountTrailingAtMost(const Price* prices, std::size_t count, Price bound);
+
+// writes count level infos taken from the back of prices/quantities, last entry first
+void PackLevelInfosReversed(const Price* prices, const Quantity* quantities, std::size_t count, LevelInfo* out);
+
+bool SimdKernelsUseAvx2();
+
+#endif
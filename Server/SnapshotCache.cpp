@@ -0,0 +1,83 @@
+// the snapshot cache keeps the last encoded snapshot of a symbol for each depth/encoding
+// pair and hands out the same buffer until the order book version moves on
+
+#include "common_includes.h"
+#include "OrderBook.h"
+#include "SnapshotCache.h"
+#include "EventClock.h"
+
+using namespace std;
+
+SnapshotCache::SnapshotCache(string symbol) : symbol_(std::move(symbol)) {}
+
+// "snapshot SYMBOL SEQUENCE TIMESTAMP" followed by one "B|A PRICE QUANTITY" line per level, best first
+// SEQUENCE is the last level update the snapshot includes and TIMESTAMP the EventClock time it was taken
+// level updates use the same line format plus the event timestamp, so a client parses both with one routine
+// the delta form, headed "dsnapshot", writes every price after the first as the step from the previous line
+static string EncodeLevels(const string& symbol, const OrderBook& orderBook, bool delta) {
+	const OrderBookLevelInfos levelInfos = orderBook.GetOrderInfos();
+
+	string snapshot = format("{} {} {} {}\n", delta ? "dsnapshot" : "snapshot", symbol, orderBook.GetUpdateSequence(), EventClock::Now());
+	int64_t previous = 0;
+	auto append = [&](char side, const LevelInfo& level) {
+		snapshot += format("{} {} {}\n", side, delta ? level.price_ - previous : level.price_, level.quantity_);
+		previous = level.price_;
+	};
+	for (const LevelInfo& level : levelInfos.GetBids())
+		append('B', level);
+	for (const LevelInfo& level : levelInfos.GetAsks())
+		append('A', level);
+	return snapshot;
+}
+
+string SnapshotCache::Encode(const OrderBook& orderBook, size_t depth, SnapshotEncoding encoding) const {
+	switch (encoding) {
+	case SnapshotEncoding::Levels:
+	case SnapshotEncoding::LevelsDelta:
+		// updates cover the whole book, so the snapshot they start from does too and depth does not apply
+		return EncodeLevels(symbol_, orderBook, encoding == SnapshotEncoding::LevelsDelta);
+	case SnapshotEncoding::Text:
+	default: {
+		const OrderBookLevelInfos levelInfos = orderBook.GetOrderInfos(depth);
+		const LevelInfos& bidLevelInfos = levelInfos.GetBids();
+		const LevelInfos& askLevelInfos = levelInfos.GetAsks();
+
+		depth = min(depth, bidLevelInfos.size());
+		depth = min(depth, askLevelInfos.size());
+
+		string snapshot = format(" {}    \t\t  {}   \n", "Bids", "Asks");
+
+		for (size_t level = 0; level < depth; ++level) {
+			snapshot += format("${}:{} \t\t ${}:{}\n",
+				bidLevelInfos[level].price_, bidLevelInfos[level].quantity_,
+				askLevelInfos[level].price_, askLevelInfos[level].quantity_);
+		}
+		return snapshot;
+	}
+	}
+}
+
+SnapshotBuffer SnapshotCache::GetSnapshot(const OrderBook& orderBook, size_t depth, SnapshotEncoding encoding) {
+	// held across the build so concurrent subscribers wait for one build instead of racing their own
+	lock_guard<mutex> lock(mutex_);
+
+	const uint64_t version = orderBook.GetVersion();
+
+	auto entry = find_if(entries_.begin(), entries_.end(), [depth, encoding](const Entry& candidate) {
+		return candidate.depth_ == depth && candidate.encoding_ == encoding;
+		});
+
+	if (entry != entries_.end() && entry->version_ == version)
+		return entry->buffer_;
+
+	SnapshotBuffer buffer = make_shared<const string>(Encode(orderBook, depth, encoding));
+
+	if (entry != entries_.end()) {
+		entry->version_ = version;
+		entry->buffer_ = buffer;
+	}
+	else {
+		entries_.push_back(Entry{ depth, encoding, version, buffer });
+	}
+	return buffer;
+}
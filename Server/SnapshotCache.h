@@ -0,0 +1,38 @@
+#ifndef SNAPSHOT_CACHE_H
+#define SNAPSHOT_CACHE_H
+
+#include "common_includes.h"
+#include "OrderBook.h"
+#include <mutex>
+
+enum class SnapshotEncoding {
+	Text,		// depth-limited bid/ask table for people
+	Levels,		// every level with the update sequence it reflects, the starting point for an incremental feed
+	LevelsDelta	// the same with each price written relative to the line before it
+};
+
+// encoded snapshots are immutable once built and shared by every subscriber that asks for them
+using SnapshotBuffer = std::shared_ptr<const std::string>;
+
+// per-symbol cache of encoded depth snapshots, keyed on (depth, encoding, book version)
+// a burst of subscribers arriving between two book changes costs a single snapshot build
+class SnapshotCache {
+private:
+	struct Entry {
+		std::size_t depth_;
+		SnapshotEncoding encoding_;
+		std::uint64_t version_;
+		SnapshotBuffer buffer_;
+	};
+
+	std::string symbol_;
+	std::mutex mutex_;
+	std::vector<Entry> entries_;	// one per (depth, encoding) in use, only a handful per symbol
+
+	std::string Encode(const OrderBook& orderBook, std::size_t depth, SnapshotEncoding encoding) const;
+public:
+	explicit SnapshotCache(std::string symbol);
+	SnapshotBuffer GetSnapshot(const OrderBook& orderBook, std::size_t depth, SnapshotEncoding encoding);
+};
+
+#endif
@@ -0,0 +1,203 @@
+// thread layout: parsing of role settings and applying them to the calling thread
+
+#include "common_includes.h"
+#include "ThreadConfig.h"
+#include <charconv>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+static string Trim(string_view text) {
+	size_t const first = text.find_first_not_of(" \t\r");
+	if (first == string_view::npos)
+		return {};
+	size_t const last = text.find_last_not_of(" \t\r");
+	return string(text.substr(first, last - first + 1));
+}
+
+static bool ParseInt(string_view text, int& value) {
+	auto [end, ec] = from_chars(text.data(), text.data() + text.size(), value);
+	return ec == errc{} && end == text.data() + text.size();
+}
+
+// one past the highest cpu Apply can pin to: the size of the affinity mask it passes
+#if defined(_WIN32)
+static constexpr int cpuLimit = 64;
+#elif defined(__linux__)
+static constexpr int cpuLimit = CPU_SETSIZE;
+#else
+static constexpr int cpuLimit = 1024;
+#endif
+
+// "2,4-7" lists cpus 2, 4, 5, 6 and 7, ids past the affinity mask are rejected
+static bool ParseCpus(string_view text, vector<int>& cpus) {
+	cpus.clear();
+	while (!text.empty()) {
+		size_t const end = min(text.find(','), text.size());
+		string const item = Trim(text.substr(0, end));
+		text.remove_prefix(min(end + 1, text.size()));
+
+		size_t const dash = item.find('-');
+		int first, last;
+		if (dash == string::npos) {
+			if (!ParseInt(item, first))
+				return false;
+			last = first;
+		}
+		else if (!ParseInt(string_view(item).substr(0, dash), first) || !ParseInt(string_view(item).substr(dash + 1), last)) {
+			return false;
+		}
+		if (first < 0 || last < first || last >= cpuLimit)
+			return false;
+		for (int cpu = first; cpu <= last; ++cpu)
+			cpus.push_back(cpu);
+	}
+	return !cpus.empty();
+}
+
+const char* ThreadConfig::RoleName(ThreadRole role) {
+	switch (role) {
+	case ThreadRole::Matching:
+		return "matching";
+	case ThreadRole::Publisher:
+		return "publisher";
+	case ThreadRole::Io:
+		return "io";
+	default:
+		return "unknown";
+	}
+}
+
+void ThreadConfig::Set(string const& setting) {
+	size_t const dot = setting.find('.');
+	size_t const equals = setting.find('=');
+	if (dot == string::npos || equals == string::npos || dot > equals)
+		throw logic_error(format("Thread setting ({}) is not of the form role.key=value.", setting));
+
+	string const role = Trim(string_view(setting).substr(0, dot));
+	string const key = Trim(string_view(setting).substr(dot + 1, equals - dot - 1));
+	string const value = Trim(string_view(setting).substr(equals + 1));
+
+	ThreadRoleSettings* settings = nullptr;
+	for (size_t r = 0; r < static_cast<size_t>(ThreadRole::Count); ++r)
+		if (role == RoleName(static_cast<ThreadRole>(r)))
+			settings = &roles_[r];
+	if (settings == nullptr)
+		throw logic_error(format("Thread setting ({}) names an unknown role.", setting));
+
+	if (key == "cpus") {
+		if (!ParseCpus(value, settings->cpus_))
+			throw logic_error(format("Thread setting ({}) has an invalid cpu list, cpu ids run from 0 to {}.", setting, cpuLimit - 1));
+		return;
+	}
+
+	int number = 0;
+	bool const parsed = ParseInt(value, number);
+	if (key == "count" && parsed && number > 0)
+		settings->count_ = number;
+	else if (key == "spin" && parsed && (number == 0 || number == 1))
+		settings->busySpin_ = number == 1;
+	else if (key == "priority" && parsed && number >= 0 && number <= 99)
+		settings->realtimePriority_ = number;
+	else if (key == "interval" && settings == &Get(ThreadRole::Matching) && parsed && number > 0)
+		matchingInterval_ = chrono::microseconds(number);
+	else
+		throw logic_error(format("Thread setting ({}) has an unknown key or an invalid value.", setting));
+}
+
+void ThreadConfig::Load(string const& path) {
+	ifstream file(path);
+	if (!file)
+		throw logic_error(format("Thread configuration ({}) cannot be opened.", path));
+
+	string line;
+	while (getline(file, line)) {
+		string const setting = Trim(string_view(line).substr(0, line.find('#')));
+		if (!setting.empty())
+			Set(setting);
+	}
+}
+
+ThreadRoleSettings const& ThreadConfig::Get(ThreadRole role) const {
+	return roles_[static_cast<size_t>(role)];
+}
+
+ThreadRoleSettings& ThreadConfig::Get(ThreadRole role) {
+	return roles_[static_cast<size_t>(role)];
+}
+
+chrono::microseconds ThreadConfig::GetMatchingInterval() const {
+	return matchingInterval_;
+}
+
+string ThreadConfig::Describe() const {
+	string description;
+	for (size_t r = 0; r < static_cast<size_t>(ThreadRole::Count); ++r) {
+		ThreadRoleSettings const& settings = roles_[r];
+		format_to(back_inserter(description), "{}{} x{} cpus", description.empty() ? "" : ", ", RoleName(static_cast<ThreadRole>(r)), settings.count_);
+		if (settings.cpus_.empty())
+			description += " any";
+		for (int cpu : settings.cpus_)
+			format_to(back_inserter(description), " {}", cpu);
+		if (settings.busySpin_)
+			description += " spin";
+		if (settings.realtimePriority_)
+			format_to(back_inserter(description), " rt {}", settings.realtimePriority_);
+	}
+	return description;
+}
+
+void ThreadConfig::Apply(ThreadRole role, int index) const {
+	ThreadRoleSettings const& settings = Get(role);
+	string const name = format("{}-{}", RoleName(role), index);
+
+#if defined(_WIN32)
+	if (!settings.cpus_.empty()) {
+		int const cpu = settings.cpus_[index % settings.cpus_.size()];
+		if (SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) == 0)
+			cerr << name << ": cannot pin to cpu " << cpu << "\n";
+	}
+	if (settings.realtimePriority_ && !SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL))
+		cerr << name << ": cannot raise thread priority\n";
+#elif defined(__linux__)
+	// shows up in top -H and perf, at most 15 characters
+	pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+
+	if (!settings.cpus_.empty()) {
+		int const cpu = settings.cpus_[index % settings.cpus_.size()];
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(cpu, &cpus);
+		if (int error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus))
+			cerr << name << ": cannot pin to cpu " << cpu << ": " << strerror(error) << "\n";
+	}
+	if (settings.realtimePriority_) {
+		sched_param parameters{};
+		parameters.sched_priority = settings.realtimePriority_;
+		if (int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &parameters))
+			cerr << name << ": cannot set SCHED_FIFO priority " << settings.realtimePriority_ << ": " << strerror(error) << "\n";
+	}
+#else
+	if (!settings.cpus_.empty() || settings.realtimePriority_)
+		cerr << name << ": cpu pinning and real-time priority are not supported on this platform\n";
+#endif
+}
+
+void ThreadConfig::Pause() {
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+	_mm_pause();
+#elif defined(__aarch64__)
+	asm volatile("yield");
+#endif
+}
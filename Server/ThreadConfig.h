@@ -0,0 +1,53 @@
+#ifndef THREAD_CONFIG_H
+#define THREAD_CONFIG_H
+
+#include "common_includes.h"
+
+// matching threads drive the order books, publishers encode and fan out what they produce,
+// io threads run the sockets
+enum class ThreadRole {
+	Matching,
+	Publisher,
+	Io,
+	Count
+};
+
+struct ThreadRoleSettings {
+	int count_{ 1 };
+	std::vector<int> cpus_;			// thread i of the role is pinned to cpus_[i % size], empty leaves it to the scheduler
+	bool busySpin_{ false };		// poll instead of blocking, for threads that own an isolated core
+	int realtimePriority_{ 0 };		// SCHED_FIFO priority 1-99, 0 keeps the default policy
+};
+
+// thread layout of the server, read from "role.key=value" settings given on the command line or one per line in a file:
+//   matching.count=1  matching.cpus=2  matching.spin=1  matching.priority=80  matching.interval=500000
+//   publisher.count=1 publisher.cpus=3
+//   io.count=4        io.cpus=4-7
+// cpus takes a comma separated list of cpus and ranges, interval is how often in microseconds the simulator
+// adds a random order to each book,
+// # starts a comment in a file
+class ThreadConfig {
+private:
+	ThreadRoleSettings roles_[static_cast<std::size_t>(ThreadRole::Count)];
+	std::chrono::microseconds matchingInterval_{ std::chrono::milliseconds(500) };
+public:
+	static const char* RoleName(ThreadRole role);
+
+	// throws logic_error naming the setting when the key or value is not understood
+	void Set(std::string const& setting);
+	void Load(std::string const& path);
+
+	ThreadRoleSettings const& Get(ThreadRole role) const;
+	ThreadRoleSettings& Get(ThreadRole role);
+	std::chrono::microseconds GetMatchingInterval() const;
+	std::string Describe() const;
+
+	// names, pins and prioritises the calling thread as thread index of role
+	// a setting the platform or the process' privileges refuse is reported on cerr and skipped
+	void Apply(ThreadRole role, int index) const;
+
+	// one iteration of a busy-wait loop, eases off the sibling hyperthread and the memory bus
+	static void Pause();
+};
+
+#endif
@@ -0,0 +1,58 @@
+// work stealing pool: per-thread task queues, idle threads steal from busy ones
+
+#include "common_includes.h"
+#include "WorkStealingPool.h"
+#include <thread>
+
+using namespace std;
+
+WorkStealingPool::WorkStealingPool(size_t threads)
+	: threads_{ max<size_t>(1, threads) }
+{ }
+
+bool WorkStealingPool::Take(Worker& worker, bool back, size_t& task) {
+	lock_guard<mutex> lock(worker.mutex_);
+	if (worker.tasks_.empty())
+		return false;
+
+	if (back) {
+		task = worker.tasks_.back();
+		worker.tasks_.pop_back();
+	}
+	else {
+		task = worker.tasks_.front();
+		worker.tasks_.pop_front();
+	}
+	return true;
+}
+
+void WorkStealingPool::Run(const vector<size_t>& tasks, const function<void(size_t)>& task) const {
+	const size_t threads = min(threads_, max<size_t>(1, tasks.size()));
+	deque<Worker> workers(threads);
+
+	// dealt in reverse so the first tasks sit at the back of each queue, where their owner starts
+	// thieves take from the front, the tasks that were going to run last
+	for (size_t i = tasks.size(); i-- > 0;)
+		workers[i % threads].tasks_.push_back(tasks[i]);
+
+	auto work = [&workers, &task, threads](size_t self) {
+		size_t next;
+		for (;;) {
+			bool found = Take(workers[self], true, next);
+			for (size_t offset = 1; !found && offset < threads; ++offset)
+				found = Take(workers[(self + offset) % threads], false, next);
+
+			// nothing new is ever queued, so every queue found empty stays empty
+			if (!found)
+				return;
+			task(next);
+		}
+	};
+
+	vector<thread> pool;
+	for (size_t i = 1; i < threads; ++i)
+		pool.emplace_back(work, i);
+	work(0);
+	for (auto& t : pool)
+		t.join();
+}
@@ -0,0 +1,29 @@
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include "common_includes.h"
+#include <functional>
+#include <mutex>
+
+// runs independent tasks on a fixed number of threads
+// tasks are dealt round robin up front, each worker takes its own from the back of its queue
+// and steals from the front of the others' once it runs dry, so uneven tasks still keep every thread busy
+// tasks must not throw, and which thread runs a task is the only thing that varies between runs
+class WorkStealingPool {
+private:
+	struct Worker {
+		std::mutex mutex_;
+		std::deque<std::size_t> tasks_;
+	};
+
+	std::size_t threads_;
+
+	static bool Take(Worker& worker, bool back, std::size_t& task);
+public:
+	explicit WorkStealingPool(std::size_t threads);
+
+	// runs task(i) for every i in tasks, earlier ones are started first, and returns once all have finished
+	void Run(const std::vector<std::size_t>& tasks, const std::function<void(std::size_t)>& task) const;
+};
+
+#endif
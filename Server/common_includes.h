@@ -1,28 +1,28 @@
-#ifndef COMMON_INCLUDES_H
-#define COMMON_INCLUDES_H
-
-#include <iostream>
-#include <map>
-#include <set>
-#include <list>
-#include <cmath>
-#include <ctime>
-#include <deque>
-#include <queue>
-#include <stack>
-#include <limits>
-#include <string>
-#include <vector>
-#include <numeric>
-#include <algorithm>
-#include <unordered_map>
-#include <memory>
-#include <variant>
-#include <optional>
-#include <tuple>
-#include <format>
-#include <fstream>
-#include <cstdlib>
-#include <chrono>
-
-#endif
+#ifndef COMMON_INCLUDES_H
+#define COMMON_INCLUDES_H
+
+#include <iostream>
+#include <map>
+#include <set>
+#include <list>
+#include <cmath>
+#include <ctime>
+#include <deque>
+#include <queue>
+#include <stack>
+#include <limits>
+#include <string>
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include <unordered_map>
+#include <memory>
+#include <variant>
+#include <optional>
+#include <tuple>
+#include <format>
+#include <fstream>
+#include <cstdlib>
+#include <chrono>
+
+#endif
@@ -0,0 +1,226 @@
+// columnar reader: maps export files and scans them, summarising trades and depth or dumping rows as text
+//
+// usage: columnar-reader [--dump <rows>] <file or directory>...
+// a directory stands for every .col file in it
+
+#include "../Server/ColumnarFormat.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#define COLUMNAR_READER_MMAP 0
+#else
+#define COLUMNAR_READER_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+namespace fs = std::filesystem;
+
+// a read-only view of a whole file, mapped where the platform allows, read into memory otherwise
+class MappedFile {
+private:
+	const unsigned char* data_{ nullptr };
+	size_t size_{ 0 };
+	vector<uint64_t> copy_;		// 8-byte aligned like a mapping
+public:
+	explicit MappedFile(const fs::path& path) {
+#if COLUMNAR_READER_MMAP
+		const int descriptor = open(path.c_str(), O_RDONLY);
+		if (descriptor < 0)
+			return;
+		size_ = static_cast<size_t>(lseek(descriptor, 0, SEEK_END));
+		if (size_ != 0) {
+			void* mapping = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, descriptor, 0);
+			if (mapping != MAP_FAILED) {
+				madvise(mapping, size_, MADV_SEQUENTIAL);
+				data_ = static_cast<const unsigned char*>(mapping);
+			}
+		}
+		close(descriptor);
+#else
+		ifstream file(path, ios::binary);
+		size_ = static_cast<size_t>(fs::file_size(path));
+		copy_.resize((size_ + 7) / 8);
+		file.read(reinterpret_cast<char*>(copy_.data()), static_cast<streamsize>(size_));
+		data_ = reinterpret_cast<const unsigned char*>(copy_.data());
+#endif
+	}
+	~MappedFile() {
+#if COLUMNAR_READER_MMAP
+		if (data_)
+			munmap(const_cast<unsigned char*>(data_), size_);
+#endif
+	}
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const unsigned char* Data() const { return data_; }
+	size_t Size() const { return data_ ? size_ : 0; }
+};
+
+struct ScanTotals {
+	uint64_t rows_{ 0 };
+	uint64_t blocks_{ 0 };
+	uint64_t bytes_{ 0 };
+	uint64_t quantity_{ 0 };
+	double notional_{ 0 };
+	int64_t firstTimestamp_{ numeric_limits<int64_t>::max() };
+	int64_t lastTimestamp_{ numeric_limits<int64_t>::min() };
+	int64_t lowPrice_{ numeric_limits<int64_t>::max() };
+	int64_t highPrice_{ numeric_limits<int64_t>::min() };
+	uint64_t snapshots_{ 0 };
+};
+
+static const char* const TradeNames[] = { "sequence", "timestamp", "bid_id", "bid_price", "ask_id", "ask_price", "quantity" };
+static const char* const DepthNames[] = { "sequence", "timestamp", "side", "level", "price", "quantity" };
+
+// walks the blocks of one file, stops with a message at the first one that does not fit
+static bool Scan(const fs::path& path, size_t dumpRows, ScanTotals& totals) {
+	MappedFile mapped(path);
+	const unsigned char* data = mapped.Data();
+	const size_t size = mapped.Size();
+
+	ColumnarFileHeader header;
+	if (size < sizeof(header) || memcmp(data, ColumnarCodec::Magic, sizeof(header.magic_)) != 0) {
+		cerr << path.string() << ": not a columnar export file\n";
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+	const bool trades = header.kind_ == ColumnarKind::Trades;
+	const char* const* names = trades ? TradeNames : DepthNames;
+	const size_t columns = trades ? static_cast<size_t>(TradeColumn::Count) : static_cast<size_t>(DepthColumn::Count);
+	if (header.version_ != ColumnarCodec::Version || header.columns_ != columns) {
+		cerr << path.string() << ": unsupported version or layout\n";
+		return false;
+	}
+
+	if (dumpRows) {
+		for (size_t column = 0; column < columns; ++column)
+			cout << (column ? " " : "") << names[column];
+		cout << "\n";
+	}
+
+	int64_t lastSnapshot = -1;
+	size_t offset = sizeof(header);
+	while (offset + sizeof(ColumnarBlockHeader) <= size) {
+		const auto* block = reinterpret_cast<const ColumnarBlockHeader*>(data + offset);
+		if (block->magic_ != ColumnarCodec::BlockMagic || block->columns_ != columns) {
+			cerr << path.string() << ": damaged block at offset " << offset << "\n";
+			return false;
+		}
+		// the server may still be writing the last block of a live file
+		if (block->bytes_ > size - offset)
+			break;
+		const auto* columnHeaders = reinterpret_cast<const ColumnarColumnHeader*>(block + 1);
+		const uint64_t* words[ColumnarCodec::MaxColumns];
+		const auto* packed = reinterpret_cast<const uint64_t*>(columnHeaders + columns);
+		for (size_t column = 0; column < columns; ++column) {
+			words[column] = packed;
+			packed += columnHeaders[column].bytes_ / 8;
+		}
+
+		auto value = [&](size_t column, size_t row) {
+			return ColumnarCodec::Unpack(words[column], row, columnHeaders[column].base_, columnHeaders[column].bitWidth_);
+		};
+
+		// the block header holds each column's minimum, the timestamp range needs no row scan
+		const size_t timestampColumn = trades ? static_cast<size_t>(TradeColumn::Timestamp) : static_cast<size_t>(DepthColumn::Timestamp);
+		totals.firstTimestamp_ = min(totals.firstTimestamp_, columnHeaders[timestampColumn].base_);
+
+		for (size_t row = 0; row < block->rows_; ++row) {
+			if (trades) {
+				// each side is reported at its own order's price, the ask's stands for the trade
+				const int64_t price = value(static_cast<size_t>(TradeColumn::AskPrice), row);
+				const int64_t quantity = value(static_cast<size_t>(TradeColumn::Quantity), row);
+				totals.quantity_ += static_cast<uint64_t>(quantity);
+				totals.notional_ += static_cast<double>(price) * static_cast<double>(quantity);
+				totals.lowPrice_ = min(totals.lowPrice_, price);
+				totals.highPrice_ = max(totals.highPrice_, price);
+			}
+			else {
+				const int64_t sequence = value(static_cast<size_t>(DepthColumn::Sequence), row);
+				totals.snapshots_ += sequence != lastSnapshot;
+				lastSnapshot = sequence;
+			}
+			totals.lastTimestamp_ = max(totals.lastTimestamp_, value(timestampColumn, row));
+
+			if (totals.rows_ + row < dumpRows) {
+				for (size_t column = 0; column < columns; ++column)
+					cout << (column ? " " : "") << value(column, row);
+				cout << "\n";
+			}
+		}
+
+		totals.rows_ += block->rows_;
+		totals.blocks_ += 1;
+		offset += static_cast<size_t>(block->bytes_);
+	}
+	totals.bytes_ += size;
+	return true;
+}
+
+int main(int argc, char* argv[]) {
+	size_t dumpRows = 0;
+	vector<fs::path> files;
+	for (int i = 1; i < argc; ++i) {
+		const string argument = argv[i];
+		if (argument == "--dump" && i + 1 < argc) {
+			dumpRows = static_cast<size_t>(max(0, atoi(argv[++i])));
+		}
+		else if (fs::is_directory(argument)) {
+			for (const auto& entry : fs::directory_iterator(argument))
+				if (entry.is_regular_file() && entry.path().extension() == ".col")
+					files.push_back(entry.path());
+		}
+		else {
+			files.push_back(argument);
+		}
+	}
+	if (files.empty()) {
+		cerr <<
+			"Usage: columnar-reader [--dump <rows>] <file or directory>...\n" <<
+			"Example:\n" <<
+			"    columnar-reader export\n" <<
+			"    columnar-reader --dump 20 export/META.trades.col\n";
+		return EXIT_FAILURE;
+	}
+	sort(files.begin(), files.end());
+
+	const auto start = chrono::steady_clock::now();
+	ScanTotals all;
+	bool ok = true;
+	for (const auto& file : files) {
+		ScanTotals totals;
+		ok = Scan(file, dumpRows, totals) && ok;
+
+		cout << file.filename().string() << ": " << totals.rows_ << " rows in " << totals.blocks_ << " blocks, "
+			<< totals.bytes_ << " bytes (" << (totals.rows_ ? static_cast<double>(totals.bytes_) / static_cast<double>(totals.rows_) : 0) << "/row)";
+		if (totals.quantity_)
+			cout << ", volume " << totals.quantity_ << " vwap " << totals.notional_ / static_cast<double>(totals.quantity_)
+				<< " low " << totals.lowPrice_ << " high " << totals.highPrice_;
+		if (totals.snapshots_)
+			cout << ", " << totals.snapshots_ << " snapshots";
+		if (totals.rows_)
+			cout << ", time " << totals.firstTimestamp_ << " to " << totals.lastTimestamp_;
+		cout << "\n";
+
+		all.rows_ += totals.rows_;
+		all.bytes_ += totals.bytes_;
+	}
+	const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	cout << files.size() << " files, " << all.rows_ << " rows, " << all.bytes_ << " bytes scanned in " << seconds << "s, "
+		<< static_cast<double>(all.rows_) / seconds << " rows/s" << endl;
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}